@@ -1,19 +1,25 @@
 #include "server_manager.hpp"
+#include <algorithm>
 #include <atomic>
 #include <array>
 #include <vector>
 #include <chrono>
+#include <condition_variable>
 #include <csignal>
 #include <cstdint>
 #include <cstdlib>
 #include <filesystem>
+#include <fstream>
+#include <functional>
 #include <iostream>
 #include <iomanip>
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <string_view>
 #include <thread>
 #include <system_error>
+#include <unordered_map>
 
 #if defined(_WIN32)
 #include <windows.h>
@@ -28,6 +34,7 @@
 #include "../../../libs/config/device_registry.hpp"
 #include "../../../libs/config/config_manager.hpp"
 #include "plugin/plugin_manager.hpp"
+#include "core/streams/capture_worker_pool.hpp"
 #include "core/streams/stream_dispatcher.hpp"
 #include "core/streams/video_capture_manager.hpp"
 #include "core/streams/video_processor.hpp"
@@ -87,7 +94,9 @@ nlohmann::json makeServerOriginMetadata() {
         {"rtmp", {{"enabled", false}, {"url", std::string{}}, {"stream_key", std::string{}}}},
         {"hls", {{"enabled", false}, {"playlist", std::string{}}, {"segment_path", std::string{}}}},
         {"rtsp", {{"enabled", false}, {"url", std::string{}}, {"stream_key", std::string{}}}},
-        {"webrtc", {{"enabled", false}}}
+        {"webrtc", {{"enabled", false}}},
+        {"websocket", {{"enabled", false}}},
+        {"encoder", {{"enabled", true}}}
     };
     return metadata;
 }
@@ -190,6 +199,177 @@ std::string resolveConfigDbPath(const std::string& argument, const char* executa
     return postgresConnectionString;
 }
 
+// Inference settings come from the flat "detection.inference.*" keys in the user config
+void applyInferenceConfig() {
+    SnowOwl::Config::ConfigManager configMgr;
+    if (!configMgr.load()) {
+        return;
+    }
+
+    auto options = SnowOwl::Server::Core::VideoProcessor::inferenceOptions();
+    auto readInt = [&](const char* key, int fallback) {
+        if (!configMgr.has(key)) {
+            return fallback;
+        }
+        const auto value = configMgr.get(key);
+        return value.is_number_integer() ? value.get<int>() : fallback;
+    };
+
+    options.maxBatch = static_cast<std::size_t>(std::max(1, readInt("detection.inference.max_batch", static_cast<int>(options.maxBatch))));
+    options.maxWait = std::chrono::milliseconds(std::max(0, readInt("detection.inference.max_wait_ms", static_cast<int>(options.maxWait.count()))));
+    options.intraOpThreads = std::max(1, readInt("detection.inference.intra_op_threads", options.intraOpThreads));
+    options.interOpThreads = std::max(1, readInt("detection.inference.inter_op_threads", options.interOpThreads));
+
+    SnowOwl::Server::Core::VideoProcessor::setInferenceOptions(options);
+}
+
+// The motion gate section of config/detection_config.json; null when no file is found
+nlohmann::json loadMotionConfig() {
+    for (const char* path : {"config/detection_config.json", "/etc/snowowl/detection_config.json",
+                             "../config/detection_config.json"}) {
+        std::ifstream file(path);
+        if (!file.is_open()) {
+            continue;
+        }
+        try {
+            nlohmann::json config;
+            file >> config;
+            if (config.contains("detection") && config["detection"].contains("motion")) {
+                return config["detection"]["motion"];
+            }
+        } catch (const std::exception& e) {
+            std::cerr << "Error loading " << path << ": " << e.what() << std::endl;
+        }
+        return nullptr;
+    }
+    return nullptr;
+}
+
+// detection_config.json supplies the motion gate; the flat "detection.*" keys
+// in the user config override it, as they do for the inference settings
+void configureProcessor(SnowOwl::Server::Core::VideoProcessor& processor, const nlohmann::json& motionConfig) {
+    if (motionConfig.is_object()) {
+        processor.setMotionGateConfig(SnowOwl::Server::Core::MotionGateConfig::fromJson(motionConfig));
+    }
+
+    SnowOwl::Config::ConfigManager configMgr;
+    if (configMgr.load()) {
+        processor.applyConfiguration(configMgr);
+    }
+}
+
+// Runs every edge device's frames through a VideoProcessor of its own, so
+// motion gates never mix backgrounds or resolutions and a busy device cannot
+// push out another one's frames. Each device keeps only its newest frame and
+// is drained on the shared capture pool one frame per turn, like a
+// VideoCaptureManager.
+class EdgeFrameRouter {
+public:
+    using Setup = std::function<void(SnowOwl::Server::Core::VideoProcessor&)>;
+    // primary is set for the device whose frames also feed the outputs
+    using Handler = std::function<void(const cv::Mat&, const std::vector<SnowOwl::Detection::DetectionResult>&,
+                                       bool primary)>;
+
+    // primaryProcessor serves primaryDevice, or the first device to send a
+    // frame when that is empty; with primaryDevice set no other device is
+    // processed
+    EdgeFrameRouter(std::unique_ptr<SnowOwl::Server::Core::VideoProcessor> primaryProcessor,
+                    std::string primaryDevice, Setup setup, Handler handler)
+        : pool_(SnowOwl::Server::Core::CaptureWorkerPool::shared())
+        , primaryProcessor_(std::move(primaryProcessor))
+        , primaryDevice_(std::move(primaryDevice))
+        , onlyPrimary_(!primaryDevice_.empty())
+        , setup_(std::move(setup))
+        , handler_(std::move(handler)) {}
+
+    ~EdgeFrameRouter() { stop(); }
+
+    EdgeFrameRouter(const EdgeFrameRouter&) = delete;
+    EdgeFrameRouter& operator=(const EdgeFrameRouter&) = delete;
+
+    void push(const SnowOwl::Modules::Ingest::ReceivedFrame& received) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopping_ || received.frame.empty() || (onlyPrimary_ && received.deviceId != primaryDevice_)) {
+            return;
+        }
+
+        auto& device = devices_[received.deviceId];
+        if (!device) {
+            device = std::make_unique<Device>();
+            if (primaryProcessor_ && (primaryDevice_.empty() || received.deviceId == primaryDevice_)) {
+                primaryDevice_ = received.deviceId;
+                device->processor = std::move(primaryProcessor_);
+                device->primary = true;
+            } else {
+                device->processor = std::make_unique<SnowOwl::Server::Core::VideoProcessor>();
+                setup_(*device->processor);
+            }
+            std::cout << "📥 StreamReceiver: processing frames from " << received.deviceId << std::endl;
+        }
+
+        device->pending = received.frame;
+        if (!device->scheduled) {
+            device->scheduled = true;
+            auto* target = device.get();
+            pool_.submit([this, target] { drain(*target); });
+        }
+    }
+
+    // Waits for queued frames to finish; later frames are ignored
+    void stop() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        stopping_ = true;
+        idleCv_.wait(lock, [this] {
+            return std::none_of(devices_.begin(), devices_.end(), [](const auto& entry) {
+                return entry.second->scheduled;
+            });
+        });
+    }
+
+private:
+    struct Device {
+        std::unique_ptr<SnowOwl::Server::Core::VideoProcessor> processor;
+        cv::Mat pending;
+        bool scheduled{false};
+        bool primary{false};
+    };
+
+    void drain(Device& device) {
+        cv::Mat frame;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            frame = std::move(device.pending);
+            device.pending = cv::Mat();
+        }
+
+        if (!frame.empty()) {
+            const auto detections = device.processor->processFrame(frame);
+            handler_(frame, detections, device.primary);
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!stopping_ && !device.pending.empty()) {
+            // One frame per turn, then requeue behind the other devices
+            pool_.submit([this, target = &device] { drain(*target); });
+            return;
+        }
+        device.scheduled = false;
+        idleCv_.notify_all();
+    }
+
+    SnowOwl::Server::Core::CaptureWorkerPool& pool_;
+    std::unique_ptr<SnowOwl::Server::Core::VideoProcessor> primaryProcessor_;
+    std::string primaryDevice_;
+    const bool onlyPrimary_;
+    Setup setup_;
+    Handler handler_;
+
+    std::mutex mutex_;
+    std::condition_variable idleCv_;
+    std::unordered_map<std::string, std::unique_ptr<Device>> devices_;
+    bool stopping_{false};
+};
+
 std::atomic<bool> g_running{true};
 
 void handleSignal(int) {
@@ -205,6 +385,9 @@ struct SourceRouting {
     std::string secondaryUri;
     bool useForwardStream{false};
     std::string forwardDeviceId;
+    SnowOwl::Server::Core::CaptureQueueConfig queue;
+    bool passthrough{true};
+    int detectionFps{0};
 };
 
 SourceRouting deriveSourceConfig(const SnowOwl::Config::DeviceRecord& device) {
@@ -306,6 +489,17 @@ SourceRouting deriveSourceConfig(const SnowOwl::Config::DeviceRecord& device) {
             setSecondary(metadata.value("rtsp_uri", std::string{}));
         }
 
+        if (metadata.contains("capture_queue") && metadata["capture_queue"].is_object()) {
+            const auto& queue = metadata["capture_queue"];
+            const int capacity = queue.value("capacity", static_cast<int>(routing.queue.capacity));
+            routing.queue.capacity = capacity < 1 ? 1 : static_cast<std::size_t>(capacity);
+            routing.queue.dropPolicy = SnowOwl::Server::Core::frameDropPolicyFromString(
+                queue.value("drop_policy", SnowOwl::Server::Core::toString(routing.queue.dropPolicy)));
+        }
+
+        routing.passthrough = metadata.value("passthrough", routing.passthrough);
+        routing.detectionFps = std::max(0, metadata.value("detection_fps", routing.detectionFps));
+
         if (!routing.useForwardStream && metadata.contains("edge_device") && metadata["edge_device"].is_object()) {
             const auto& edge = metadata["edge_device"];
             if (edge.value("forward_enabled", false)) {
@@ -406,6 +600,30 @@ SnowOwl::Server::Core::StreamTargetProfile deriveStreamProfile(const SnowOwl::Co
     if (const auto it = outputs.find("webrtc"); it != outputs.end()) {
         parseConfig(it.value(), profile.webrtc);
     }
+    if (const auto it = outputs.find("websocket"); it != outputs.end()) {
+        parseConfig(it.value(), profile.websocket);
+        // start_streaming subscribes to the device id unless told otherwise
+        if (profile.websocket.enabled && !profile.websocket.parameters.count("channel")) {
+            profile.websocket.parameters["channel"] = std::to_string(device.id);
+        }
+    }
+    if (const auto it = outputs.find("encoder"); it != outputs.end()) {
+        parseConfig(it.value(), profile.encoder);
+    }
+
+    // All muxers share one encoder, so settings still given per muxer only
+    // apply when "encoder" leaves them out; the first enabled muxer wins
+    for (const auto* muxer : {&profile.rtmp, &profile.rtsp, &profile.hls, &profile.websocket}) {
+        if (!muxer->enabled) {
+            continue;
+        }
+        for (const char* key : {"bitrate_kbps", "gop", "fps", "preset"}) {
+            const auto value = muxer->parameters.find(key);
+            if (value != muxer->parameters.end()) {
+                profile.encoder.parameters.emplace(key, value->second);
+            }
+        }
+    }
 
     if (!SnowOwl::Server::Core::hasAnyEnabled(profile)) {
         profile.tcp.enabled = true;
@@ -414,9 +632,30 @@ SnowOwl::Server::Core::StreamTargetProfile deriveStreamProfile(const SnowOwl::Co
     return profile;
 }
 
+struct OutputDrops {
+    std::uint64_t frames{0};
+    std::uint64_t events{0};
+};
+
+// Reports the outputs that dropped frames or event batches since the last call
+void logOutputDrops(const std::string& label, const SnowOwl::Server::Core::StreamDispatcher& dispatcher,
+                    std::unordered_map<std::string, OutputDrops>& previous) {
+    for (const auto& stats : dispatcher.outputStats()) {
+        auto& last = previous[label + "/" + stats.name];
+        if (stats.queue.dropped == last.frames && stats.droppedEvents == last.events) {
+            continue;
+        }
+        std::cout << "  ⚠️  " << label << " output " << stats.name << " dropped "
+                  << (stats.queue.dropped - last.frames) << " frames and "
+                  << (stats.droppedEvents - last.events) << " event batches (queue "
+                  << stats.queue.depth << "/" << stats.queue.capacity << ")" << std::endl;
+        last = {stats.queue.dropped, stats.droppedEvents};
+    }
+}
+
 void printStreamProfile(const SnowOwl::Server::Core::StreamTargetProfile& profile) {
     auto printEntry = [](const char* name, const SnowOwl::Server::Core::StreamOutputConfig& cfg) {
-        std::cout << "  - " << std::setw(6) << std::left << name << " : "
+        std::cout << "  - " << std::setw(9) << std::left << name << " : "
                   << (cfg.enabled ? "enabled" : "disabled");
         if (!cfg.parameters.empty()) {
             std::cout << " (";
@@ -443,6 +682,16 @@ void printStreamProfile(const SnowOwl::Server::Core::StreamTargetProfile& profil
     printEntry("rtsp", profile.rtsp);
     printEntry("hls", profile.hls);
     printEntry("webrtc", profile.webrtc);
+    printEntry("websocket", profile.websocket);
+    if (!profile.encoder.parameters.empty()) {
+        std::cout << "  - " << std::setw(9) << "encoder" << " : shared by packet outputs (";
+        bool first = true;
+        for (const auto& [key, value] : profile.encoder.parameters) {
+            std::cout << (first ? "" : ", ") << key << '=' << value;
+            first = false;
+        }
+        std::cout << ')' << std::endl;
+    }
 
     std::cout.flags(previousFlags);
     std::cout.fill(previousFill);
@@ -1039,8 +1288,17 @@ int ServerManager::startServer(const po::variables_map& vm) {
     const bool useStreamReceiver = routing.useForwardStream
         || (routing.sourceKind == CaptureSourceKind::Camera && routing.primaryUri.empty());
 
+    applyInferenceConfig();
+    const auto motionConfig = loadMotionConfig();
+
     SnowOwl::Modules::Ingest::StreamReceiver receiver;
     SnowOwl::Server::Core::VideoCaptureManager captureManager;
+    // Streams of the extra capture devices; declared first so their managers stop before them
+    // Keyed by device id
+    std::vector<std::pair<int, std::unique_ptr<SnowOwl::Server::Core::StreamDispatcher>>> extraDispatchers;
+    std::vector<std::unique_ptr<SnowOwl::Server::Core::VideoCaptureManager>> extraCaptureManagers;
+    // Capture callbacks run on the shared worker pool, one device at a time each
+    std::mutex publishMutex;
     SnowOwl::Server::Core::StreamDispatcher streamDispatcher;
     streamDispatcher.configure(streamProfile);
 
@@ -1062,6 +1320,8 @@ int ServerManager::startServer(const po::variables_map& vm) {
     if (useStreamReceiver) {
         receiverProcessor = std::make_unique<SnowOwl::Server::Core::VideoProcessor>();
     }
+    // Takes over receiverProcessor for the primary edge device
+    std::unique_ptr<EdgeFrameRouter> edgeRouter;
 
 #ifdef HAVE_GRPC
     std::unique_ptr<SnowOwl::Server::Modules::Api::Grpc::GrpcServer> grpcServer;
@@ -1070,9 +1330,20 @@ int ServerManager::startServer(const po::variables_map& vm) {
 
     SnowOwl::Server::Modules::Network::NetworkServer server(listenPort);
 
+    // Frames that only feed detection are decoded near the detector's 640
+    // input; stream outputs and connected TCP preview clients get full size
+    const bool detectionOnly = [&]() {
+        auto outputs = streamProfile;
+        outputs.tcp.enabled = false;
+        return !SnowOwl::Server::Core::hasAnyEnabled(outputs);
+    }();
+    auto receiverDecodeTarget = [&]() {
+        return detectionOnly && server.clientCount() == 0 ? 640 : 0;
+    };
+
     if (receiverProcessor) {
-        receiverProcessor->setNetworkServer(&server);
         receiverProcessor->setStreamProfile(streamProfile);
+        configureProcessor(*receiverProcessor, motionConfig);
     }
 
     std::cout << "===============================================================================\n";
@@ -1133,6 +1404,31 @@ int ServerManager::startServer(const po::variables_map& vm) {
             return 1;
         }
 
+        receiver.setDecodeTargetSize(receiverDecodeTarget());
+
+        edgeRouter = std::make_unique<EdgeFrameRouter>(std::move(receiverProcessor), routing.forwardDeviceId,
+            [&](SnowOwl::Server::Core::VideoProcessor& processor) {
+                processor.setStreamProfile(streamProfile);
+                configureProcessor(processor, motionConfig);
+            },
+            [&](const cv::Mat& frame, const std::vector<SnowOwl::Detection::DetectionResult>& detections, bool primary) {
+                // Only the primary device is streamed, like the active capture device
+                std::lock_guard<std::mutex> lock(publishMutex);
+                if (primary) {
+                    server.broadcastFrame(frame);
+                    streamDispatcher.onFrame(frame);
+                }
+                if (!detections.empty()) {
+                    server.broadcastEvents(detections);
+                }
+                if (primary || !detections.empty()) {
+                    streamDispatcher.onEvents(detections);
+                }
+            });
+        receiver.subscribe([router = edgeRouter.get()](const SnowOwl::Modules::Ingest::ReceivedFrame& received) {
+            router->push(received);
+        });
+
         if (!receiver.start(ingestPort)) {
             std::cerr << "❌ Failed to start edge stream receiver on port " << ingestPort << std::endl;
             if (unifiedApiServer) {
@@ -1163,24 +1459,36 @@ int ServerManager::startServer(const po::variables_map& vm) {
 
         SnowOwl::Server::Core::CaptureSourceConfig managerConfig;
         managerConfig.kind = routing.sourceKind;
+        managerConfig.deviceId = activeDevice->id;
         managerConfig.cameraId = routing.cameraId;
         managerConfig.primaryUri = routing.primaryUri;
         managerConfig.secondaryUri = routing.secondaryUri;
+        managerConfig.queue = routing.queue;
+        managerConfig.passthrough = routing.passthrough;
+        managerConfig.detectionFps = routing.detectionFps;
 
         SnowOwl::Server::Core::VideoCaptureManager::FrameCallback frameCallback = [&](cv::Mat& frame) {
             if (!frame.empty()) {
+                std::lock_guard<std::mutex> lock(publishMutex);
                 server.broadcastFrame(frame);
                 streamDispatcher.onFrame(frame);
             }
         };
 
         auto detectionCallback = [&](const std::vector<SnowOwl::Detection::DetectionResult>& detections) {
+            std::lock_guard<std::mutex> lock(publishMutex);
             server.broadcastEvents(detections);
             streamDispatcher.onEvents(detections);
         };
 
-        captureManager.getProcessor().setNetworkServer(&server);
+        // Events reach the network server through detectionCallback only
         captureManager.getProcessor().setStreamProfile(streamProfile);
+        if (SnowOwl::Server::Core::hasPacketOutputs(streamProfile)) {
+            captureManager.setEncodedSampleCallback([&](GstSample* sample) {
+                streamDispatcher.onEncodedSample(sample);
+            });
+        }
+        configureProcessor(captureManager.getProcessor(), motionConfig);
 
         if (!captureManager.start(managerConfig, frameCallback, detectionCallback)) {
             std::cerr << "❌ Error: Failed to start video capture" << std::endl;
@@ -1194,13 +1502,86 @@ int ServerManager::startServer(const po::variables_map& vm) {
             }
             return 1;
         }
+
+        // Every other enabled capture device runs detection alongside the active one
+        for (const auto& device : registry.listDevices()) {
+            if (!device.enabled || device.id == activeDevice->id) {
+                continue;
+            }
+            if (device.kind != SnowOwl::Config::DeviceKind::Camera
+                && device.kind != SnowOwl::Config::DeviceKind::RTSP
+                && device.kind != SnowOwl::Config::DeviceKind::RTMP
+                && device.kind != SnowOwl::Config::DeviceKind::File) {
+                continue;
+            }
+
+            const auto extraRouting = deriveSourceConfig(device);
+            if (extraRouting.useForwardStream
+                || (extraRouting.sourceKind == CaptureSourceKind::Camera && extraRouting.primaryUri.empty())) {
+                continue;
+            }
+
+            SnowOwl::Server::Core::CaptureSourceConfig extraConfig;
+            extraConfig.kind = extraRouting.sourceKind;
+            extraConfig.deviceId = device.id;
+            extraConfig.cameraId = extraRouting.cameraId;
+            extraConfig.primaryUri = extraRouting.primaryUri;
+            extraConfig.secondaryUri = extraRouting.secondaryUri;
+            extraConfig.queue = extraRouting.queue;
+            extraConfig.passthrough = extraRouting.passthrough;
+            extraConfig.detectionFps = extraRouting.detectionFps;
+
+            const auto extraProfile = deriveStreamProfile(device);
+            auto extraManager = std::make_unique<SnowOwl::Server::Core::VideoCaptureManager>();
+            extraManager->getProcessor().setStreamProfile(extraProfile);
+            configureProcessor(extraManager->getProcessor(), motionConfig);
+
+            // Devices with their own muxer outputs stream through their own dispatcher
+            std::unique_ptr<SnowOwl::Server::Core::StreamDispatcher> extraDispatcher;
+            SnowOwl::Server::Core::VideoCaptureManager::FrameCallback extraFrameCallback;
+            if (SnowOwl::Server::Core::hasPacketOutputs(extraProfile)) {
+                extraDispatcher = std::make_unique<SnowOwl::Server::Core::StreamDispatcher>();
+                extraDispatcher->configure(extraProfile);
+                if (!extraDispatcher->startOutputs()) {
+                    std::cerr << "  ⚠️  Warning: Failed to start stream outputs for device " << device.name
+                              << " (" << device.id << ")" << std::endl;
+                    extraDispatcher.reset();
+                }
+            }
+            if (extraDispatcher) {
+                auto* dispatcher = extraDispatcher.get();
+                extraFrameCallback = [dispatcher](cv::Mat& frame) {
+                    if (!frame.empty()) {
+                        dispatcher->onFrame(frame);
+                    }
+                };
+                extraManager->setEncodedSampleCallback([dispatcher](GstSample* sample) {
+                    dispatcher->onEncodedSample(sample);
+                });
+            }
+
+            if (!extraManager->start(extraConfig, extraFrameCallback, detectionCallback)) {
+                std::cerr << "  ⚠️  Warning: Failed to start capture for device " << device.name
+                          << " (" << device.id << ")" << std::endl;
+                continue;
+            }
+            if (extraDispatcher) {
+                extraDispatchers.emplace_back(device.id, std::move(extraDispatcher));
+            }
+
+            std::cout << "  📷 Capturing " << device.name << " (" << toString(device.kind) << ")" << std::endl;
+            extraCaptureManagers.push_back(std::move(extraManager));
+        }
     }
 
     if (!server.startNetworkSystem()) {
         std::cerr << "  ❌ Error: Failed to start server" << std::endl;
         if (useStreamReceiver) {
             receiver.stop();
+            edgeRouter->stop();
         } else {
+            extraCaptureManagers.clear();
+            extraDispatchers.clear();
             captureManager.stop();
         }
         if (outputsStarted) {
@@ -1228,58 +1609,32 @@ int ServerManager::startServer(const po::variables_map& vm) {
     std::cout << "  🚀 SnowOwl Server Started Successfully!\n";
     std::cout << "===============================================================================\n";
 
-    std::string activeForwardDevice;
+    constexpr auto kOutputStatsInterval = std::chrono::seconds(60);
+    auto nextOutputStats = std::chrono::steady_clock::now() + kOutputStatsInterval;
+    std::unordered_map<std::string, OutputDrops> outputDrops;
     while (g_running.load()) {
         if (useStreamReceiver) {
-            SnowOwl::Modules::Ingest::ReceivedFrame received;
-            if (!receiver.latestFrame(received)) {
-                std::this_thread::sleep_for(std::chrono::milliseconds(20));
-                continue;
-            }
-            if (!routing.forwardDeviceId.empty()
-                && !received.deviceId.empty()
-                && received.deviceId != routing.forwardDeviceId) {
-                std::this_thread::sleep_for(std::chrono::milliseconds(20));
-                continue;
-            }
-
-            if (activeForwardDevice.empty() && !received.deviceId.empty()) {
-                activeForwardDevice = received.deviceId;
-                if (!routing.forwardDeviceId.empty() && routing.forwardDeviceId != activeForwardDevice) {
-                    std::cout << "📥 StreamReceiver: processing frames from " << activeForwardDevice
-                              << " (expected " << routing.forwardDeviceId << ")" << std::endl;
-                } else {
-                    std::cout << "📥 StreamReceiver: processing frames from " << activeForwardDevice << std::endl;
-                }
-            }
-
-            cv::Mat frame = received.frame.clone();
-            std::vector<SnowOwl::Detection::DetectionResult> detections;
-            if (!frame.empty() && receiverProcessor) {
-                detections = receiverProcessor->processFrame(frame);
-            }
-
-            if (!frame.empty()) {
-                server.broadcastFrame(frame);
-                streamDispatcher.onFrame(frame);
+            receiver.setDecodeTargetSize(receiverDecodeTarget());
+        }
+        if (std::chrono::steady_clock::now() >= nextOutputStats) {
+            nextOutputStats += kOutputStatsInterval;
+            if (outputsStarted) {
+                logOutputDrops("Stream", streamDispatcher, outputDrops);
             }
-
-            if (!detections.empty()) {
-                server.broadcastEvents(detections);
+            for (const auto& [deviceId, dispatcher] : extraDispatchers) {
+                logOutputDrops("Device " + std::to_string(deviceId), *dispatcher, outputDrops);
             }
-            streamDispatcher.onEvents(detections);
-
-            std::this_thread::sleep_for(std::chrono::milliseconds(33));
-            continue;
         }
-
         std::this_thread::sleep_for(std::chrono::milliseconds(200));
     }
 
     server.stopNetworkSystem();
     if (useStreamReceiver) {
         receiver.stop();
+        edgeRouter->stop();
     } else {
+        extraCaptureManagers.clear();
+        extraDispatchers.clear();
         captureManager.stop();
     }
     if (outputsStarted) {
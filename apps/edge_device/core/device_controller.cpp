@@ -138,6 +138,16 @@ ForwarderConfig DeviceController::buildForwarderConfig() const {
     config.reconnectDelay = std::chrono::milliseconds(forward.reconnectDelayMs);
     config.deviceId = profile_.deviceId;
     config.deviceName = profile_.name;
+    config.codec = forward.codec;
+    config.bitrateKbps = static_cast<int>(forward.bitrateKbps);
+    config.encoder = encoderChoice_;
+    config.sendQueueBytes = static_cast<std::size_t>(forward.sendQueueKb) * 1024;
+    config.adaptive = forward.adaptive;
+    config.jpegQuality = static_cast<int>(forward.jpegQuality);
+    config.minJpegQuality = static_cast<int>(forward.minJpegQuality);
+    config.minBitrateKbps = static_cast<int>(forward.minBitrateKbps);
+    config.maxFrameInterval = std::chrono::milliseconds(forward.maxFrameIntervalMs);
+    config.minScale = forward.minScale;
 
     if (config.frameInterval.count() <= 0) {
         config.frameInterval = std::chrono::milliseconds(100);
@@ -145,6 +155,9 @@ ForwarderConfig DeviceController::buildForwarderConfig() const {
     if (config.reconnectDelay.count() <= 0) {
         config.reconnectDelay = std::chrono::milliseconds(2000);
     }
+    if (config.maxFrameInterval < config.frameInterval) {
+        config.maxFrameInterval = config.frameInterval;
+    }
 
     return config;
 }
@@ -173,6 +186,7 @@ void DeviceController::applyProfile() {
         forwarder_->stop();
     }
 
+    encoderChoice_ = encoderSelector_.select(profile_, profile_.forward.preferredEncoder);
     forwarderConfig_ = buildForwarderConfig();
     forwarder_->configure(forwarderConfig_);
     HealthThresholds thresholds;
@@ -185,7 +199,6 @@ void DeviceController::applyProfile() {
     }
     healthMonitor_.setThresholds(thresholds);
 
-    encoderChoice_ = encoderSelector_.select(profile_);
     powerPolicy_ = Utils::PowerPolicy::fromProfile(profile_);
     powerManager_.applyPolicy(powerPolicy_);
 
@@ -248,8 +261,13 @@ ResourceSnapshot DeviceController::latestResourceSnapshot() const {
 }
 
 HealthStatus DeviceController::healthStatus() const {
-    std::lock_guard<std::mutex> lock(healthMutex_);
-    return healthStatus_;
+    HealthStatus status;
+    {
+        std::lock_guard<std::mutex> lock(healthMutex_);
+        status = healthStatus_;
+    }
+    status.uplink = forwarder_->uplinkStatus();
+    return status;
 }
 
 void DeviceController::refreshOperationalState() {
@@ -743,6 +761,7 @@ bool DeviceController::tryRegisterViaDatabase()
         metadata["edge_device"]["forward_enabled"] = true;
         metadata["edge_device"]["forward_host"] = forwarderConfig_.host;
         metadata["edge_device"]["forward_port"] = forwarderConfig_.port;
+        metadata["edge_device"]["forward_codec"] = forwarderConfig_.codec;
     } else {
         metadata["edge_device"]["forward_enabled"] = false;
     }
@@ -0,0 +1,263 @@
+#include <algorithm>
+#include <iostream>
+#include <vector>
+#include <gst/app/gstappsink.h>
+#include <gst/app/gstappsrc.h>
+#include <gst/video/video.h>
+
+#include "core/frame_encoder.hpp"
+
+namespace SnowOwl::Edge::Core {
+
+namespace {
+
+struct EncoderElement {
+	Utils::EncoderKind kind;
+	SnowOwl::Protocol::VideoCodec codec;
+	const char* name;
+	const char* bitrateKey;
+	const char* gopKey;
+	const char* extra;
+};
+
+using SnowOwl::Protocol::VideoCodec;
+using Utils::EncoderKind;
+
+// Ordered by preference within each kind; the software entries come last
+const EncoderElement kEncoderElements[] = {
+	{EncoderKind::NvidiaNVENC, VideoCodec::H264, "nvh264enc", "bitrate", "gop-size", "zerolatency=true"},
+	{EncoderKind::NvidiaNVENC, VideoCodec::H265, "nvh265enc", "bitrate", "gop-size", "zerolatency=true"},
+	{EncoderKind::IntelQSV, VideoCodec::H264, "qsvh264enc", "bitrate", "gop-size", ""},
+	{EncoderKind::IntelQSV, VideoCodec::H264, "msdkh264enc", "bitrate", "gop-size", ""},
+	{EncoderKind::IntelQSV, VideoCodec::H265, "qsvh265enc", "bitrate", "gop-size", ""},
+	{EncoderKind::IntelQSV, VideoCodec::H265, "msdkh265enc", "bitrate", "gop-size", ""},
+	{EncoderKind::VAAPI, VideoCodec::H264, "vah264enc", "bitrate", "key-int-max", ""},
+	{EncoderKind::VAAPI, VideoCodec::H264, "vaapih264enc", "bitrate", "keyframe-period", ""},
+	{EncoderKind::VAAPI, VideoCodec::H265, "vah265enc", "bitrate", "key-int-max", ""},
+	{EncoderKind::VAAPI, VideoCodec::H265, "vaapih265enc", "bitrate", "keyframe-period", ""},
+	{EncoderKind::AMF, VideoCodec::H264, "amfh264enc", "bitrate", "gop-size", ""},
+	{EncoderKind::AMF, VideoCodec::H265, "amfh265enc", "bitrate", "gop-size", ""},
+	{EncoderKind::AppleVT, VideoCodec::H264, "vtenc_h264", "bitrate", "max-keyframe-interval", "realtime=true allow-frame-reordering=false"},
+	{EncoderKind::AppleVT, VideoCodec::H265, "vtenc_h265", "bitrate", "max-keyframe-interval", "realtime=true allow-frame-reordering=false"},
+	{EncoderKind::Software, VideoCodec::H264, "x264enc", "bitrate", "key-int-max", "tune=zerolatency speed-preset=ultrafast"},
+	{EncoderKind::Software, VideoCodec::H265, "x265enc", "bitrate", "key-int-max", "tune=zerolatency speed-preset=ultrafast"},
+};
+
+bool elementAvailable(const char* name) {
+	GstElementFactory* factory = gst_element_factory_find(name);
+	if (!factory) {
+		return false;
+	}
+	gst_object_unref(factory);
+	return true;
+}
+
+std::vector<const EncoderElement*> candidatesFor(EncoderKind kind, VideoCodec codec) {
+	std::vector<const EncoderElement*> candidates;
+	for (const auto& element : kEncoderElements) {
+		if (element.kind == kind && element.codec == codec && kind != EncoderKind::Software) {
+			candidates.push_back(&element);
+		}
+	}
+	for (const auto& element : kEncoderElements) {
+		if (element.kind == EncoderKind::Software && element.codec == codec) {
+			candidates.push_back(&element);
+		}
+	}
+	return candidates;
+}
+
+}
+
+FrameEncoder::~FrameEncoder() {
+	close();
+}
+
+void FrameEncoder::configure(const Utils::EncoderChoice& choice, SnowOwl::Protocol::VideoCodec codec, int bitrateKbps, int fps) {
+	close();
+	choice_ = choice;
+	codec_ = codec;
+	bitrateKbps_ = std::max(bitrateKbps, 100);
+	fps_ = std::clamp(fps, 1, 120);
+	failedElements_.clear();
+	exhausted_ = false;
+}
+
+bool FrameEncoder::encode(const std::shared_ptr<const CapturedFrame>& captured, const PacketHandler& handler) {
+	if (!captured || captured->frame.empty() || captured->frame.type() != CV_8UC3) {
+		return false;
+	}
+
+	const cv::Mat& frame = captured->frame;
+	if (!pipeline_ || frame.cols != width_ || frame.rows != height_) {
+		close();
+		if (!open(frame.cols, frame.rows)) {
+			return false;
+		}
+	}
+
+	// The buffer borrows the pooled pixels and keeps the frame referenced
+	// until the encoder is done with them, so the pool cannot rewrite it
+	auto* held = new std::shared_ptr<const CapturedFrame>(captured);
+	const gsize size = frame.step[0] * frame.rows;
+	GstBuffer* buffer = gst_buffer_new_wrapped_full(GST_MEMORY_FLAG_READONLY, frame.data, size, 0, size, held,
+		[](gpointer data) { delete static_cast<std::shared_ptr<const CapturedFrame>*>(data); });
+
+	gsize offset[GST_VIDEO_MAX_PLANES] = {0};
+	gint stride[GST_VIDEO_MAX_PLANES] = {static_cast<gint>(frame.step[0])};
+	gst_buffer_add_video_meta_full(buffer, GST_VIDEO_FRAME_FLAG_NONE, GST_VIDEO_FORMAT_BGR,
+		width_, height_, 1, offset, stride);
+
+	const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(captured->timestamp - startTime_).count();
+	GST_BUFFER_PTS(buffer) = static_cast<GstClockTime>(std::max<std::int64_t>(elapsed, 0));
+	GST_BUFFER_DURATION(buffer) = GST_SECOND / fps_;
+
+	if (gst_app_src_push_buffer(GST_APP_SRC(appsrc_), buffer) != GST_FLOW_OK) {
+		std::cerr << "FrameEncoder: " << elementName_ << " refused frame" << std::endl;
+		close();
+		return false;
+	}
+
+	// Hardware encoders often only fail once the first frame reaches them
+	GstBus* bus = gst_element_get_bus(pipeline_);
+	GstMessage* error = gst_bus_pop_filtered(bus, GST_MESSAGE_ERROR);
+	gst_object_unref(bus);
+	if (error) {
+		GError* err = nullptr;
+		gst_message_parse_error(error, &err, nullptr);
+		std::cerr << "FrameEncoder: " << elementName_ << " failed - " << (err ? err->message : "unknown error") << std::endl;
+		if (err) {
+			g_error_free(err);
+		}
+		gst_message_unref(error);
+		failedElements_.push_back(elementName_);
+		close();
+		return false;
+	}
+
+	drain(handler, GST_SECOND / fps_ / 2);
+	return true;
+}
+
+void FrameEncoder::requestKeyframe() {
+	if (appsink_) {
+		gst_element_send_event(appsink_, gst_video_event_new_upstream_force_key_unit(GST_CLOCK_TIME_NONE, TRUE, 0));
+	}
+}
+
+void FrameEncoder::setBitrate(int bitrateKbps) {
+	bitrateKbps = std::max(bitrateKbps, 100);
+	if (bitrateKbps == bitrateKbps_) {
+		return;
+	}
+	bitrateKbps_ = bitrateKbps;
+	if (encoder_ && bitrateKey_) {
+		g_object_set(encoder_, bitrateKey_, static_cast<guint>(bitrateKbps_), nullptr);
+	}
+}
+
+void FrameEncoder::close() {
+	if (pipeline_) {
+		gst_element_set_state(pipeline_, GST_STATE_NULL);
+	}
+	if (appsrc_) {
+		gst_object_unref(appsrc_);
+		appsrc_ = nullptr;
+	}
+	if (appsink_) {
+		gst_object_unref(appsink_);
+		appsink_ = nullptr;
+	}
+	if (encoder_) {
+		gst_object_unref(encoder_);
+		encoder_ = nullptr;
+	}
+	bitrateKey_ = nullptr;
+	if (pipeline_) {
+		gst_object_unref(pipeline_);
+		pipeline_ = nullptr;
+	}
+	elementName_.clear();
+	width_ = 0;
+	height_ = 0;
+}
+
+bool FrameEncoder::open(int width, int height) {
+	gst_init(nullptr, nullptr);
+
+	const int gop = fps_ * 2;
+	for (const auto* candidate : candidatesFor(choice_.kind, codec_)) {
+		if (std::find(failedElements_.begin(), failedElements_.end(), candidate->name) != failedElements_.end()
+			|| !elementAvailable(candidate->name)) {
+			continue;
+		}
+
+		std::string properties = std::string(candidate->bitrateKey) + "=" + std::to_string(bitrateKbps_)
+			+ " " + candidate->gopKey + "=" + std::to_string(gop) + " " + candidate->extra;
+		if (launch(candidate->name, candidate->bitrateKey, properties, width, height)) {
+			std::cout << "FrameEncoder: encoding " << width << 'x' << height << " with " << elementName_ << std::endl;
+			return true;
+		}
+		failedElements_.push_back(candidate->name);
+	}
+
+	exhausted_ = true;
+	std::cerr << "FrameEncoder: no usable " << (codec_ == VideoCodec::H265 ? "H.265" : "H.264") << " encoder" << std::endl;
+	return false;
+}
+
+bool FrameEncoder::launch(const std::string& element, const char* bitrateKey, const std::string& properties, int width, int height) {
+	const bool hevc = codec_ == VideoCodec::H265;
+	const std::string pipelineStr =
+		"appsrc name=src is-live=true format=time do-timestamp=false "
+		"caps=video/x-raw,format=BGR,width=" + std::to_string(width) + ",height=" + std::to_string(height)
+		+ ",framerate=" + std::to_string(fps_) + "/1 ! videoconvert ! " + element + " name=enc " + properties + " ! "
+		+ (hevc ? "h265parse" : "h264parse") + " config-interval=-1 ! "
+		+ (hevc ? "video/x-h265" : "video/x-h264") + ",stream-format=byte-stream,alignment=au ! "
+		"appsink name=sink sync=false";
+
+	GError* error = nullptr;
+	pipeline_ = gst_parse_launch(pipelineStr.c_str(), &error);
+	if (error) {
+		std::cerr << "FrameEncoder: " << element << " pipeline failed - " << error->message << std::endl;
+		g_error_free(error);
+		close();
+		return false;
+	}
+	if (!pipeline_) {
+		return false;
+	}
+
+	appsrc_ = gst_bin_get_by_name(GST_BIN(pipeline_), "src");
+	appsink_ = gst_bin_get_by_name(GST_BIN(pipeline_), "sink");
+	encoder_ = gst_bin_get_by_name(GST_BIN(pipeline_), "enc");
+	if (!appsrc_ || !appsink_ || gst_element_set_state(pipeline_, GST_STATE_PLAYING) == GST_STATE_CHANGE_FAILURE) {
+		close();
+		return false;
+	}
+
+	elementName_ = element;
+	bitrateKey_ = bitrateKey;
+	width_ = width;
+	height_ = height;
+	startTime_ = std::chrono::steady_clock::now();
+	return true;
+}
+
+void FrameEncoder::drain(const PacketHandler& handler, GstClockTime firstWait) {
+	GstClockTime wait = firstWait;
+	while (GstSample* sample = gst_app_sink_try_pull_sample(GST_APP_SINK(appsink_), wait)) {
+		wait = 0;
+		GstBuffer* buffer = gst_sample_get_buffer(sample);
+		GstMapInfo map;
+		if (buffer && gst_buffer_map(buffer, &map, GST_MAP_READ)) {
+			const GstClockTime pts = GST_BUFFER_PTS(buffer);
+			const std::int64_t ptsUs = GST_CLOCK_TIME_IS_VALID(pts) ? static_cast<std::int64_t>(pts / GST_USECOND) : 0;
+			handler(map.data, map.size, ptsUs, !GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT));
+			gst_buffer_unmap(buffer, &map);
+		}
+		gst_sample_unref(sample);
+	}
+}
+
+}
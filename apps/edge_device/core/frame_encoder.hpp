@@ -0,0 +1,73 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include <gst/gst.h>
+#include <opencv2/opencv.hpp>
+
+#include "core/stream_capture.hpp"
+#include "modules/utils/encoder_selector.hpp"
+#include "protocol/message_types.hpp"
+
+namespace SnowOwl::Edge::Core {
+
+// Encodes BGR frames into H.264/H.265 access units through a GStreamer
+// pipeline built around the encoder the EncoderSelector picked. Elements that
+// are missing or fail to start fall back to the next candidate, ending with
+// the software encoder. Reopens itself when the frame size changes.
+class FrameEncoder {
+public:
+	// data is one Annex-B access unit, valid only during the call
+	using PacketHandler = std::function<void(const std::uint8_t* data, std::size_t size, std::int64_t ptsUs, bool keyframe)>;
+
+	FrameEncoder() = default;
+	~FrameEncoder();
+
+	FrameEncoder(const FrameEncoder&) = delete;
+	FrameEncoder& operator=(const FrameEncoder&) = delete;
+
+	void configure(const Utils::EncoderChoice& choice, SnowOwl::Protocol::VideoCodec codec, int bitrateKbps, int fps);
+
+	// The PTS comes from the capture timestamp, clamped to 0 for frames taken
+	// before the encoder opened. The frame is held until the encoder has read it.
+	bool encode(const std::shared_ptr<const CapturedFrame>& captured, const PacketHandler& handler);
+	// The next access unit will be a keyframe, e.g. for a new receiver
+	void requestKeyframe();
+	// Applied to the running encoder without reopening it
+	void setBitrate(int bitrateKbps);
+	void close();
+
+	// False once every candidate element failed; configure() resets it
+	bool usable() const { return !exhausted_; }
+	SnowOwl::Protocol::VideoCodec codec() const { return codec_; }
+	const std::string& elementName() const { return elementName_; }
+
+private:
+	bool open(int width, int height);
+	bool launch(const std::string& element, const char* bitrateKey, const std::string& properties, int width, int height);
+	void drain(const PacketHandler& handler, GstClockTime firstWait);
+
+	Utils::EncoderChoice choice_{};
+	SnowOwl::Protocol::VideoCodec codec_{SnowOwl::Protocol::VideoCodec::H264};
+	int bitrateKbps_{2000};
+	int fps_{10};
+
+	GstElement* pipeline_{nullptr};
+	GstElement* appsrc_{nullptr};
+	GstElement* appsink_{nullptr};
+	GstElement* encoder_{nullptr};
+	const char* bitrateKey_{nullptr};
+	std::string elementName_;
+	// Elements that failed to start are skipped until the next configure()
+	std::vector<std::string> failedElements_;
+	bool exhausted_{false};
+	int width_{0};
+	int height_{0};
+	std::chrono::steady_clock::time_point startTime_{};
+};
+
+}
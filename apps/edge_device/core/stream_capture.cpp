@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <chrono>
 #include <iostream>
 #include <thread>
@@ -8,6 +9,9 @@ namespace SnowOwl::Edge::Core {
 
 namespace {
 
+// The slot, one reader and the frame being written make three; one spare
+constexpr std::size_t kMaxPooledFrames = 4;
+
 bool isCameraUri(const std::string& uri) {
     return uri.rfind("camera://", 0) == 0;
 }
@@ -86,17 +90,48 @@ void StreamCapture::stop() {
         cleanupGstPipeline();
     }
 
-    std::lock_guard<std::mutex> frameLock(frameMutex_);
-    frame_.release();
+    std::atomic_store(&latest_, std::shared_ptr<const CapturedFrame>());
+    framePool_.clear();
 }
 
 cv::Mat StreamCapture::latestFrame() const {
-    std::lock_guard<std::mutex> lock(frameMutex_);
-    if (frame_.empty()) {
+    const auto captured = latest();
+    if (!captured) {
         return {};
     }
 
-    return frame_.clone();
+    return captured->frame.clone();
+}
+
+std::shared_ptr<const CapturedFrame> StreamCapture::latest() const {
+    return std::atomic_load(&latest_);
+}
+
+bool StreamCapture::waitForFrame(std::shared_ptr<const CapturedFrame>& out, std::uint64_t afterSequence,
+                                 std::chrono::milliseconds timeout) const {
+    std::unique_lock<std::mutex> lock(notifyMutex_);
+    return frameCv_.wait_for(lock, timeout, [&]() {
+        auto captured = std::atomic_load(&latest_);
+        if (!captured || captured->sequence <= afterSequence) {
+            return false;
+        }
+        out = std::move(captured);
+        return true;
+    });
+}
+
+std::size_t StreamCapture::subscribe(FrameCallback callback) {
+    std::lock_guard<std::mutex> lock(subscriberMutex_);
+    const std::size_t id = nextSubscriberId_++;
+    subscribers_.emplace_back(id, std::make_shared<const FrameCallback>(std::move(callback)));
+    return id;
+}
+
+void StreamCapture::unsubscribe(std::size_t id) {
+    std::lock_guard<std::mutex> lock(subscriberMutex_);
+    subscribers_.erase(std::remove_if(subscribers_.begin(), subscribers_.end(), [id](const auto& entry) {
+        return entry.first == id;
+    }), subscribers_.end());
 }
 
 bool StreamCapture::isRunning() const {
@@ -169,57 +204,99 @@ GstFlowReturn StreamCapture::onNewSample(GstAppSink* appsink, gpointer userData)
         return GST_FLOW_ERROR;
     }
 
-    cv::Mat frame = capture->gstSampleToMat(sample);
-    
-    {
-        std::lock_guard<std::mutex> lock(capture->frameMutex_);
-        capture->frame_ = frame.clone();
-    }
-    
+    auto captured = capture->acquireFrame();
+    const bool converted = capture->gstSampleToMat(sample, captured->frame);
     gst_sample_unref(sample);
+
+    if (converted) {
+        capture->publishFrame(std::move(captured));
+    }
     return GST_FLOW_OK;
 }
 
-cv::Mat StreamCapture::gstSampleToMat(GstSample* sample) {
+std::shared_ptr<CapturedFrame> StreamCapture::acquireFrame() {
+    for (const auto& entry : framePool_) {
+        // Only the pool holds it, and only this thread hands out new references
+        if (entry.use_count() == 1) {
+            std::atomic_thread_fence(std::memory_order_acquire);
+            return entry;
+        }
+    }
+
+    auto entry = std::make_shared<CapturedFrame>();
+    if (framePool_.size() < kMaxPooledFrames) {
+        framePool_.push_back(entry);
+    }
+    return entry;
+}
+
+void StreamCapture::publishFrame(std::shared_ptr<CapturedFrame> captured) {
+    captured->sequence = ++sequence_;
+    captured->timestamp = std::chrono::steady_clock::now();
+    std::shared_ptr<const CapturedFrame> published = std::move(captured);
+    std::atomic_store(&latest_, published);
+
+    // Waiters test the slot under this mutex, so the notify cannot slip in between
+    {
+        std::lock_guard<std::mutex> lock(notifyMutex_);
+    }
+    frameCv_.notify_all();
+
+    {
+        std::lock_guard<std::mutex> lock(subscriberMutex_);
+        callbackScratch_.clear();
+        for (const auto& entry : subscribers_) {
+            callbackScratch_.push_back(entry.second);
+        }
+    }
+    for (const auto& callback : callbackScratch_) {
+        (*callback)(published);
+    }
+    callbackScratch_.clear();
+}
+
+// Converts straight into out, whose buffer is reused when the size matches
+bool StreamCapture::gstSampleToMat(GstSample* sample, cv::Mat& out) {
     if (!sample) {
-        return cv::Mat();
+        return false;
     }
 
     GstBuffer* buffer = gst_sample_get_buffer(sample);
     if (!buffer) {
-        return cv::Mat();
+        return false;
     }
 
     GstMapInfo map;
     if (!gst_buffer_map(buffer, &map, GST_MAP_READ)) {
-        return cv::Mat();
+        return false;
     }
 
     GstCaps* caps = gst_sample_get_caps(sample);
     if (!caps) {
         gst_buffer_unmap(buffer, &map);
-        return cv::Mat();
+        return false;
     }
 
     GstStructure* structure = gst_caps_get_structure(caps, 0);
-    int width, height;
+    int width = 0;
+    int height = 0;
     gst_structure_get_int(structure, "width", &width);
     gst_structure_get_int(structure, "height", &height);
+    if (width <= 0 || height <= 0) {
+        gst_buffer_unmap(buffer, &map);
+        return false;
+    }
     
     const char* format = gst_structure_get_string(structure, "format");
     
-    cv::Mat frame;
-    if (format && strcmp(format, "RGB") == 0) {
-        frame = cv::Mat(height, width, CV_8UC3, map.data).clone();
-    } else if (format && strcmp(format, "I420") == 0) {
-        frame = cv::Mat(height * 3/2, width, CV_8UC1, map.data).clone();
-        cv::cvtColor(frame, frame, cv::COLOR_YUV2BGR_I420);
+    if (format && strcmp(format, "I420") == 0) {
+        cv::cvtColor(cv::Mat(height * 3/2, width, CV_8UC1, map.data), out, cv::COLOR_YUV2BGR_I420);
     } else {
-        frame = cv::Mat(height, width, CV_8UC3, map.data).clone();
+        cv::Mat(height, width, CV_8UC3, map.data).copyTo(out);
     }
 
     gst_buffer_unmap(buffer, &map);
-    return frame;
+    return true;
 }
 
 std::string StreamCapture::buildPipelineString() {
@@ -2,9 +2,15 @@
 
 #include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
 #include <mutex>
 #include <string>
 #include <thread>
+#include <utility>
+#include <vector>
 #include <gst/gst.h>
 #include <gst/app/gstappsink.h>
 #include <opencv2/opencv.hpp>
@@ -24,8 +30,19 @@ struct CaptureSourceConfig {
     std::string fallbackUri;
 };
 
+// One published frame. Its pixels come from a recycled pool and are only
+// rewritten once no shared_ptr to the frame is left, so keep the pointer,
+// not a copy of the Mat header, for as long as the pixels are needed.
+struct CapturedFrame {
+    cv::Mat frame;
+    std::uint64_t sequence{0};
+    std::chrono::steady_clock::time_point timestamp{};
+};
+
 class StreamCapture {
 public:
+    using FrameCallback = std::function<void(const std::shared_ptr<const CapturedFrame>&)>;
+
     StreamCapture();
     ~StreamCapture();
 
@@ -34,20 +51,46 @@ public:
     bool start();
     void stop();
 
+    // Independent copy of the newest frame; latest() avoids the copy
     cv::Mat latestFrame() const;
+    // Newest frame without taking a lock; null before the first frame
+    std::shared_ptr<const CapturedFrame> latest() const;
+    // Blocks until a frame newer than afterSequence is published; false on timeout
+    bool waitForFrame(std::shared_ptr<const CapturedFrame>& out, std::uint64_t afterSequence,
+                      std::chrono::milliseconds timeout) const;
+    // Called on the GStreamer streaming thread for every frame, so keep it short.
+    // Returns an id for unsubscribe.
+    std::size_t subscribe(FrameCallback callback);
+    void unsubscribe(std::size_t id);
+
     bool isRunning() const;
 
 private:
     bool initializeGstPipeline();
     void cleanupGstPipeline();
     static GstFlowReturn onNewSample(GstAppSink* appsink, gpointer userData);
-    cv::Mat gstSampleToMat(GstSample* sample);
+    bool gstSampleToMat(GstSample* sample, cv::Mat& out);
+    std::shared_ptr<CapturedFrame> acquireFrame();
+    void publishFrame(std::shared_ptr<CapturedFrame> captured);
     std::string buildPipelineString();
     void captureLoop();
 
     mutable std::mutex mutex_;
-    mutable std::mutex frameMutex_;
-    cv::Mat frame_;
+    // Latest-value slot, only accessed through std::atomic_load/atomic_store;
+    // sequence numbers keep increasing across restarts
+    std::shared_ptr<const CapturedFrame> latest_;
+    std::uint64_t sequence_{0};
+    mutable std::mutex notifyMutex_;
+    mutable std::condition_variable frameCv_;
+
+    std::mutex subscriberMutex_;
+    std::vector<std::pair<std::size_t, std::shared_ptr<const FrameCallback>>> subscribers_;
+    std::size_t nextSubscriberId_{1};
+
+    // Streaming thread only. Buffers keep their capacity, so steady-state
+    // capture allocates nothing.
+    std::vector<std::shared_ptr<CapturedFrame>> framePool_;
+    std::vector<std::shared_ptr<const FrameCallback>> callbackScratch_;
     std::thread thread_;
 
     CaptureSourceConfig config_;
@@ -1,32 +1,53 @@
+#include <algorithm>
 #include <chrono>
-#include <ctime>
 #include <iostream>
 #include <vector>
-#include <nlohmann/json.hpp>
 
 #include "core/stream_forwarder.hpp"
 #include "protocol/message_types.hpp"
 
 namespace SnowOwl::Edge::Core {
 
-namespace {
-
-template <typename T>
-void writeLE(std::vector<std::uint8_t>& buffer, T value) {
-	for (std::size_t i = 0; i < sizeof(T); ++i) {
-		buffer.push_back(static_cast<std::uint8_t>((value >> (8 * i)) & 0xFF));
-	}
-}
-
-}
-
 StreamForwarder::StreamForwarder() = default;
 
 StreamForwarder::~StreamForwarder() { stop();}
 
 void StreamForwarder::configure(const ForwarderConfig& config) {
 	config_ = config;
-	sentHandshake_ = false;
+
+	Network::ConnectionSettings settings;
+	settings.host = config_.host;
+	settings.port = config_.port;
+	settings.reconnectDelay = config_.reconnectDelay;
+	connection_.disconnect();
+	connection_.configure(settings);
+	connection_.setSendQueueBudget(config_.enabled ? config_.sendQueueBytes : 0);
+	client_.setIdentity(config_.deviceId, config_.deviceName);
+
+	const bool hevc = config_.codec == "h265" || config_.codec == "hevc";
+	videoPackets_ = hevc || config_.codec == "h264";
+	if (videoPackets_) {
+		const auto intervalMs = std::max<std::int64_t>(config_.frameInterval.count(), 1);
+		videoEncoder_.configure(config_.encoder,
+			hevc ? SnowOwl::Protocol::VideoCodec::H265 : SnowOwl::Protocol::VideoCodec::H264,
+			config_.bitrateKbps, static_cast<int>(std::max<std::int64_t>(1000 / intervalMs, 1)));
+	} else {
+		videoEncoder_.close();
+	}
+
+	UplinkBounds bounds;
+	bounds.maxJpegQuality = config_.jpegQuality;
+	bounds.minJpegQuality = config_.minJpegQuality;
+	bounds.maxBitrateKbps = config_.bitrateKbps;
+	bounds.minBitrateKbps = config_.minBitrateKbps;
+	bounds.minFrameInterval = config_.frameInterval;
+	bounds.maxFrameInterval = config_.maxFrameInterval;
+	bounds.minScale = config_.minScale;
+	uplink_.configure(bounds, config_.adaptive);
+	scaledFrame_.reset();
+
+	std::lock_guard<std::mutex> lock(statusMutex_);
+	uplinkStatus_ = uplink_.status();
 }
 
 bool StreamForwarder::start(StreamCapture* capture) {
@@ -66,92 +87,17 @@ void StreamForwarder::stop() {
 		thread_.join();
 	}
 
-	std::lock_guard<std::mutex> lock(connectionMutex_);
-	if (socket_) {
-		boost::system::error_code ec;
-		if (socket_->is_open()) {
-			socket_->shutdown(boost::asio::ip::tcp::socket::shutdown_both, ec);
-		}
-		socket_->close(ec);
-		socket_.reset();
-	}
-
-	if (ioContext_) {
-		ioContext_->stop();
-	}
-
-	ioContext_.reset();
-	sentHandshake_ = false;
-}
-
-bool StreamForwarder::ensureConnected() {
-	std::lock_guard<std::mutex> lock(connectionMutex_);
-	if (socket_ && socket_->is_open()) {
-		return true;
-	}
-
-	try {
-		if (!ioContext_) {
-			ioContext_ = std::make_unique<boost::asio::io_context>();
-		}
-
-		auto socket = std::make_unique<boost::asio::ip::tcp::socket>(*ioContext_);
-		boost::asio::ip::tcp::resolver resolver(*ioContext_);
-		boost::asio::ip::tcp::resolver::results_type endpoints = 
-			resolver.resolve(config_.host, std::to_string(config_.port));
-
-		boost::asio::connect(*socket, endpoints);
-		socket_ = std::move(socket);
-		sentHandshake_ = false;
-		std::cout << "StreamForwarder: connected to " << config_.host << ':' << config_.port << std::endl;
-
-		if (!config_.deviceId.empty() && !sentHandshake_) {
-			nlohmann::json payload;
-			payload["device_id"] = config_.deviceId;
-			if (!config_.deviceName.empty()) {
-				payload["device_name"] = config_.deviceName;
-			}
-			const auto now = std::chrono::system_clock::now();
-			const std::time_t timeValue = std::chrono::system_clock::to_time_t(now);
-			std::tm utcTime{};
-#if defined(_WIN32)
-			gmtime_s(&utcTime, &timeValue);
-#else
-			gmtime_r(&timeValue, &utcTime);
-#endif
-			char buffer[32];
-			if (std::strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%SZ", &utcTime) != 0) {
-				payload["connected_at"] = buffer;
-			}
-
-			const std::string serialized = payload.dump();
-			std::vector<std::uint8_t> controlBuffer;
-			controlBuffer.reserve(serialized.size() + 5);
-			controlBuffer.push_back(static_cast<std::uint8_t>(SnowOwl::Protocol::MessageType::Control));
-			writeLE<std::uint32_t>(controlBuffer, static_cast<std::uint32_t>(serialized.size()));
-			controlBuffer.insert(controlBuffer.end(), serialized.begin(), serialized.end());
-
-			boost::system::error_code ec;
-			boost::asio::write(*socket_, boost::asio::buffer(controlBuffer), ec);
-			if (ec) {
-				std::cerr << "StreamForwarder: failed to send handshake - " << ec.message() << std::endl;
-				socket_->close();
-				socket_.reset();
-				return false;
-			}
-			sentHandshake_ = true;
-		}
-		return true;
-	} catch (const std::exception& ex) {
-		std::cerr << "StreamForwarder: connection failed - " << ex.what() << std::endl;
-		socket_.reset();
-		return false;
-	}
+	connection_.disconnect();
 }
 
 void StreamForwarder::forwardLoop() {
+	// Bounds how long stop() waits when the camera delivers nothing
+	constexpr auto kFrameWait = std::chrono::milliseconds(200);
+	std::uint64_t lastSequence = 0;
+
 	while (running_.load()) {
-		if (!ensureConnected()) {
+		if (!client_.ensureConnected()) {
+			adaptUplink();
 			std::this_thread::sleep_for(config_.reconnectDelay);
 			continue;
 		}
@@ -161,69 +107,98 @@ void StreamForwarder::forwardLoop() {
 			continue;
 		}
 
-		cv::Mat frame = capture_->latestFrame();
-		if (!frame.empty()) {
-			if (!sendFrame(frame)) {
-				std::lock_guard<std::mutex> lock(connectionMutex_);
-				if (socket_) {
-					boost::system::error_code ec;
-					socket_->close(ec);
-				}
-			}
+		// Every frame is sent at most once: as soon as it is captured, but no
+		// sooner than the controller's interval after the previous send started
+		std::shared_ptr<const CapturedFrame> captured;
+		if (!capture_->waitForFrame(captured, lastSequence, kFrameWait)) {
+			continue;
 		}
+		lastSequence = captured->sequence;
+
+		// A failed write closes the connection; the next pass reconnects
+		const auto sendStart = std::chrono::steady_clock::now();
+		sendFrame(captured);
+		adaptUplink();
 
-		std::this_thread::sleep_for(config_.frameInterval);
+		std::this_thread::sleep_until(sendStart + uplink_.decision().frameInterval);
 	}
 }
 
-std::vector<std::uint8_t> StreamForwarder::encodeFrame(const cv::Mat& frame) const {
-	std::vector<int> params = {cv::IMWRITE_JPEG_QUALITY, 80};
-	std::vector<unsigned char> jpegBuffer;
-	if (!cv::imencode(".jpg", frame, jpegBuffer, params)) {
-		return {};
+bool StreamForwarder::sendFrame(const std::shared_ptr<const CapturedFrame>& captured) {
+	const auto frame = scaleFrame(captured);
+	if (videoPackets_ && videoEncoder_.usable()) {
+		bool encoded = false;
+		const bool sent = sendVideoFrame(frame, encoded);
+		// A failed element is replaced on the next frame; JPEG only once none is left
+		if (encoded || videoEncoder_.usable()) {
+			return sent;
+		}
 	}
 
-	std::vector<std::uint8_t> buffer;
-	buffer.reserve(jpegBuffer.size() + 5);
-	buffer.push_back(static_cast<std::uint8_t>(SnowOwl::Protocol::MessageType::Frame));
-	writeLE<std::uint32_t>(buffer, static_cast<std::uint32_t>(jpegBuffer.size()));
-	buffer.insert(buffer.end(), jpegBuffer.begin(), jpegBuffer.end());
-	return buffer;
+	return client_.sendFrame(frame->frame, uplink_.decision().jpegQuality);
 }
 
-bool StreamForwarder::sendFrame(const cv::Mat& frame) {
-	const auto payload = encodeFrame(frame);
+std::shared_ptr<const CapturedFrame> StreamForwarder::scaleFrame(const std::shared_ptr<const CapturedFrame>& captured) {
+	const double scale = uplink_.decision().scale;
+	if (scale >= 1.0) {
+		return captured;
+	}
 
-	std::lock_guard<std::mutex> lock(connectionMutex_);
-	if (!socket_ || !socket_->is_open()) {
-		return false;
+	if (!scaledFrame_ || scaledFrame_.use_count() > 1) {
+		scaledFrame_ = std::make_shared<CapturedFrame>();
+	} else {
+		std::atomic_thread_fence(std::memory_order_acquire);
 	}
 
-	boost::system::error_code ec;
-	boost::asio::write(*socket_, boost::asio::buffer(payload), ec);
-	return !ec.failed();
+	// Even sides keep 4:2:0 encoders happy
+	const int width = std::max(static_cast<int>(captured->frame.cols * scale) & ~1, 2);
+	const int height = std::max(static_cast<int>(captured->frame.rows * scale) & ~1, 2);
+	cv::resize(captured->frame, scaledFrame_->frame, cv::Size(width, height), 0, 0, cv::INTER_AREA);
+	scaledFrame_->sequence = captured->sequence;
+	scaledFrame_->timestamp = captured->timestamp;
+	return scaledFrame_;
 }
 
-std::vector<std::uint8_t> StreamForwarder::encodeAudioData(const std::vector<std::uint8_t>& audioData) const {
-	std::vector<std::uint8_t> buffer;
-	buffer.reserve(audioData.size() + 5);
-	buffer.push_back(static_cast<std::uint8_t>(SnowOwl::Protocol::MessageType::AudioData));
-	writeLE<std::uint32_t>(buffer, static_cast<std::uint32_t>(audioData.size()));
-	buffer.insert(buffer.end(), audioData.begin(), audioData.end());
-	return buffer;
+void StreamForwarder::adaptUplink() {
+	if (uplink_.update(connection_.sendStats(), connection_.isConnected(), std::chrono::steady_clock::now())) {
+		videoEncoder_.setBitrate(uplink_.decision().bitrateKbps);
+	}
+
+	std::lock_guard<std::mutex> lock(statusMutex_);
+	uplinkStatus_ = uplink_.status();
 }
 
-bool StreamForwarder::sendAudioData(const std::vector<std::uint8_t>& audioData) {
-	const auto payload = encodeAudioData(audioData);
+SnowOwl::Utils::SystemResources::UplinkStatus StreamForwarder::uplinkStatus() const {
+	std::lock_guard<std::mutex> lock(statusMutex_);
+	return uplinkStatus_;
+}
 
-	std::lock_guard<std::mutex> lock(connectionMutex_);
-	if (!socket_ || !socket_->is_open()) {
-		return false;
+bool StreamForwarder::sendVideoFrame(const std::shared_ptr<const CapturedFrame>& captured, bool& encoded) {
+	// Every frame dropped while resyncing would otherwise ask again, and an
+	// encoder a frame behind would emit IDR after IDR into a congested link
+	constexpr auto kKeyframeRequestInterval = std::chrono::seconds(1);
+
+	const auto now = std::chrono::steady_clock::now();
+	const auto generation = connection_.generation();
+	if (generation != keyframeGeneration_
+		|| (connection_.resyncPending() && now - lastKeyframeRequest_ >= kKeyframeRequestInterval)) {
+		videoEncoder_.requestKeyframe();
+		keyframeGeneration_ = generation;
+		lastKeyframeRequest_ = now;
 	}
 
-	boost::system::error_code ec;
-	boost::asio::write(*socket_, boost::asio::buffer(payload), ec);
-	return !ec.failed();
+	bool sent = true;
+	const auto codec = videoEncoder_.codec();
+	encoded = videoEncoder_.encode(captured, [&](const std::uint8_t* data, std::size_t size, std::int64_t ptsUs, bool keyframe) {
+		if (sent) {
+			sent = client_.sendVideoPacket(codec, data, size, ptsUs, keyframe);
+		}
+	});
+	return sent;
+}
+
+bool StreamForwarder::sendAudioData(const std::vector<std::uint8_t>& audioData) {
+	return client_.sendAudio(audioData.data(), audioData.size());
 }
 
 }
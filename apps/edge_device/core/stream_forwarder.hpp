@@ -7,10 +7,14 @@
 #include <string>
 #include <thread>
 #include <vector>
-#include <boost/asio.hpp>
 #include <opencv2/opencv.hpp>
 
+#include "core/frame_encoder.hpp"
 #include "core/stream_capture.hpp"
+#include "core/uplink_controller.hpp"
+#include "modules/network/connection_manager.hpp"
+#include "modules/network/forward_client.hpp"
+#include "modules/utils/encoder_selector.hpp"
 
 namespace SnowOwl::Edge::Core {
 
@@ -25,6 +29,22 @@ struct ForwarderConfig {
 	std::chrono::milliseconds reconnectDelay{std::chrono::milliseconds(2000)};
 	std::string deviceId;
 	std::string deviceName;
+	// "h264" or "h265" send VideoPacket messages through the selected
+	// encoder and fall back to JPEG when none starts; "jpeg" sends Frame
+	std::string codec{"h264"};
+	int bitrateKbps{2000};
+	Utils::EncoderChoice encoder{};
+	// Frames wait for the socket on a writer thread and are dropped beyond
+	// this many bytes; 0 writes on the forwarding thread and blocks it
+	std::size_t sendQueueBytes{1024 * 1024};
+	// frameInterval, bitrateKbps and jpegQuality are the best the uplink
+	// controller sends; under congestion it goes down to these bounds
+	bool adaptive{true};
+	int jpegQuality{80};
+	int minJpegQuality{40};
+	int minBitrateKbps{300};
+	std::chrono::milliseconds maxFrameInterval{std::chrono::milliseconds(500)};
+	double minScale{0.5};
 };
 
 class StreamForwarder {
@@ -40,20 +60,34 @@ public:
 
 	bool sendAudioData(const std::vector<std::uint8_t>& audioData);
 
+	SnowOwl::Utils::SystemResources::UplinkStatus uplinkStatus() const;
+
 private:
-	bool ensureConnected();
 	void forwardLoop();
-	bool sendFrame(const cv::Mat& frame);
-	std::vector<std::uint8_t> encodeFrame(const cv::Mat& frame) const;
-	std::vector<std::uint8_t> encodeAudioData(const std::vector<std::uint8_t>& audioData) const;
+	bool sendFrame(const std::shared_ptr<const CapturedFrame>& captured);
+	bool sendVideoFrame(const std::shared_ptr<const CapturedFrame>& captured, bool& encoded);
+	std::shared_ptr<const CapturedFrame> scaleFrame(const std::shared_ptr<const CapturedFrame>& captured);
+	void adaptUplink();
 
 	ForwarderConfig config_{};
 	StreamCapture* capture_{nullptr};
 
-	mutable std::mutex connectionMutex_;
-	std::unique_ptr<boost::asio::io_context> ioContext_;
-	std::unique_ptr<boost::asio::ip::tcp::socket> socket_;
-    bool sentHandshake_{false};
+	Network::ConnectionManager connection_;
+	Network::ForwardClient client_{connection_};
+
+	// Only touched by the forward thread
+	FrameEncoder videoEncoder_;
+	bool videoPackets_{false};
+	// A new connection or a send queue resync means the server needs a
+	// keyframe before it can decode again
+	std::uint64_t keyframeGeneration_{0};
+	std::chrono::steady_clock::time_point lastKeyframeRequest_{};
+	UplinkController uplink_;
+	// Reused once the encoder has released it
+	std::shared_ptr<CapturedFrame> scaledFrame_;
+
+	mutable std::mutex statusMutex_;
+	SnowOwl::Utils::SystemResources::UplinkStatus uplinkStatus_{};
 
 	std::thread thread_;
 	std::atomic<bool> running_{false};
@@ -0,0 +1,144 @@
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <sstream>
+
+#include "core/uplink_controller.hpp"
+
+namespace SnowOwl::Edge::Core {
+
+namespace {
+
+constexpr auto kWindow = std::chrono::seconds(1);
+// Idle windows in a row before stepping back up
+constexpr int kStableWindows = 3;
+constexpr double kBackoff = 0.8;
+constexpr double kRecoveryStep = 0.1;
+
+}
+
+void UplinkController::configure(const UplinkBounds& bounds, bool adaptive) {
+	bounds_ = bounds;
+	bounds_.maxJpegQuality = std::clamp(bounds_.maxJpegQuality, 1, 100);
+	bounds_.minJpegQuality = std::clamp(bounds_.minJpegQuality, 1, bounds_.maxJpegQuality);
+	bounds_.maxBitrateKbps = std::max(bounds_.maxBitrateKbps, 100);
+	bounds_.minBitrateKbps = std::clamp(bounds_.minBitrateKbps, 100, bounds_.maxBitrateKbps);
+	bounds_.minFrameInterval = std::max(bounds_.minFrameInterval, std::chrono::milliseconds(1));
+	bounds_.maxFrameInterval = std::max(bounds_.maxFrameInterval, bounds_.minFrameInterval);
+	bounds_.minScale = std::clamp(bounds_.minScale, 0.25, 1.0);
+	adaptive_ = adaptive;
+
+	level_ = 1.0;
+	stableWindows_ = 0;
+	haveBaseline_ = false;
+	decision_ = decide();
+
+	status_ = {};
+	status_.adaptive = adaptive_;
+	status_.jpegQuality = decision_.jpegQuality;
+	status_.bitrateKbps = decision_.bitrateKbps;
+	status_.fps = 1000.0 / static_cast<double>(decision_.frameInterval.count());
+	status_.scale = decision_.scale;
+}
+
+bool UplinkController::update(const Network::SendStats& stats, bool connected, std::chrono::steady_clock::time_point now) {
+	status_.active = connected;
+	status_.queuedBytes = stats.queuedBytes;
+	status_.droppedMessages = stats.droppedMessages;
+
+	// Windows start over after a reconnect so the outage is not counted as idle time
+	if (!connected || !haveBaseline_) {
+		baseline_ = stats;
+		windowStart_ = now;
+		haveBaseline_ = connected;
+		return false;
+	}
+
+	const auto elapsed = now - windowStart_;
+	if (elapsed < kWindow) {
+		return false;
+	}
+
+	const double seconds = std::chrono::duration<double>(elapsed).count();
+	const auto drops = stats.droppedMessages - baseline_.droppedMessages;
+	const auto messages = stats.messagesWritten - baseline_.messagesWritten;
+	const auto bytes = stats.bytesWritten - baseline_.bytesWritten;
+	const double writeSeconds = std::chrono::duration<double>(stats.writeTime - baseline_.writeTime).count();
+	baseline_ = stats;
+	windowStart_ = now;
+
+	const double writeLoad = writeSeconds / seconds;
+	const double queueFill = stats.queueBudget > 0
+		? static_cast<double>(stats.queuedBytes) / static_cast<double>(stats.queueBudget) : 0.0;
+	const bool congested = drops > 0 || queueFill > 0.5 || writeLoad > 0.7;
+	const bool idle = queueFill < 0.1 && writeLoad < 0.3;
+
+	status_.congested = congested;
+	status_.throughputKbps = static_cast<double>(bytes) * 8.0 / 1000.0 / seconds;
+	status_.avgWriteMs = messages > 0 ? writeSeconds * 1000.0 / static_cast<double>(messages) : 0.0;
+
+	if (!adaptive_) {
+		return false;
+	}
+
+	if (congested) {
+		// The small constant lets the level actually reach the bounds' worst
+		level_ = std::max(level_ * kBackoff - 0.05, 0.0);
+		stableWindows_ = 0;
+	} else if (idle && level_ < 1.0) {
+		if (++stableWindows_ >= kStableWindows) {
+			level_ = std::min(level_ + kRecoveryStep, 1.0);
+			stableWindows_ = 0;
+		}
+	} else {
+		stableWindows_ = 0;
+	}
+
+	const UplinkDecision next = decide();
+	if (next == decision_) {
+		return false;
+	}
+	decision_ = next;
+
+	std::ostringstream reason;
+	reason << (congested ? "congested" : "recovering") << " (drops " << drops
+		<< ", queue " << static_cast<int>(queueFill * 100.0) << "%, write load "
+		<< static_cast<int>(writeLoad * 100.0) << "%)";
+	status_.lastDecision = reason.str();
+	status_.jpegQuality = decision_.jpegQuality;
+	status_.bitrateKbps = decision_.bitrateKbps;
+	status_.fps = 1000.0 / static_cast<double>(decision_.frameInterval.count());
+	status_.scale = decision_.scale;
+
+	std::cout << "UplinkController: " << status_.lastDecision << " -> quality " << decision_.jpegQuality
+		<< ", bitrate " << decision_.bitrateKbps << " kbps, interval " << decision_.frameInterval.count()
+		<< " ms, scale " << decision_.scale << std::endl;
+	return true;
+}
+
+UplinkDecision UplinkController::decide() const {
+	// The level is split in thirds: the top one trades detail, the middle one
+	// frame rate and the bottom one resolution
+	const auto share = [this](double from) { return std::clamp((level_ - from) * 3.0, 0.0, 1.0); };
+	const double detail = share(2.0 / 3.0);
+	const double rate = share(1.0 / 3.0);
+	const double size = share(0.0);
+
+	UplinkDecision decision;
+	decision.jpegQuality = static_cast<int>(std::lround(bounds_.minJpegQuality
+		+ (bounds_.maxJpegQuality - bounds_.minJpegQuality) * detail));
+	decision.bitrateKbps = static_cast<int>(std::lround(bounds_.minBitrateKbps
+		+ (bounds_.maxBitrateKbps - bounds_.minBitrateKbps) * detail));
+
+	const double maxFps = 1000.0 / static_cast<double>(bounds_.minFrameInterval.count());
+	const double minFps = 1000.0 / static_cast<double>(bounds_.maxFrameInterval.count());
+	const double fps = minFps + (maxFps - minFps) * rate;
+	decision.frameInterval = std::clamp(std::chrono::milliseconds(std::lround(1000.0 / fps)),
+		bounds_.minFrameInterval, bounds_.maxFrameInterval);
+
+	const double scale = bounds_.minScale + (1.0 - bounds_.minScale) * size;
+	decision.scale = std::clamp(std::round(scale * 4.0) / 4.0, bounds_.minScale, 1.0);
+	return decision;
+}
+
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+#include "modules/network/connection_manager.hpp"
+#include "utils/health_monitor.hpp"
+
+namespace SnowOwl::Edge::Core {
+
+struct UplinkBounds {
+	int maxJpegQuality{80};
+	int minJpegQuality{40};
+	int maxBitrateKbps{2000};
+	int minBitrateKbps{300};
+	std::chrono::milliseconds minFrameInterval{std::chrono::milliseconds(100)};
+	std::chrono::milliseconds maxFrameInterval{std::chrono::milliseconds(500)};
+	double minScale{0.5};
+};
+
+struct UplinkDecision {
+	int jpegQuality{80};
+	int bitrateKbps{2000};
+	std::chrono::milliseconds frameInterval{std::chrono::milliseconds(100)};
+	// Applied to both frame sides, in quarter steps so the encoder reopens rarely
+	double scale{1.0};
+
+	bool operator==(const UplinkDecision& other) const {
+		return jpegQuality == other.jpegQuality && bitrateKbps == other.bitrateKbps
+			&& frameInterval == other.frameInterval && scale == other.scale;
+	}
+	bool operator!=(const UplinkDecision& other) const { return !(*this == other); }
+};
+
+// Picks quality, bitrate, frame rate and resolution from how the link keeps
+// up, judged once per window from ConnectionManager::sendStats(): messages
+// dropped, the send queue filling up, or writes blocking on the server's TCP
+// window mean congestion. Backs off multiplicatively and recovers slowly once
+// the link stays idle. Quality and bitrate give way first, then frame rate,
+// then resolution, and they come back in reverse order.
+class UplinkController {
+public:
+	void configure(const UplinkBounds& bounds, bool adaptive);
+
+	// Call once per sent frame; true when decision() changed
+	bool update(const Network::SendStats& stats, bool connected, std::chrono::steady_clock::time_point now);
+
+	const UplinkDecision& decision() const { return decision_; }
+	SnowOwl::Utils::SystemResources::UplinkStatus status() const { return status_; }
+
+private:
+	UplinkDecision decide() const;
+
+	UplinkBounds bounds_{};
+	bool adaptive_{true};
+	// 1 sends at the bounds' best, 0 at their worst
+	double level_{1.0};
+	int stableWindows_{0};
+	UplinkDecision decision_{};
+
+	bool haveBaseline_{false};
+	Network::SendStats baseline_{};
+	std::chrono::steady_clock::time_point windowStart_{};
+	SnowOwl::Utils::SystemResources::UplinkStatus status_{};
+};
+
+}
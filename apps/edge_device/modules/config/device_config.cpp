@@ -57,6 +57,16 @@ void applyForwardSettings(DeviceProfile& profile, const nlohmann::json& node) {
     profile.forward.port = node.value("port", profile.forward.port);
     profile.forward.frameIntervalMs = node.value("frame_interval_ms", profile.forward.frameIntervalMs);
     profile.forward.reconnectDelayMs = node.value("reconnect_delay_ms", profile.forward.reconnectDelayMs);
+    profile.forward.codec = node.value("codec", profile.forward.codec);
+    profile.forward.bitrateKbps = node.value("bitrate_kbps", profile.forward.bitrateKbps);
+    profile.forward.preferredEncoder = node.value("encoder", profile.forward.preferredEncoder);
+    profile.forward.sendQueueKb = node.value("send_queue_kb", profile.forward.sendQueueKb);
+    profile.forward.adaptive = node.value("adaptive", profile.forward.adaptive);
+    profile.forward.jpegQuality = node.value("jpeg_quality", profile.forward.jpegQuality);
+    profile.forward.minJpegQuality = node.value("min_jpeg_quality", profile.forward.minJpegQuality);
+    profile.forward.minBitrateKbps = node.value("min_bitrate_kbps", profile.forward.minBitrateKbps);
+    profile.forward.maxFrameIntervalMs = node.value("max_frame_interval_ms", profile.forward.maxFrameIntervalMs);
+    profile.forward.minScale = node.value("min_scale", profile.forward.minScale);
 }
 
 }
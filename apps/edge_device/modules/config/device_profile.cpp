@@ -48,6 +48,16 @@ DeviceProfile DeviceProfile::makeDefault() {
     profile.forward.port = 7500;
     profile.forward.frameIntervalMs = 33;
     profile.forward.reconnectDelayMs = 2000;
+    profile.forward.codec = "h264";
+    profile.forward.bitrateKbps = 2000;
+    profile.forward.preferredEncoder.clear();
+    profile.forward.sendQueueKb = 1024;
+    profile.forward.adaptive = true;
+    profile.forward.jpegQuality = 80;
+    profile.forward.minJpegQuality = 40;
+    profile.forward.minBitrateKbps = 300;
+    profile.forward.maxFrameIntervalMs = 500;
+    profile.forward.minScale = 0.5;
     return profile;
 }
 
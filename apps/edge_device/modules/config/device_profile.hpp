@@ -62,6 +62,18 @@ struct DeviceProfile {
         std::uint16_t port{7500};
         std::uint32_t frameIntervalMs{33};
         std::uint32_t reconnectDelayMs{2000};
+        std::string codec{"h264"};
+        std::uint32_t bitrateKbps{2000};
+        std::string preferredEncoder;
+        std::uint32_t sendQueueKb{1024};
+        // Bounds for the adaptive uplink; frameIntervalMs, bitrateKbps and
+        // jpegQuality are the best it sends on a good link
+        bool adaptive{true};
+        std::uint32_t jpegQuality{80};
+        std::uint32_t minJpegQuality{40};
+        std::uint32_t minBitrateKbps{300};
+        std::uint32_t maxFrameIntervalMs{500};
+        double minScale{0.5};
     } forward{};
 
     bool shouldRunOnDeviceDetection() const {
@@ -4,11 +4,19 @@
 
 namespace SnowOwl::Edge::Network {
 
+namespace {
+
+constexpr std::size_t kMaxPooledBuffers = 16;
+constexpr std::size_t kMaxPooledCapacity = 4 * 1024 * 1024;
+
+}
+
 ConnectionManager::ConnectionManager()
 	: state_(ConnectionState::Disconnected) {
 }
 
 ConnectionManager::~ConnectionManager() {
+	setSendQueueBudget(0);
 	disconnect();
 }
 
@@ -39,6 +47,7 @@ void ConnectionManager::disconnect() {
 	socket_.reset();
 	ioContext_.reset();
 	state_ = ConnectionState::Disconnected;
+	clearQueue();
 }
 
 bool ConnectionManager::isConnected() const {
@@ -68,15 +77,224 @@ bool ConnectionManager::send(const void* data, std::size_t size) {
 	boost::system::error_code ec;
 	boost::asio::write(*socket_, boost::asio::buffer(data, size), ec);
 	if (ec) {
-		lastError_ = ec.message();
-		state_ = ConnectionState::Error;
-		std::cerr << "ConnectionManager: send failed - " << ec.message() << std::endl;
+		failLocked(ec);
 		return false;
 	}
 
 	return true;
 }
 
+bool ConnectionManager::send(OutgoingMessage&& message) {
+	std::unique_lock<std::mutex> queueLock(queueMutex_);
+	if (queueBudget_ == 0) {
+		queueLock.unlock();
+
+		bool written = false;
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			written = writeLocked(message);
+		}
+		releaseBuffer(std::move(message.payload));
+		return written;
+	}
+
+	if (!isConnected()) {
+		queueLock.unlock();
+		releaseBuffer(std::move(message.payload));
+		return false;
+	}
+
+	const std::size_t size = message.size();
+	// Only video packets depend on the ones before them; a dropped JPEG or
+	// audio chunk breaks nothing, and neither can end a video resync
+	const bool video = message.type == SnowOwl::Protocol::MessageType::VideoPacket;
+	if (message.droppable) {
+		if (queuedBytes_ + size > queueBudget_) {
+			// Everything waiting is older than this message, so drop the stale part
+			for (auto it = queue_.begin(); it != queue_.end();) {
+				if (!it->droppable) {
+					++it;
+					continue;
+				}
+				if (it->type == SnowOwl::Protocol::MessageType::VideoPacket) {
+					resyncPending_ = true;
+				}
+				queuedBytes_ -= it->size();
+				releaseBuffer(std::move(it->payload));
+				it = queue_.erase(it);
+				++droppedMessages_;
+			}
+		}
+
+		// Still no room behind the undroppable backlog, or waiting for a keyframe
+		const bool full = !queue_.empty() && queuedBytes_ + size > queueBudget_;
+		if (full || (video && resyncPending_ && !message.keyframe)) {
+			resyncPending_ = resyncPending_ || video;
+			++droppedMessages_;
+			queueLock.unlock();
+			releaseBuffer(std::move(message.payload));
+			return true;
+		}
+		if (video) {
+			resyncPending_ = false;
+		}
+	}
+
+	queuedBytes_ += size;
+	queue_.push_back(std::move(message));
+	queueLock.unlock();
+	queueCv_.notify_one();
+	return true;
+}
+
+void ConnectionManager::setSendQueueBudget(std::size_t maxQueuedBytes) {
+	std::thread writer;
+	{
+		std::lock_guard<std::mutex> lock(queueMutex_);
+		queueBudget_ = maxQueuedBytes;
+		if (maxQueuedBytes > 0 && !writerRunning_) {
+			writerRunning_ = true;
+			writer_ = std::thread(&ConnectionManager::writerLoop, this);
+			return;
+		}
+		if (maxQueuedBytes == 0 && writerRunning_) {
+			writerRunning_ = false;
+			writer = std::move(writer_);
+		}
+	}
+
+	if (writer.joinable()) {
+		queueCv_.notify_all();
+		writer.join();
+		clearQueue();
+	}
+}
+
+bool ConnectionManager::resyncPending() const {
+	std::lock_guard<std::mutex> lock(queueMutex_);
+	return resyncPending_;
+}
+
+SendStats ConnectionManager::sendStats() const {
+	SendStats stats;
+	{
+		std::lock_guard<std::mutex> lock(queueMutex_);
+		stats.queuedBytes = queuedBytes_;
+		stats.queueBudget = queueBudget_;
+	}
+	stats.droppedMessages = droppedMessages_.load();
+	stats.messagesWritten = messagesWritten_.load();
+	stats.bytesWritten = bytesWritten_.load();
+	stats.writeTime = std::chrono::microseconds(writeMicros_.load());
+	return stats;
+}
+
+std::vector<std::uint8_t> ConnectionManager::acquireBuffer() {
+	std::lock_guard<std::mutex> lock(bufferMutex_);
+	if (freeBuffers_.empty()) {
+		return {};
+	}
+	auto buffer = std::move(freeBuffers_.back());
+	freeBuffers_.pop_back();
+	return buffer;
+}
+
+void ConnectionManager::releaseBuffer(std::vector<std::uint8_t>&& buffer) {
+	if (buffer.capacity() == 0 || buffer.capacity() > kMaxPooledCapacity) {
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(bufferMutex_);
+	if (freeBuffers_.size() < kMaxPooledBuffers) {
+		buffer.clear();
+		freeBuffers_.push_back(std::move(buffer));
+	}
+}
+
+bool ConnectionManager::writeLocked(const OutgoingMessage& message) {
+	if (!socket_ || !socket_->is_open()) {
+		return false;
+	}
+
+	const auto length = static_cast<std::uint32_t>(message.prefixSize + message.payload.size());
+	const std::array<std::uint8_t, 5> header = {
+		static_cast<std::uint8_t>(message.type),
+		static_cast<std::uint8_t>(length & 0xFF),
+		static_cast<std::uint8_t>((length >> 8) & 0xFF),
+		static_cast<std::uint8_t>((length >> 16) & 0xFF),
+		static_cast<std::uint8_t>((length >> 24) & 0xFF)
+	};
+	const std::array<boost::asio::const_buffer, 3> buffers = {
+		boost::asio::buffer(header),
+		boost::asio::buffer(message.prefix.data(), message.prefixSize),
+		boost::asio::buffer(message.payload)
+	};
+
+	boost::system::error_code ec;
+	const auto start = std::chrono::steady_clock::now();
+	boost::asio::write(*socket_, buffers, ec);
+	writeMicros_ += static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now() - start).count());
+	if (ec) {
+		failLocked(ec);
+		return false;
+	}
+	++messagesWritten_;
+	bytesWritten_ += message.size();
+	return true;
+}
+
+// Closes the socket so the next connect() starts over; what is still
+// queued belonged to the dead connection
+void ConnectionManager::failLocked(const boost::system::error_code& ec) {
+	lastError_ = ec.message();
+	state_ = ConnectionState::Error;
+	std::cerr << "ConnectionManager: send failed - " << ec.message() << std::endl;
+
+	if (socket_) {
+		boost::system::error_code closeEc;
+		socket_->close(closeEc);
+		socket_.reset();
+	}
+	clearQueue();
+}
+
+void ConnectionManager::clearQueue() {
+	std::deque<OutgoingMessage> stale;
+	{
+		std::lock_guard<std::mutex> lock(queueMutex_);
+		stale.swap(queue_);
+		queuedBytes_ = 0;
+		resyncPending_ = false;
+	}
+	for (auto& message : stale) {
+		releaseBuffer(std::move(message.payload));
+	}
+}
+
+void ConnectionManager::writerLoop() {
+	std::unique_lock<std::mutex> queueLock(queueMutex_);
+	while (true) {
+		queueCv_.wait(queueLock, [this]() { return !writerRunning_ || !queue_.empty(); });
+		if (!writerRunning_) {
+			break;
+		}
+
+		OutgoingMessage message = std::move(queue_.front());
+		queue_.pop_front();
+		queuedBytes_ -= message.size();
+		queueLock.unlock();
+
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			writeLocked(message);
+		}
+		releaseBuffer(std::move(message.payload));
+
+		queueLock.lock();
+	}
+}
+
 bool ConnectionManager::establishLocked() {
 	if (socket_ && socket_->is_open()) {
 		state_ = ConnectionState::Connected;
@@ -98,6 +316,8 @@ bool ConnectionManager::establishLocked() {
 		socket_ = std::move(socket);
 		lastError_.clear();
 		state_ = ConnectionState::Connected;
+		++generation_;
+		std::cout << "ConnectionManager: connected to " << settings_.host << ':' << settings_.port << std::endl;
 		return true;
 	} catch (const std::exception& ex) {
 		lastError_ = ex.what();
@@ -1,16 +1,22 @@
 #pragma once
 
+#include <array>
 #include <atomic>
 #include <chrono>
+#include <condition_variable>
 #include <cstdint>
+#include <deque>
 #include <memory>
 #include <mutex>
 #include <optional>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include <boost/asio.hpp>
 
+#include "protocol/message_types.hpp"
+
 namespace SnowOwl::Edge::Network {
 
 enum class ConnectionState {
@@ -27,6 +33,36 @@ struct ConnectionSettings {
 	std::chrono::milliseconds reconnectDelay{std::chrono::milliseconds(2000)};
 };
 
+// One framed message. The 5-byte type/length header, the prefix and the
+// payload are gather-written, so none of them is copied into the others.
+struct OutgoingMessage {
+	SnowOwl::Protocol::MessageType type{SnowOwl::Protocol::MessageType::Frame};
+	// Small per-message header that precedes the payload, e.g. the VideoPacket header
+	std::array<std::uint8_t, 16> prefix{};
+	std::size_t prefixSize{0};
+	// Ideally from ConnectionManager::acquireBuffer; returned to the pool once written
+	std::vector<std::uint8_t> payload;
+	// Droppable messages may be discarded under congestion. After a dropped
+	// VideoPacket the following ones are dropped too until a keyframe, where
+	// the receiver can resume; other types are dropped one by one.
+	bool droppable{false};
+	bool keyframe{true};
+
+	std::size_t size() const { return 5 + prefixSize + payload.size(); }
+};
+
+// Cumulative since construction except for the queue fields, so callers
+// compare two samples to get rates
+struct SendStats {
+	std::size_t queuedBytes{0};
+	std::size_t queueBudget{0};
+	std::uint64_t droppedMessages{0};
+	std::uint64_t messagesWritten{0};
+	std::uint64_t bytesWritten{0};
+	// Time spent blocked in socket writes, i.e. waiting on the peer's TCP window
+	std::chrono::microseconds writeTime{0};
+};
+
 class ConnectionManager {
 public:
 	ConnectionManager();
@@ -44,9 +80,33 @@ public:
 
 	bool send(const std::vector<std::uint8_t>& payload);
 	bool send(const void* data, std::size_t size);
+	// Written right away, or handed to the writer thread when a send queue
+	// budget is set. Never connects, so a reconnect cannot skip the caller's
+	// handshake; false when disconnected, while congestion drops count as sent.
+	bool send(OutgoingMessage&& message);
+
+	// 0 writes on the calling thread. Otherwise a writer thread drains the
+	// queue; when droppable messages would push it past maxQueuedBytes the
+	// stale queued ones are discarded, and once a video packet was dropped so
+	// is every video packet up to the next keyframe.
+	void setSendQueueBudget(std::size_t maxQueuedBytes);
+	std::uint64_t droppedMessages() const { return droppedMessages_.load(); }
+	// True from a dropped video packet until a keyframe is queued again
+	bool resyncPending() const;
+	// Incremented for every established connection
+	std::uint64_t generation() const { return generation_.load(); }
+	SendStats sendStats() const;
+
+	// Payload buffers keep their capacity between messages
+	std::vector<std::uint8_t> acquireBuffer();
+	void releaseBuffer(std::vector<std::uint8_t>&& buffer);
 
 private:
 	bool establishLocked();
+	bool writeLocked(const OutgoingMessage& message);
+	void failLocked(const boost::system::error_code& ec);
+	void clearQueue();
+	void writerLoop();
 
 	mutable std::mutex mutex_;
 	ConnectionSettings settings_;
@@ -55,6 +115,24 @@ private:
 
 	std::unique_ptr<boost::asio::io_context> ioContext_;
 	std::unique_ptr<boost::asio::ip::tcp::socket> socket_;
+	std::atomic<std::uint64_t> generation_{0};
+
+	// Lock order: mutex_ before queueMutex_
+	mutable std::mutex queueMutex_;
+	std::condition_variable queueCv_;
+	std::deque<OutgoingMessage> queue_;
+	std::size_t queuedBytes_{0};
+	std::size_t queueBudget_{0};
+	bool resyncPending_{false};
+	bool writerRunning_{false};
+	std::thread writer_;
+	std::atomic<std::uint64_t> droppedMessages_{0};
+	std::atomic<std::uint64_t> messagesWritten_{0};
+	std::atomic<std::uint64_t> bytesWritten_{0};
+	std::atomic<std::uint64_t> writeMicros_{0};
+
+	std::mutex bufferMutex_;
+	std::vector<std::vector<std::uint8_t>> freeBuffers_;
 };
 
 }
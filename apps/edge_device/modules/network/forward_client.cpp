@@ -12,13 +12,6 @@ namespace SnowOwl::Edge::Network {
 
 namespace {
 
-template <typename T>
-void writeLE(std::vector<std::uint8_t>& buffer, T value) {
-	for (std::size_t i = 0; i < sizeof(T); ++i) {
-		buffer.push_back(static_cast<std::uint8_t>((value >> (8 * i)) & 0xFF));
-	}
-}
-
 std::string utcNow() {
 	const auto now = std::chrono::system_clock::now();
 	const std::time_t timeValue = std::chrono::system_clock::to_time_t(now);
@@ -66,8 +59,7 @@ bool ForwardClient::sendHandshake() {
 	}
 	payload["connected_at"] = utcNow();
 
-	const auto buffer = serializeControl(payload);
-	if (!manager_.send(buffer)) {
+	if (!manager_.send(serializeControl(payload))) {
 		return false;
 	}
 
@@ -80,21 +72,30 @@ bool ForwardClient::sendFrame(const cv::Mat& frame, int quality) {
 		return false;
 	}
 
-	if (!ensureConnected()) {
+	if (!prepare()) {
 		return false;
 	}
 
-	if (!handshakeSent_ && !sendHandshake()) {
+	OutgoingMessage message;
+	if (!encodeFrame(frame, quality, message)) {
+		manager_.releaseBuffer(std::move(message.payload));
 		return false;
 	}
 
-	const auto payload = encodeFrame(frame, quality);
-	if (payload.empty()) {
+	return manager_.send(std::move(message));
+}
+
+bool ForwardClient::sendVideoPacket(SnowOwl::Protocol::VideoCodec codec, const std::uint8_t* data, std::size_t size,
+	std::int64_t ptsUs, bool keyframe) {
+	if (!data || size == 0) {
+		return false;
+	}
 
+	if (!prepare()) {
 		return false;
 	}
 
-	return manager_.send(payload);
+	return manager_.send(encodeVideoPacket(codec, data, size, ptsUs, keyframe));
 }
 
 bool ForwardClient::sendControl(const nlohmann::json& payload) {
@@ -105,30 +106,62 @@ bool ForwardClient::sendControl(const nlohmann::json& payload) {
 	return manager_.send(serializeControl(payload));
 }
 
-std::vector<std::uint8_t> ForwardClient::encodeFrame(const cv::Mat& frame, int quality) const {
-	std::vector<int> params = {cv::IMWRITE_JPEG_QUALITY, quality};
-	std::vector<unsigned char> jpegBuffer;
-	if (!cv::imencode(".jpg", frame, jpegBuffer, params)) {
-		return {};
+bool ForwardClient::sendAudio(const void* data, std::size_t size) {
+	if (!manager_.isConnected()) {
+		return false;
+	}
+
+	OutgoingMessage message;
+	message.type = SnowOwl::Protocol::MessageType::AudioData;
+	message.payload = manager_.acquireBuffer();
+	const auto* bytes = static_cast<const std::uint8_t*>(data);
+	message.payload.assign(bytes, bytes + size);
+	message.droppable = true;
+	return manager_.send(std::move(message));
+}
+
+bool ForwardClient::prepare() {
+	if (!ensureConnected()) {
+		return false;
 	}
 
-	std::vector<std::uint8_t> buffer;
-	buffer.reserve(jpegBuffer.size() + 5);
-	buffer.push_back(static_cast<std::uint8_t>(SnowOwl::Protocol::MessageType::Frame));
-	writeLE<std::uint32_t>(buffer, static_cast<std::uint32_t>(jpegBuffer.size()));
-	buffer.insert(buffer.end(), jpegBuffer.begin(), jpegBuffer.end());
-	return buffer;
+	return handshakeSent_ || sendHandshake();
+}
+
+// Encodes straight into a pooled buffer; the header is written separately
+bool ForwardClient::encodeFrame(const cv::Mat& frame, int quality, OutgoingMessage& message) const {
+	const std::vector<int> params = {cv::IMWRITE_JPEG_QUALITY, quality};
+	message.type = SnowOwl::Protocol::MessageType::Frame;
+	message.payload = manager_.acquireBuffer();
+	message.droppable = true;
+	return cv::imencode(".jpg", frame, message.payload, params);
+}
+
+OutgoingMessage ForwardClient::encodeVideoPacket(SnowOwl::Protocol::VideoCodec codec, const std::uint8_t* data,
+	std::size_t size, std::int64_t ptsUs, bool keyframe) const {
+	OutgoingMessage message;
+	message.type = SnowOwl::Protocol::MessageType::VideoPacket;
+	message.prefix[0] = static_cast<std::uint8_t>(codec);
+	message.prefix[1] = keyframe ? SnowOwl::Protocol::kVideoPacketKeyframe : 0;
+	for (std::size_t i = 0; i < 8; ++i) {
+		message.prefix[2 + i] = static_cast<std::uint8_t>((static_cast<std::uint64_t>(ptsUs) >> (8 * i)) & 0xFF);
+	}
+	message.prefixSize = SnowOwl::Protocol::kVideoPacketHeaderSize;
+	// The encoder's buffer goes back to GStreamer, so this is the one copy
+	message.payload = manager_.acquireBuffer();
+	message.payload.assign(data, data + size);
+	message.droppable = true;
+	message.keyframe = keyframe;
+	return message;
 }
 
-std::vector<std::uint8_t> ForwardClient::serializeControl(const nlohmann::json& payload) const {
+OutgoingMessage ForwardClient::serializeControl(const nlohmann::json& payload) const {
 	const std::string serialized = payload.dump();
 
-	std::vector<std::uint8_t> buffer;
-	buffer.reserve(serialized.size() + 5);
-	buffer.push_back(static_cast<std::uint8_t>(SnowOwl::Protocol::MessageType::Control));
-	writeLE<std::uint32_t>(buffer, static_cast<std::uint32_t>(serialized.size()));
-	buffer.insert(buffer.end(), serialized.begin(), serialized.end());
-	return buffer;
+	OutgoingMessage message;
+	message.type = SnowOwl::Protocol::MessageType::Control;
+	message.payload.assign(serialized.begin(), serialized.end());
+	return message;
 }
 
 }
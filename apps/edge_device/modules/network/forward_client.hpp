@@ -9,6 +9,7 @@
 #include <nlohmann/json.hpp>
 
 #include "modules/network/connection_manager.hpp"
+#include "protocol/message_types.hpp"
 
 namespace SnowOwl::Edge::Network {
 
@@ -21,13 +22,21 @@ public:
 	bool ensureConnected();
 	bool sendHandshake();
 	bool sendFrame(const cv::Mat& frame, int quality = 80);
+	// One encoded access unit, e.g. from Core::FrameEncoder
+	bool sendVideoPacket(SnowOwl::Protocol::VideoCodec codec, const std::uint8_t* data, std::size_t size,
+		std::int64_t ptsUs, bool keyframe);
 	bool sendControl(const nlohmann::json& payload);
+	// Never connects, so it is safe next to the forwarding thread
+	bool sendAudio(const void* data, std::size_t size);
 
 	bool isConnected() const { return manager_.isConnected(); }
 
 private:
-	std::vector<std::uint8_t> encodeFrame(const cv::Mat& frame, int quality) const;
-	std::vector<std::uint8_t> serializeControl(const nlohmann::json& payload) const;
+	bool prepare();
+	bool encodeFrame(const cv::Mat& frame, int quality, OutgoingMessage& message) const;
+	OutgoingMessage encodeVideoPacket(SnowOwl::Protocol::VideoCodec codec, const std::uint8_t* data,
+		std::size_t size, std::int64_t ptsUs, bool keyframe) const;
+	OutgoingMessage serializeControl(const nlohmann::json& payload) const;
 
 	ConnectionManager& manager_;
 	std::string deviceId_;
@@ -0,0 +1,439 @@
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <unordered_map>
+
+extern "C" {
+#include <libavutil/mem.h>
+#include <libavutil/opt.h>
+}
+
+#include "core/output/hls_output.hpp"
+
+namespace SnowOwl::Server::Core {
+
+namespace {
+
+constexpr int kAvioBufferSize = 64 * 1024;
+// Parts are listed for this many of the newest segments only
+constexpr std::size_t kSegmentsWithParts = 3;
+
+std::mutex g_registryMutex;
+std::unordered_map<std::string, std::weak_ptr<HlsSegmentStore>> g_registry;
+
+double doubleParameter(const StreamOutputConfig& config, const char* key, double fallback) {
+	const auto it = config.parameters.find(key);
+	if (it == config.parameters.end()) {
+		return fallback;
+	}
+
+	try {
+		return std::stod(it->second);
+	} catch (const std::exception&) {
+		std::cerr << "HlsOutput: invalid " << key << ": " << it->second << std::endl;
+		return fallback;
+	}
+}
+
+// avio write callbacks became const in libavformat 61
+#if LIBAVFORMAT_VERSION_MAJOR >= 61
+int writeToStore(void* opaque, const std::uint8_t* data, int size)
+#else
+int writeToStore(void* opaque, std::uint8_t* data, int size)
+#endif
+{
+	static_cast<HlsSegmentStore*>(opaque)->append(data, static_cast<std::size_t>(size));
+	return size;
+}
+
+}
+
+HlsOptions HlsOptions::fromConfig(const StreamOutputConfig& config) {
+	HlsOptions options;
+	if (auto it = config.parameters.find("name"); it != config.parameters.end() && !it->second.empty()) {
+		options.name = it->second;
+	}
+
+	const double segmentCount = doubleParameter(config, "segment_count", static_cast<double>(options.segmentCount));
+	options.segmentCount = static_cast<std::size_t>(std::max(3.0, segmentCount));
+	options.segmentSeconds = std::max(0.5, doubleParameter(config, "segment_seconds", options.segmentSeconds));
+	options.partSeconds = std::clamp(doubleParameter(config, "part_seconds", options.partSeconds), 0.0, options.segmentSeconds);
+	return options;
+}
+
+HlsSegmentStore::HlsSegmentStore(const HlsOptions& options)
+	: options_(options)
+{
+}
+
+void HlsSegmentStore::beginSegment(bool discontinuity) {
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	Segment segment;
+	segment.sequence = nextSequence_++;
+	segment.discontinuity = discontinuity;
+	segments_.push_back(std::move(segment));
+	partOffset_ = 0;
+
+	while (segments_.size() > options_.segmentCount + 1) {
+		if (segments_.front().discontinuity) {
+			++discontinuitySequence_;
+		}
+		segments_.pop_front();
+	}
+}
+
+void HlsSegmentStore::discardSegment() {
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (!segments_.empty() && !segments_.back().complete) {
+		segments_.pop_back();
+		--nextSequence_;
+	}
+}
+
+void HlsSegmentStore::append(const std::uint8_t* data, std::size_t size) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (segments_.empty() || segments_.back().complete) {
+		return;
+	}
+	segments_.back().data.append(reinterpret_cast<const char*>(data), size);
+}
+
+void HlsSegmentStore::closePart(double duration, bool independent) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (segments_.empty() || segments_.back().complete) {
+		return;
+	}
+
+	auto& segment = segments_.back();
+	if (segment.data.size() > partOffset_) {
+		segment.parts.push_back({partOffset_, segment.data.size() - partOffset_, duration, independent});
+		partOffset_ = segment.data.size();
+	}
+}
+
+void HlsSegmentStore::closeSegment(double duration) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (segments_.empty() || segments_.back().complete) {
+		return;
+	}
+
+	segments_.back().duration = duration;
+	segments_.back().complete = true;
+}
+
+const HlsSegmentStore::Segment* HlsSegmentStore::findSegment(std::int64_t sequence) const {
+	if (segments_.empty() || sequence < segments_.front().sequence || sequence > segments_.back().sequence) {
+		return nullptr;
+	}
+	return &segments_[static_cast<std::size_t>(sequence - segments_.front().sequence)];
+}
+
+std::string HlsSegmentStore::playlist() const {
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	const bool lowLatency = options_.partSeconds > 0.0;
+	double longest = options_.segmentSeconds;
+	// Below about 1 / partSeconds fps a single frame outlasts the target,
+	// so advertise the longest part actually served instead
+	double partTarget = options_.partSeconds;
+	std::size_t complete = 0;
+	for (const auto& segment : segments_) {
+		for (const auto& part : segment.parts) {
+			partTarget = std::max(partTarget, part.duration);
+		}
+		if (segment.complete) {
+			longest = std::max(longest, segment.duration);
+			++complete;
+		}
+	}
+
+	std::ostringstream out;
+	out << std::fixed << std::setprecision(3);
+	out << "#EXTM3U\n"
+	    << "#EXT-X-VERSION:" << (lowLatency ? 9 : 3) << "\n"
+	    << "#EXT-X-TARGETDURATION:" << static_cast<int>(std::ceil(longest)) << "\n";
+	if (lowLatency) {
+		out << "#EXT-X-SERVER-CONTROL:CAN-BLOCK-RELOAD=YES,PART-HOLD-BACK=" << partTarget * 3.0 << "\n"
+		    << "#EXT-X-PART-INF:PART-TARGET=" << partTarget << "\n";
+	}
+
+	// Only complete segments are listed to non-LL clients; the oldest one in
+	// the ring stays out so a segment is never dropped while it is advertised
+	const std::size_t skip = complete > options_.segmentCount ? 1 : 0;
+	const std::int64_t first = segments_.empty() ? 0 : segments_.front().sequence + static_cast<std::int64_t>(skip);
+	out << "#EXT-X-MEDIA-SEQUENCE:" << first << "\n"
+	    << "#EXT-X-DISCONTINUITY-SEQUENCE:"
+	    << discontinuitySequence_ + (skip && segments_.front().discontinuity ? 1 : 0) << "\n"
+	    << "#EXT-X-INDEPENDENT-SEGMENTS\n";
+
+	for (std::size_t i = skip; i < segments_.size(); ++i) {
+		const auto& segment = segments_[i];
+		if (segment.discontinuity) {
+			out << "#EXT-X-DISCONTINUITY\n";
+		}
+
+		if (lowLatency && segments_.size() - i <= kSegmentsWithParts) {
+			for (std::size_t p = 0; p < segment.parts.size(); ++p) {
+				const auto& part = segment.parts[p];
+				out << "#EXT-X-PART:DURATION=" << part.duration
+				    << ",URI=\"" << segment.sequence << "." << p << ".ts\""
+				    << (part.independent ? ",INDEPENDENT=YES" : "") << "\n";
+			}
+		}
+
+		if (segment.complete) {
+			out << "#EXTINF:" << segment.duration << ",\n" << segment.sequence << ".ts\n";
+		} else if (lowLatency) {
+			out << "#EXT-X-PRELOAD-HINT:TYPE=PART,URI=\"" << segment.sequence << "." << segment.parts.size() << ".ts\"\n";
+		}
+	}
+
+	return out.str();
+}
+
+bool HlsSegmentStore::contains(std::int64_t msn, std::optional<int> part) const {
+	std::lock_guard<std::mutex> lock(mutex_);
+	const Segment* segment = findSegment(msn);
+	if (!segment) {
+		return !segments_.empty() && msn < segments_.front().sequence;
+	}
+	if (segment->complete) {
+		return true;
+	}
+	return part && *part >= 0 && static_cast<std::size_t>(*part) < segment->parts.size();
+}
+
+std::optional<std::string> HlsSegmentStore::segment(std::int64_t sequence) const {
+	std::lock_guard<std::mutex> lock(mutex_);
+	const Segment* segment = findSegment(sequence);
+	if (!segment || !segment->complete) {
+		return std::nullopt;
+	}
+	return segment->data;
+}
+
+std::optional<std::string> HlsSegmentStore::part(std::int64_t sequence, int index) const {
+	std::lock_guard<std::mutex> lock(mutex_);
+	const Segment* segment = findSegment(sequence);
+	if (!segment || index < 0 || static_cast<std::size_t>(index) >= segment->parts.size()) {
+		return std::nullopt;
+	}
+	const auto& part = segment->parts[static_cast<std::size_t>(index)];
+	return segment->data.substr(part.offset, part.size);
+}
+
+void HlsSegmentStore::publish(const std::shared_ptr<HlsSegmentStore>& store) {
+	std::lock_guard<std::mutex> lock(g_registryMutex);
+	g_registry[store->options().name] = store;
+}
+
+void HlsSegmentStore::unpublish(const HlsSegmentStore* store) {
+	std::lock_guard<std::mutex> lock(g_registryMutex);
+	auto it = g_registry.find(store->options().name);
+	if (it != g_registry.end()) {
+		auto current = it->second.lock();
+		if (!current || current.get() == store) {
+			g_registry.erase(it);
+		}
+	}
+}
+
+std::shared_ptr<HlsSegmentStore> HlsSegmentStore::find(const std::string& name) {
+	std::lock_guard<std::mutex> lock(g_registryMutex);
+	auto it = g_registry.find(name);
+	return it == g_registry.end() ? nullptr : it->second.lock();
+}
+
+HlsOutput::HlsOutput(StreamOutputConfig config)
+	: config_(std::move(config))
+	, options_(HlsOptions::fromConfig(config_))
+{
+}
+
+HlsOutput::~HlsOutput() {
+	stop();
+}
+
+bool HlsOutput::start() {
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (started_) {
+		return true;
+	}
+
+	store_ = std::make_shared<HlsSegmentStore>(options_);
+	HlsSegmentStore::publish(store_);
+	started_ = true;
+	return true;
+}
+
+void HlsOutput::stop() {
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (!started_) {
+		return;
+	}
+
+	if (segmentOpen_) {
+		finishSegment(lastPts_);
+	}
+	closeMuxer();
+	HlsSegmentStore::unpublish(store_.get());
+	store_.reset();
+	started_ = false;
+}
+
+double HlsOutput::secondsBetween(std::int64_t from, std::int64_t to) const {
+	if (!stream_) {
+		return 0.0;
+	}
+	return static_cast<double>(to - from) * av_q2d(stream_->timeBase);
+}
+
+void HlsOutput::publishPacket(EncodedPacket& packet) {
+	if (!packet.valid() || !packet.stream) {
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (!started_) {
+		return;
+	}
+
+	AVPacket* pkt = packet.packet;
+	const std::int64_t pts = pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+	if (pts == AV_NOPTS_VALUE) {
+		return;
+	}
+
+	if (formatCtx_ && packet.stream != stream_) {
+		// New encoder session: end the current segment and flag the switch
+		if (segmentOpen_) {
+			finishSegment(lastPts_);
+		}
+		closeMuxer();
+		discontinuity_ = true;
+	}
+
+	if (segmentOpen_ && packet.keyframe() && secondsBetween(segmentStartPts_, pts) >= options_.segmentSeconds) {
+		finishSegment(pts);
+	}
+
+	if (!segmentOpen_) {
+		if (!packet.keyframe()) {
+			return;
+		}
+
+		store_->beginSegment(discontinuity_);
+		if (!formatCtx_) {
+			if (!openMuxer(packet)) {
+				store_->discardSegment();
+				return;
+			}
+		} else {
+			// PAT/PMT at the head of every segment so each one decodes on its own
+			av_opt_set(formatCtx_->priv_data, "mpegts_flags", "+resend_headers", 0);
+		}
+
+		discontinuity_ = false;
+		segmentOpen_ = true;
+		segmentStartPts_ = pts;
+		partStartPts_ = pts;
+		partIndependent_ = true;
+	} else if (options_.partSeconds > 0.0 && pts > partStartPts_
+		&& secondsBetween(partStartPts_, pts) + secondsBetween(lastPts_, pts) > options_.partSeconds + 0.001) {
+		// A part lasts until the packet after its last one, so close it before
+		// this packet if, lasting as long as the previous one, it would
+		// overrun PART-TARGET
+		flushMuxer();
+		store_->closePart(secondsBetween(partStartPts_, pts), partIndependent_);
+		partStartPts_ = pts;
+		partIndependent_ = packet.keyframe();
+	}
+
+	lastPts_ = pts;
+	av_packet_rescale_ts(pkt, stream_->timeBase, videoStream_->time_base);
+	pkt->stream_index = videoStream_->index;
+	if (av_write_frame(formatCtx_, pkt) < 0) {
+		std::cerr << "HlsOutput: failed to mux packet for " << options_.name << std::endl;
+	}
+}
+
+void HlsOutput::finishSegment(std::int64_t endPts) {
+	flushMuxer();
+	store_->closePart(secondsBetween(partStartPts_, endPts), partIndependent_);
+	store_->closeSegment(secondsBetween(segmentStartPts_, endPts));
+	segmentOpen_ = false;
+}
+
+void HlsOutput::flushMuxer() {
+	if (!formatCtx_) {
+		return;
+	}
+
+	av_write_frame(formatCtx_, nullptr);
+	avio_flush(formatCtx_->pb);
+}
+
+bool HlsOutput::openMuxer(const EncodedPacket& first) {
+	AVFormatContext* formatCtx = nullptr;
+	if (avformat_alloc_output_context2(&formatCtx, nullptr, "mpegts", nullptr) < 0 || !formatCtx) {
+		std::cerr << "HlsOutput: failed to allocate output context" << std::endl;
+		return false;
+	}
+
+	AVStream* stream = avformat_new_stream(formatCtx, nullptr);
+	if (!stream || avcodec_parameters_copy(stream->codecpar, first.stream->parameters) < 0) {
+		std::cerr << "HlsOutput: failed to create stream" << std::endl;
+		avformat_free_context(formatCtx);
+		return false;
+	}
+	stream->codecpar->codec_tag = 0;
+	stream->time_base = AVRational{1, 90000};
+
+	auto* buffer = static_cast<unsigned char*>(av_malloc(kAvioBufferSize));
+	AVIOContext* io = buffer
+		? avio_alloc_context(buffer, kAvioBufferSize, 1, store_.get(), nullptr, &writeToStore, nullptr)
+		: nullptr;
+	if (!io) {
+		std::cerr << "HlsOutput: failed to allocate memory io" << std::endl;
+		av_free(buffer);
+		avformat_free_context(formatCtx);
+		return false;
+	}
+	formatCtx->pb = io;
+	formatCtx->flags |= AVFMT_FLAG_CUSTOM_IO;
+
+	if (avformat_write_header(formatCtx, nullptr) < 0) {
+		std::cerr << "HlsOutput: failed to write stream header" << std::endl;
+		av_freep(&io->buffer);
+		avio_context_free(&io);
+		avformat_free_context(formatCtx);
+		return false;
+	}
+
+	formatCtx_ = formatCtx;
+	videoStream_ = stream;
+	stream_ = first.stream;
+	return true;
+}
+
+void HlsOutput::closeMuxer() {
+	if (!formatCtx_) {
+		return;
+	}
+
+	av_write_trailer(formatCtx_);
+	if (formatCtx_->pb) {
+		av_freep(&formatCtx_->pb->buffer);
+		avio_context_free(&formatCtx_->pb);
+	}
+	avformat_free_context(formatCtx_);
+	formatCtx_ = nullptr;
+	videoStream_ = nullptr;
+	stream_.reset();
+	segmentOpen_ = false;
+}
+
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+#include "core/output/video_encoder.hpp"
+#include "core/streams/stream_dispatcher.hpp"
+
+namespace SnowOwl::Server::Core {
+
+struct HlsOptions {
+	// Path component under /hls/ the REST server serves this stream at
+	std::string name{"live"};
+	std::size_t segmentCount{6};
+	double segmentSeconds{2.0};
+	// Low-latency partial segments; 0 disables them
+	double partSeconds{0.5};
+
+	static HlsOptions fromConfig(const StreamOutputConfig& config);
+};
+
+// The last few MPEG-TS segments of one HLS stream, kept in memory and shared
+// between the muxer thread writing them and the REST server reading them.
+// The segment being written is exposed part by part for LL-HLS clients.
+class HlsSegmentStore {
+public:
+	explicit HlsSegmentStore(const HlsOptions& options);
+
+	void beginSegment(bool discontinuity);
+	void append(const std::uint8_t* data, std::size_t size);
+	void closePart(double duration, bool independent);
+	void closeSegment(double duration);
+	// Drops the segment being written, e.g. when the muxer failed to open
+	void discardSegment();
+
+	std::string playlist() const;
+	// Blocking playlist reload: true once segment msn (or part msn.part) is listed
+	bool contains(std::int64_t msn, std::optional<int> part) const;
+	std::optional<std::string> segment(std::int64_t sequence) const;
+	std::optional<std::string> part(std::int64_t sequence, int index) const;
+	const HlsOptions& options() const { return options_; }
+
+	// Streams currently served over REST, keyed by HlsOptions::name
+	static void publish(const std::shared_ptr<HlsSegmentStore>& store);
+	static void unpublish(const HlsSegmentStore* store);
+	static std::shared_ptr<HlsSegmentStore> find(const std::string& name);
+
+private:
+	struct Part {
+		std::size_t offset{0};
+		std::size_t size{0};
+		double duration{0.0};
+		bool independent{false};
+	};
+
+	struct Segment {
+		std::int64_t sequence{0};
+		std::string data;
+		std::vector<Part> parts;
+		double duration{0.0};
+		bool complete{false};
+		bool discontinuity{false};
+	};
+
+	const Segment* findSegment(std::int64_t sequence) const;
+
+	HlsOptions options_;
+	mutable std::mutex mutex_;
+	std::deque<Segment> segments_;
+	std::int64_t nextSequence_{0};
+	std::int64_t discontinuitySequence_{0};
+	std::size_t partOffset_{0};
+};
+
+// Muxer-only output that turns the shared encoder's packets into an HLS
+// stream held entirely in memory: MPEG-TS segments cut on keyframes, each
+// further split into partial segments, served by the REST server under
+// /hls/<name>/index.m3u8.
+class HlsOutput final : public StreamOutput {
+public:
+	explicit HlsOutput(StreamOutputConfig config);
+	~HlsOutput() override;
+
+	bool start() override;
+	void stop() override;
+	void publishFrame(const cv::Mat&) override {}
+	void publishEvents(const std::vector<Detection::DetectionResult>&) override {}
+
+	bool consumesPackets() const override { return true; }
+	void publishPacket(EncodedPacket& packet) override;
+
+private:
+	bool openMuxer(const EncodedPacket& first);
+	void closeMuxer();
+	void flushMuxer();
+	void finishSegment(std::int64_t endPts);
+	double secondsBetween(std::int64_t from, std::int64_t to) const;
+
+	StreamOutputConfig config_;
+	HlsOptions options_;
+	std::shared_ptr<HlsSegmentStore> store_;
+
+	std::mutex mutex_;
+	bool started_{false};
+
+	AVFormatContext* formatCtx_{nullptr};
+	AVStream* videoStream_{nullptr};
+	std::shared_ptr<const EncodedStream> stream_;
+	bool segmentOpen_{false};
+	bool partIndependent_{false};
+	bool discontinuity_{false};
+	std::int64_t segmentStartPts_{0};
+	std::int64_t partStartPts_{0};
+	std::int64_t lastPts_{0};
+};
+
+}
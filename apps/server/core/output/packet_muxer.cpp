@@ -0,0 +1,148 @@
+#include <iostream>
+
+#include "core/output/packet_muxer.hpp"
+
+namespace SnowOwl::Server::Core {
+
+PacketMuxer::PacketMuxer(std::string name, std::string format, StreamOutputConfig config)
+	: name_(std::move(name))
+	, format_(std::move(format))
+	, config_(std::move(config))
+{
+	if (auto it = config_.parameters.find("url"); it != config_.parameters.end()) {
+		url_ = it->second;
+	}
+}
+
+PacketMuxer::~PacketMuxer() {
+	stop();
+}
+
+bool PacketMuxer::start() {
+	if (started_.load()) {
+		return true;
+	}
+
+	if (url_.empty()) {
+		std::cerr << name_ << ": missing url in configuration" << std::endl;
+		return false;
+	}
+
+	static std::once_flag networkInitFlag;
+	std::call_once(networkInitFlag, []() {
+		avformat_network_init();
+	});
+
+	started_ = true;
+	return true;
+}
+
+void PacketMuxer::stop() {
+	if (!started_.exchange(false)) {
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	closeOutput();
+}
+
+void PacketMuxer::publishPacket(EncodedPacket& packet) {
+	if (!started_.load() || !packet.valid() || !packet.stream) {
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex_);
+
+	if (formatCtx_ && packet.stream != stream_) {
+		// Encoder was reopened, e.g. for a new resolution
+		closeOutput();
+	}
+
+	if (!formatCtx_) {
+		if (!packet.keyframe()) {
+			return;
+		}
+		if (!openOutput(packet)) {
+			return;
+		}
+	}
+
+	AVPacket* pkt = packet.packet;
+	if (pkt->pts != AV_NOPTS_VALUE) {
+		pkt->pts -= startPts_;
+	}
+	if (pkt->dts != AV_NOPTS_VALUE) {
+		pkt->dts -= startPts_;
+	}
+	av_packet_rescale_ts(pkt, stream_->timeBase, videoStream_->time_base);
+	pkt->stream_index = videoStream_->index;
+
+	// Takes over the packet's reference; only this muxer's ref is released
+	if (av_interleaved_write_frame(formatCtx_, pkt) < 0) {
+		std::cerr << name_ << ": failed to write packet to " << url_ << ", reconnecting on next keyframe" << std::endl;
+		closeOutput();
+	}
+}
+
+bool PacketMuxer::openOutput(const EncodedPacket& first) {
+	AVFormatContext* formatCtx = nullptr;
+	if (avformat_alloc_output_context2(&formatCtx, nullptr, format_.c_str(), url_.c_str()) < 0 || !formatCtx) {
+		std::cerr << name_ << ": failed to allocate output context" << std::endl;
+		return false;
+	}
+
+	AVStream* stream = avformat_new_stream(formatCtx, nullptr);
+	if (!stream || avcodec_parameters_copy(stream->codecpar, first.stream->parameters) < 0) {
+		std::cerr << name_ << ": failed to create stream" << std::endl;
+		avformat_free_context(formatCtx);
+		return false;
+	}
+	stream->codecpar->codec_tag = 0;
+	stream->time_base = first.stream->timeBase;
+	stream->avg_frame_rate = first.stream->frameRate;
+
+	if (!(formatCtx->oformat->flags & AVFMT_NOFILE)) {
+		if (avio_open(&formatCtx->pb, url_.c_str(), AVIO_FLAG_WRITE) < 0) {
+			std::cerr << name_ << ": failed to open url " << url_ << std::endl;
+			avformat_free_context(formatCtx);
+			return false;
+		}
+	}
+
+	AVDictionary* options = nullptr;
+	headerOptions(&options);
+	const int ret = avformat_write_header(formatCtx, &options);
+	av_dict_free(&options);
+	if (ret < 0) {
+		std::cerr << name_ << ": failed to write stream header" << std::endl;
+		if (formatCtx->pb) {
+			avio_closep(&formatCtx->pb);
+		}
+		avformat_free_context(formatCtx);
+		return false;
+	}
+
+	formatCtx_ = formatCtx;
+	videoStream_ = stream;
+	stream_ = first.stream;
+	startPts_ = first.packet->dts != AV_NOPTS_VALUE ? first.packet->dts : first.packet->pts;
+	return true;
+}
+
+void PacketMuxer::closeOutput() {
+	if (!formatCtx_) {
+		return;
+	}
+
+	av_write_trailer(formatCtx_);
+	if (!(formatCtx_->oformat->flags & AVFMT_NOFILE) && formatCtx_->pb) {
+		avio_closep(&formatCtx_->pb);
+	}
+	avformat_free_context(formatCtx_);
+	formatCtx_ = nullptr;
+	videoStream_ = nullptr;
+	stream_.reset();
+	startPts_ = 0;
+}
+
+}
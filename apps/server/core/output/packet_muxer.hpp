@@ -0,0 +1,60 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+#include "core/output/video_encoder.hpp"
+#include "core/streams/stream_dispatcher.hpp"
+
+namespace SnowOwl::Server::Core {
+
+// Muxer-only output: writes packets from the shared VideoEncoder to a
+// container/transport and never touches raw frames. The header is written
+// on the first keyframe, and again after the encoder was reopened or a
+// write failed, so late joiners and reconnects start on a decodable frame.
+class PacketMuxer : public StreamOutput {
+public:
+	PacketMuxer(std::string name, std::string format, StreamOutputConfig config);
+	~PacketMuxer() override;
+
+	bool start() override;
+	void stop() override;
+	void publishFrame(const cv::Mat&) override {}
+	void publishEvents(const std::vector<Detection::DetectionResult>&) override {}
+
+	bool consumesPackets() const override { return true; }
+	void publishPacket(EncodedPacket& packet) override;
+
+protected:
+	// Format specific options handed to avformat_write_header
+	virtual void headerOptions(AVDictionary** options) const { (void)options; }
+
+	const StreamOutputConfig& config() const { return config_; }
+	const std::string& url() const { return url_; }
+
+private:
+	bool openOutput(const EncodedPacket& first);
+	void closeOutput();
+
+	std::string name_;
+	std::string format_;
+	StreamOutputConfig config_;
+	std::string url_;
+
+	std::mutex mutex_;
+	std::atomic<bool> started_{false};
+
+	AVFormatContext* formatCtx_{nullptr};
+	AVStream* videoStream_{nullptr};
+	std::shared_ptr<const EncodedStream> stream_;
+	std::int64_t startPts_{0};
+};
+
+}
@@ -0,0 +1,192 @@
+#include <algorithm>
+#include <iostream>
+#include <iterator>
+#include <vector>
+
+extern "C" {
+#include <libavutil/mem.h>
+}
+
+#include "core/output/sample_packetizer.hpp"
+
+namespace SnowOwl::Server::Core {
+
+namespace {
+
+// GStreamer timestamps are nanoseconds
+constexpr AVRational kGstTimeBase{1, 1000000000};
+
+struct MappedBuffer {
+	GstBuffer* buffer{nullptr};
+	GstMapInfo info{};
+};
+
+void releaseMappedBuffer(void* opaque, std::uint8_t*) {
+	auto* mapped = static_cast<MappedBuffer*>(opaque);
+	gst_buffer_unmap(mapped->buffer, &mapped->info);
+	gst_buffer_unref(mapped->buffer);
+	delete mapped;
+}
+
+// Copies the SPS and PPS NAL units of an Annex B access unit, start codes
+// included; muxers convert that to avcC where they need it
+std::vector<std::uint8_t> parameterSets(const std::uint8_t* data, std::size_t size) {
+	std::vector<std::size_t> starts;
+	for (std::size_t i = 0; i + 3 <= size;) {
+		if (data[i] == 0 && data[i + 1] == 0 && data[i + 2] == 1) {
+			starts.push_back(i + 3);
+			i += 3;
+		} else {
+			++i;
+		}
+	}
+
+	static constexpr std::uint8_t kStartCode[] = {0, 0, 0, 1};
+	std::vector<std::uint8_t> sets;
+	for (std::size_t k = 0; k < starts.size(); ++k) {
+		const std::size_t begin = starts[k];
+		std::size_t end = k + 1 < starts.size() ? starts[k + 1] - 3 : size;
+		// NAL units never end in a zero byte, so these belong to the next start code
+		while (end > begin && data[end - 1] == 0) {
+			--end;
+		}
+		if (begin >= end) {
+			continue;
+		}
+
+		const int type = data[begin] & 0x1f;
+		if (type == 7 || type == 8) {
+			sets.insert(sets.end(), std::begin(kStartCode), std::end(kStartCode));
+			sets.insert(sets.end(), data + begin, data + end);
+		}
+	}
+	return sets;
+}
+
+}
+
+SamplePacketizer::SamplePacketizer()
+	: packet_(av_packet_alloc())
+{
+}
+
+SamplePacketizer::~SamplePacketizer() {
+	if (packet_) {
+		av_packet_free(&packet_);
+	}
+}
+
+void SamplePacketizer::reset() {
+	stream_.reset();
+	width_ = 0;
+	height_ = 0;
+}
+
+bool SamplePacketizer::updateStream(GstCaps* caps, const std::uint8_t* data, std::size_t size) {
+	int width = 0;
+	int height = 0;
+	int fpsNumerator = 0;
+	int fpsDenominator = 1;
+	if (caps && gst_caps_get_size(caps) > 0) {
+		const GstStructure* structure = gst_caps_get_structure(caps, 0);
+		gst_structure_get_int(structure, "width", &width);
+		gst_structure_get_int(structure, "height", &height);
+		gst_structure_get_fraction(structure, "framerate", &fpsNumerator, &fpsDenominator);
+	}
+
+	const auto sets = parameterSets(data, size);
+	if (sets.empty()) {
+		std::cerr << "SamplePacketizer: keyframe without SPS/PPS, waiting for the next one" << std::endl;
+		return false;
+	}
+
+	auto stream = std::make_shared<EncodedStream>();
+	stream->parameters = avcodec_parameters_alloc();
+	if (!stream->parameters) {
+		return false;
+	}
+
+	AVCodecParameters* parameters = stream->parameters;
+	parameters->codec_type = AVMEDIA_TYPE_VIDEO;
+	parameters->codec_id = AV_CODEC_ID_H264;
+	parameters->width = width;
+	parameters->height = height;
+	parameters->extradata = static_cast<std::uint8_t*>(av_mallocz(sets.size() + AV_INPUT_BUFFER_PADDING_SIZE));
+	if (!parameters->extradata) {
+		return false;
+	}
+	std::copy(sets.begin(), sets.end(), parameters->extradata);
+	parameters->extradata_size = static_cast<int>(sets.size());
+
+	stream->timeBase = kGstTimeBase;
+	if (fpsNumerator > 0 && fpsDenominator > 0) {
+		stream->frameRate = AVRational{fpsNumerator, fpsDenominator};
+	}
+
+	stream_ = std::move(stream);
+	width_ = width;
+	height_ = height;
+	return true;
+}
+
+bool SamplePacketizer::packetize(GstSample* sample, const VideoEncoder::PacketHandler& handler) {
+	if (!sample || !packet_) {
+		return false;
+	}
+
+	GstBuffer* buffer = gst_sample_get_buffer(sample);
+	if (!buffer) {
+		return false;
+	}
+
+	auto* mapped = new MappedBuffer{gst_buffer_ref(buffer), {}};
+	if (!gst_buffer_map(mapped->buffer, &mapped->info, GST_MAP_READ)) {
+		gst_buffer_unref(mapped->buffer);
+		delete mapped;
+		return false;
+	}
+
+	const bool keyframe = !GST_BUFFER_FLAG_IS_SET(buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+	if (keyframe) {
+		// New parameter sets, e.g. after a camera resolution change, start a new stream
+		GstCaps* caps = gst_sample_get_caps(sample);
+		int width = 0;
+		int height = 0;
+		if (caps && gst_caps_get_size(caps) > 0) {
+			const GstStructure* structure = gst_caps_get_structure(caps, 0);
+			gst_structure_get_int(structure, "width", &width);
+			gst_structure_get_int(structure, "height", &height);
+		}
+		if (!stream_ || width != width_ || height != height_) {
+			updateStream(caps, mapped->info.data, mapped->info.size);
+		}
+	}
+
+	if (!stream_) {
+		releaseMappedBuffer(mapped, nullptr);
+		return false;
+	}
+
+	AVBufferRef* ref = av_buffer_create(mapped->info.data, static_cast<int>(mapped->info.size),
+		&releaseMappedBuffer, mapped, AV_BUFFER_FLAG_READONLY);
+	if (!ref) {
+		releaseMappedBuffer(mapped, nullptr);
+		return false;
+	}
+
+	av_packet_unref(packet_);
+	packet_->buf = ref;
+	packet_->data = ref->data;
+	packet_->size = ref->size;
+	packet_->flags = keyframe ? AV_PKT_FLAG_KEY : 0;
+	packet_->pts = GST_BUFFER_PTS_IS_VALID(buffer) ? static_cast<std::int64_t>(GST_BUFFER_PTS(buffer)) : AV_NOPTS_VALUE;
+	packet_->dts = GST_BUFFER_DTS_IS_VALID(buffer) ? static_cast<std::int64_t>(GST_BUFFER_DTS(buffer)) : packet_->pts;
+
+	if (handler) {
+		handler(packet_, stream_);
+	}
+	av_packet_unref(packet_);
+	return true;
+}
+
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include <gst/gst.h>
+
+#include "core/output/video_encoder.hpp"
+
+namespace SnowOwl::Server::Core {
+
+// Turns H.264 access units from a capture's encoded appsink into AVPackets
+// for the muxers without copying: each packet's buffer keeps the GstBuffer
+// mapped and referenced until the last muxer lets go of it. Expects
+// byte-stream samples with SPS/PPS on keyframes, as VideoCapture produces.
+class SamplePacketizer {
+public:
+	SamplePacketizer();
+	~SamplePacketizer();
+
+	SamplePacketizer(const SamplePacketizer&) = delete;
+	SamplePacketizer& operator=(const SamplePacketizer&) = delete;
+
+	// The sample is borrowed. Returns false for samples that cannot be
+	// described yet, i.e. anything before the first keyframe.
+	bool packetize(GstSample* sample, const VideoEncoder::PacketHandler& handler);
+	void reset();
+
+private:
+	bool updateStream(GstCaps* caps, const std::uint8_t* data, std::size_t size);
+
+	AVPacket* packet_{nullptr};
+	std::shared_ptr<const EncodedStream> stream_;
+	int width_{0};
+	int height_{0};
+};
+
+}
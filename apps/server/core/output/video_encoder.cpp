@@ -0,0 +1,235 @@
+#include <iostream>
+#include <string>
+#include <opencv2/imgproc.hpp>
+
+extern "C" {
+#include <libavutil/opt.h>
+}
+
+#include "core/output/video_encoder.hpp"
+
+namespace SnowOwl::Server::Core {
+
+namespace {
+
+int intParameter(const StreamOutputConfig& config, const char* key, int fallback) {
+	const auto it = config.parameters.find(key);
+	if (it == config.parameters.end()) {
+		return fallback;
+	}
+
+	try {
+		const int value = std::stoi(it->second);
+		return value > 0 ? value : fallback;
+	} catch (const std::exception&) {
+		std::cerr << "VideoEncoder: invalid " << key << ": " << it->second << std::endl;
+		return fallback;
+	}
+}
+
+}
+
+EncodedStream::~EncodedStream() {
+	if (parameters) {
+		avcodec_parameters_free(&parameters);
+	}
+}
+
+EncodedPacket::EncodedPacket(const AVPacket* source, std::shared_ptr<const EncodedStream> encodedStream)
+	: stream(std::move(encodedStream))
+{
+	packet = av_packet_alloc();
+	if (packet && av_packet_ref(packet, source) < 0) {
+		av_packet_free(&packet);
+	}
+}
+
+EncodedPacket::~EncodedPacket() {
+	if (packet) {
+		av_packet_free(&packet);
+	}
+}
+
+EncodedPacket::EncodedPacket(EncodedPacket&& other) noexcept
+	: stream(std::move(other.stream))
+	, packet(other.packet)
+{
+	other.packet = nullptr;
+}
+
+EncodedPacket& EncodedPacket::operator=(EncodedPacket&& other) noexcept {
+	if (this != &other) {
+		if (packet) {
+			av_packet_free(&packet);
+		}
+		stream = std::move(other.stream);
+		packet = other.packet;
+		other.packet = nullptr;
+	}
+	return *this;
+}
+
+VideoEncoder::VideoEncoder(const StreamOutputConfig& config)
+	: bitrateKbps_(intParameter(config, "bitrate_kbps", 2500))
+	, gop_(intParameter(config, "gop", 60))
+	, fps_(intParameter(config, "fps", 30))
+{
+	if (auto it = config.parameters.find("preset"); it != config.parameters.end() && !it->second.empty()) {
+		preset_ = it->second;
+	}
+}
+
+VideoEncoder::~VideoEncoder() {
+	close();
+}
+
+bool VideoEncoder::open(int width, int height) {
+	close();
+
+	const AVCodec* codec = avcodec_find_encoder(AV_CODEC_ID_H264);
+	if (!codec) {
+		std::cerr << "VideoEncoder: H264 encoder not found" << std::endl;
+		return false;
+	}
+
+	codecCtx_ = avcodec_alloc_context3(codec);
+	if (!codecCtx_) {
+		std::cerr << "VideoEncoder: failed to allocate codec context" << std::endl;
+		return false;
+	}
+
+	codecCtx_->codec_id = AV_CODEC_ID_H264;
+	codecCtx_->width = width;
+	codecCtx_->height = height;
+	codecCtx_->pix_fmt = AV_PIX_FMT_YUV420P;
+	codecCtx_->time_base = AVRational{1, fps_};
+	codecCtx_->framerate = AVRational{fps_, 1};
+	codecCtx_->gop_size = gop_;
+	codecCtx_->max_b_frames = 0;
+	codecCtx_->bit_rate = static_cast<long long>(bitrateKbps_) * 1000LL;
+	// FLV and RTSP both take SPS/PPS from extradata rather than the bitstream
+	codecCtx_->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+
+	av_opt_set(codecCtx_->priv_data, "preset", preset_.c_str(), 0);
+	av_opt_set(codecCtx_->priv_data, "tune", "zerolatency", 0);
+
+	if (avcodec_open2(codecCtx_, codec, nullptr) < 0) {
+		std::cerr << "VideoEncoder: failed to open codec" << std::endl;
+		close();
+		return false;
+	}
+
+	swsCtx_ = sws_getContext(width, height, AV_PIX_FMT_BGR24,
+			width, height, AV_PIX_FMT_YUV420P,
+			SWS_BILINEAR, nullptr, nullptr, nullptr);
+	frame_ = av_frame_alloc();
+	packet_ = av_packet_alloc();
+	if (!swsCtx_ || !frame_ || !packet_) {
+		std::cerr << "VideoEncoder: failed to allocate conversion buffers" << std::endl;
+		close();
+		return false;
+	}
+
+	frame_->format = codecCtx_->pix_fmt;
+	frame_->width = width;
+	frame_->height = height;
+	if (av_frame_get_buffer(frame_, 32) < 0) {
+		std::cerr << "VideoEncoder: failed to allocate frame buffer" << std::endl;
+		close();
+		return false;
+	}
+
+	auto stream = std::make_shared<EncodedStream>();
+	stream->parameters = avcodec_parameters_alloc();
+	if (!stream->parameters || avcodec_parameters_from_context(stream->parameters, codecCtx_) < 0) {
+		std::cerr << "VideoEncoder: failed to derive codec parameters" << std::endl;
+		close();
+		return false;
+	}
+	stream->timeBase = codecCtx_->time_base;
+	stream->frameRate = codecCtx_->framerate;
+	stream_ = std::move(stream);
+
+	pts_ = 0;
+	return true;
+}
+
+void VideoEncoder::close() {
+	if (codecCtx_) {
+		avcodec_free_context(&codecCtx_);
+	}
+	if (swsCtx_) {
+		sws_freeContext(swsCtx_);
+		swsCtx_ = nullptr;
+	}
+	if (frame_) {
+		av_frame_free(&frame_);
+	}
+	if (packet_) {
+		av_packet_free(&packet_);
+	}
+	stream_.reset();
+}
+
+bool VideoEncoder::encode(const cv::Mat& bgrFrame, const PacketHandler& handler) {
+	if (bgrFrame.empty()) {
+		return false;
+	}
+
+	const cv::Mat* source = &bgrFrame;
+	if (bgrFrame.type() != CV_8UC3) {
+		if (bgrFrame.type() == CV_8UC4) {
+			cv::cvtColor(bgrFrame, converted_, cv::COLOR_BGRA2BGR);
+		} else if (bgrFrame.type() == CV_8UC1) {
+			cv::cvtColor(bgrFrame, converted_, cv::COLOR_GRAY2BGR);
+		} else {
+			std::cerr << "VideoEncoder: unsupported frame format" << std::endl;
+			return false;
+		}
+		source = &converted_;
+	}
+
+	if (!codecCtx_ || codecCtx_->width != source->cols || codecCtx_->height != source->rows) {
+		if (!open(source->cols, source->rows)) {
+			return false;
+		}
+	}
+
+	if (av_frame_make_writable(frame_) < 0) {
+		std::cerr << "VideoEncoder: frame buffer not writable" << std::endl;
+		return false;
+	}
+
+	// sws_scale honours the row stride, so strided frame views need no copy
+	const uint8_t* srcSlice[1] = { source->data };
+	const int srcStride[1] = { static_cast<int>(source->step[0]) };
+	sws_scale(swsCtx_, srcSlice, srcStride, 0, codecCtx_->height, frame_->data, frame_->linesize);
+
+	frame_->pts = pts_++;
+
+	if (avcodec_send_frame(codecCtx_, frame_) < 0) {
+		std::cerr << "VideoEncoder: failed to send frame to encoder" << std::endl;
+		return false;
+	}
+
+	return receivePackets(handler);
+}
+
+bool VideoEncoder::receivePackets(const PacketHandler& handler) {
+	while (true) {
+		const int ret = avcodec_receive_packet(codecCtx_, packet_);
+		if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+			return true;
+		} else if (ret < 0) {
+			std::cerr << "VideoEncoder: failed to receive packet from encoder" << std::endl;
+			return false;
+		}
+
+		if (handler) {
+			handler(packet_, stream_);
+		}
+		av_packet_unref(packet_);
+	}
+}
+
+}
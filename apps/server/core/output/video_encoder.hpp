@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include <opencv2/core.hpp>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libswscale/swscale.h>
+}
+
+#include "core/streams/stream_dispatcher.hpp"
+
+namespace SnowOwl::Server::Core {
+
+// Codec parameters of one encoder session. Muxers compare the pointer to
+// notice that the encoder was reopened and their header is stale.
+struct EncodedStream {
+	AVCodecParameters* parameters{nullptr};
+	AVRational timeBase{1, 30};
+	AVRational frameRate{30, 1};
+
+	EncodedStream() = default;
+	~EncodedStream();
+	EncodedStream(const EncodedStream&) = delete;
+	EncodedStream& operator=(const EncodedStream&) = delete;
+};
+
+// One consumer's reference to an encoded packet. The payload buffer is
+// shared through av_packet_ref, so the consumer may rescale or write it
+// without affecting anybody else.
+struct EncodedPacket {
+	std::shared_ptr<const EncodedStream> stream;
+	AVPacket* packet{nullptr};
+
+	EncodedPacket() = default;
+	EncodedPacket(const AVPacket* source, std::shared_ptr<const EncodedStream> encodedStream);
+	~EncodedPacket();
+	EncodedPacket(EncodedPacket&& other) noexcept;
+	EncodedPacket& operator=(EncodedPacket&& other) noexcept;
+	EncodedPacket(const EncodedPacket&) = delete;
+	EncodedPacket& operator=(const EncodedPacket&) = delete;
+
+	bool valid() const { return packet != nullptr; }
+	bool keyframe() const { return packet && (packet->flags & AV_PKT_FLAG_KEY); }
+};
+
+// BGR to YUV conversion plus H.264 encoding, done once per frame no matter
+// how many outputs consume the result. Reopens itself when the frame size
+// changes. Parameters: "bitrate_kbps", "gop", "fps", "preset".
+class VideoEncoder {
+public:
+	using PacketHandler = std::function<void(const AVPacket* packet, const std::shared_ptr<const EncodedStream>& stream)>;
+
+	explicit VideoEncoder(const StreamOutputConfig& config);
+	~VideoEncoder();
+
+	VideoEncoder(const VideoEncoder&) = delete;
+	VideoEncoder& operator=(const VideoEncoder&) = delete;
+
+	bool encode(const cv::Mat& bgrFrame, const PacketHandler& handler);
+	void close();
+
+private:
+	bool open(int width, int height);
+	bool receivePackets(const PacketHandler& handler);
+
+	int bitrateKbps_{2500};
+	int gop_{60};
+	int fps_{30};
+	std::string preset_{"veryfast"};
+
+	AVCodecContext* codecCtx_{nullptr};
+	SwsContext* swsCtx_{nullptr};
+	AVFrame* frame_{nullptr};
+	AVPacket* packet_{nullptr};
+	std::shared_ptr<const EncodedStream> stream_;
+	cv::Mat converted_;
+
+	std::int64_t pts_{0};
+};
+
+}
@@ -0,0 +1,309 @@
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <unordered_map>
+
+extern "C" {
+#include <libavutil/mem.h>
+}
+
+#include "core/output/websocket_video_output.hpp"
+
+namespace SnowOwl::Server::Core {
+
+namespace {
+
+constexpr int kAvioBufferSize = 64 * 1024;
+
+std::mutex g_channelMutex;
+std::unordered_map<std::string, std::weak_ptr<LiveVideoChannel>> g_channels;
+
+#if LIBAVFORMAT_VERSION_MAJOR >= 61
+int writeToOutput(void* opaque, const std::uint8_t* data, int size)
+#else
+int writeToOutput(void* opaque, std::uint8_t* data, int size)
+#endif
+{
+	static_cast<WebsocketVideoOutput*>(opaque)->appendOutput(data, static_cast<std::size_t>(size));
+	return size;
+}
+
+// RFC 6381 codec string from the SPS, either in avcC or Annex-B extradata
+std::string codecString(const AVCodecParameters* parameters) {
+	const std::uint8_t* sps = nullptr;
+	const std::uint8_t* data = parameters ? parameters->extradata : nullptr;
+	const int size = parameters ? parameters->extradata_size : 0;
+
+	if (data && size >= 4 && data[0] == 1) {
+		sps = data + 1;
+	} else if (data) {
+		for (int i = 0; i + 6 < size; ++i) {
+			if (data[i] == 0 && data[i + 1] == 0 && data[i + 2] == 1 && (data[i + 3] & 0x1f) == 7) {
+				sps = data + i + 4;
+				break;
+			}
+		}
+	}
+
+	char buffer[16];
+	if (sps) {
+		std::snprintf(buffer, sizeof(buffer), "avc1.%02X%02X%02X", sps[0], sps[1], sps[2]);
+	} else {
+		std::snprintf(buffer, sizeof(buffer), "avc1.42E01F");
+	}
+	return buffer;
+}
+
+}
+
+LiveVideoChannel::LiveVideoChannel(std::string name)
+	: name_(std::move(name))
+{
+}
+
+std::shared_ptr<LiveVideoChannel> LiveVideoChannel::acquire(const std::string& name) {
+	std::lock_guard<std::mutex> lock(g_channelMutex);
+	auto& entry = g_channels[name];
+	auto channel = entry.lock();
+	if (!channel) {
+		channel = std::make_shared<LiveVideoChannel>(name);
+		entry = channel;
+	}
+	return channel;
+}
+
+void LiveVideoChannel::subscribe(const std::shared_ptr<VideoFragmentSink>& sink) {
+	std::string mimeType;
+	std::shared_ptr<const std::string> initSegment;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		sinks_.push_back(sink);
+		mimeType = mimeType_;
+		initSegment = initSegment_;
+	}
+
+	if (initSegment) {
+		sink->onVideoInit(name_, mimeType, std::move(initSegment));
+	}
+}
+
+void LiveVideoChannel::unsubscribe(const VideoFragmentSink* sink) {
+	std::lock_guard<std::mutex> lock(mutex_);
+	sinks_.erase(std::remove_if(sinks_.begin(), sinks_.end(), [sink](const std::weak_ptr<VideoFragmentSink>& entry) {
+		auto current = entry.lock();
+		return !current || current.get() == sink;
+	}), sinks_.end());
+}
+
+std::vector<std::shared_ptr<VideoFragmentSink>> LiveVideoChannel::liveSinks() {
+	std::vector<std::shared_ptr<VideoFragmentSink>> sinks;
+	sinks.reserve(sinks_.size());
+	for (auto it = sinks_.begin(); it != sinks_.end();) {
+		if (auto sink = it->lock()) {
+			sinks.push_back(std::move(sink));
+			++it;
+		} else {
+			it = sinks_.erase(it);
+		}
+	}
+	return sinks;
+}
+
+void LiveVideoChannel::publishInit(std::string mimeType, std::string initSegment) {
+	auto segment = std::make_shared<const std::string>(std::move(initSegment));
+	std::vector<std::shared_ptr<VideoFragmentSink>> sinks;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		mimeType_ = std::move(mimeType);
+		initSegment_ = segment;
+		sinks = liveSinks();
+		mimeType = mimeType_;
+	}
+
+	for (const auto& sink : sinks) {
+		sink->onVideoInit(name_, mimeType, segment);
+	}
+}
+
+void LiveVideoChannel::publishFragment(std::string fragment, bool keyframe) {
+	auto shared = std::make_shared<const std::string>(std::move(fragment));
+	std::vector<std::shared_ptr<VideoFragmentSink>> sinks;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		sinks = liveSinks();
+	}
+
+	for (const auto& sink : sinks) {
+		sink->onVideoFragment(name_, shared, keyframe);
+	}
+}
+
+void LiveVideoChannel::reset() {
+	std::lock_guard<std::mutex> lock(mutex_);
+	mimeType_.clear();
+	initSegment_.reset();
+}
+
+WebsocketVideoOutput::WebsocketVideoOutput(StreamOutputConfig config)
+	: config_(std::move(config))
+{
+	if (auto it = config_.parameters.find("channel"); it != config_.parameters.end() && !it->second.empty()) {
+		channelName_ = it->second;
+	}
+}
+
+WebsocketVideoOutput::~WebsocketVideoOutput() {
+	stop();
+}
+
+bool WebsocketVideoOutput::start() {
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (started_) {
+		return true;
+	}
+
+	channel_ = LiveVideoChannel::acquire(channelName_);
+	started_ = true;
+	return true;
+}
+
+void WebsocketVideoOutput::stop() {
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (!started_) {
+		return;
+	}
+
+	closeMuxer();
+	channel_->reset();
+	channel_.reset();
+	started_ = false;
+}
+
+void WebsocketVideoOutput::appendOutput(const std::uint8_t* data, std::size_t size) {
+	pending_.append(reinterpret_cast<const char*>(data), size);
+}
+
+void WebsocketVideoOutput::publishPacket(EncodedPacket& packet) {
+	if (!packet.valid() || !packet.stream) {
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex_);
+	if (!started_) {
+		return;
+	}
+
+	if (formatCtx_ && packet.stream != stream_) {
+		closeMuxer();
+	}
+
+	if (!formatCtx_) {
+		// Clients join on the init segment, so it must precede a keyframe
+		if (!packet.keyframe() || !openMuxer(packet)) {
+			return;
+		}
+	}
+
+	AVPacket* pkt = packet.packet;
+	if (pkt->duration <= 0) {
+		pkt->duration = av_rescale_q(1, av_inv_q(stream_->frameRate), stream_->timeBase);
+	}
+	if (pkt->pts != AV_NOPTS_VALUE) {
+		pkt->pts -= startPts_;
+	}
+	if (pkt->dts != AV_NOPTS_VALUE) {
+		pkt->dts -= startPts_;
+	}
+	av_packet_rescale_ts(pkt, stream_->timeBase, videoStream_->time_base);
+	pkt->stream_index = videoStream_->index;
+
+	const bool keyframe = packet.keyframe();
+	if (av_write_frame(formatCtx_, pkt) < 0) {
+		std::cerr << "WebsocketVideoOutput: failed to mux packet for " << channelName_ << std::endl;
+		closeMuxer();
+		return;
+	}
+
+	// frag_custom: a null packet closes the fragment holding this access unit
+	av_write_frame(formatCtx_, nullptr);
+	avio_flush(formatCtx_->pb);
+	if (!pending_.empty()) {
+		channel_->publishFragment(std::move(pending_), keyframe);
+		pending_.clear();
+	}
+}
+
+bool WebsocketVideoOutput::openMuxer(const EncodedPacket& first) {
+	AVFormatContext* formatCtx = nullptr;
+	if (avformat_alloc_output_context2(&formatCtx, nullptr, "mp4", nullptr) < 0 || !formatCtx) {
+		std::cerr << "WebsocketVideoOutput: failed to allocate output context" << std::endl;
+		return false;
+	}
+
+	AVStream* stream = avformat_new_stream(formatCtx, nullptr);
+	if (!stream || avcodec_parameters_copy(stream->codecpar, first.stream->parameters) < 0) {
+		std::cerr << "WebsocketVideoOutput: failed to create stream" << std::endl;
+		avformat_free_context(formatCtx);
+		return false;
+	}
+	stream->codecpar->codec_tag = 0;
+	stream->time_base = AVRational{1, 90000};
+	stream->avg_frame_rate = first.stream->frameRate;
+
+	auto* buffer = static_cast<unsigned char*>(av_malloc(kAvioBufferSize));
+	AVIOContext* io = buffer
+		? avio_alloc_context(buffer, kAvioBufferSize, 1, this, nullptr, &writeToOutput, nullptr)
+		: nullptr;
+	if (!io) {
+		std::cerr << "WebsocketVideoOutput: failed to allocate memory io" << std::endl;
+		av_free(buffer);
+		avformat_free_context(formatCtx);
+		return false;
+	}
+	formatCtx->pb = io;
+	formatCtx->flags |= AVFMT_FLAG_CUSTOM_IO;
+
+	AVDictionary* options = nullptr;
+	av_dict_set(&options, "movflags", "empty_moov+default_base_moof+frag_custom", 0);
+	pending_.clear();
+	const int ret = avformat_write_header(formatCtx, &options);
+	av_dict_free(&options);
+	if (ret < 0) {
+		std::cerr << "WebsocketVideoOutput: failed to write init segment" << std::endl;
+		av_freep(&io->buffer);
+		avio_context_free(&io);
+		avformat_free_context(formatCtx);
+		pending_.clear();
+		return false;
+	}
+	avio_flush(io);
+
+	formatCtx_ = formatCtx;
+	videoStream_ = stream;
+	stream_ = first.stream;
+	startPts_ = first.packet->dts != AV_NOPTS_VALUE ? first.packet->dts : first.packet->pts;
+
+	channel_->publishInit("video/mp4; codecs=\"" + codecString(first.stream->parameters) + "\"", std::move(pending_));
+	pending_.clear();
+	return true;
+}
+
+void WebsocketVideoOutput::closeMuxer() {
+	if (!formatCtx_) {
+		return;
+	}
+
+	av_write_trailer(formatCtx_);
+	if (formatCtx_->pb) {
+		av_freep(&formatCtx_->pb->buffer);
+		avio_context_free(&formatCtx_->pb);
+	}
+	avformat_free_context(formatCtx_);
+	formatCtx_ = nullptr;
+	videoStream_ = nullptr;
+	stream_.reset();
+	startPts_ = 0;
+	pending_.clear();
+}
+
+}
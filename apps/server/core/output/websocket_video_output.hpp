@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+#include "core/output/video_encoder.hpp"
+#include "core/streams/stream_dispatcher.hpp"
+
+namespace SnowOwl::Server::Core {
+
+// Receiver of one live video channel. Called on the muxer's worker thread,
+// so implementations only hand the shared buffers over to their own thread.
+class VideoFragmentSink {
+public:
+	virtual ~VideoFragmentSink() = default;
+	// Sent on subscribe and whenever the encoder restarts; everything that
+	// follows decodes against this init segment (ftyp + moov)
+	virtual void onVideoInit(const std::string& channel, const std::string& mimeType,
+		std::shared_ptr<const std::string> initSegment) = 0;
+	// One moof + mdat pair holding a single access unit
+	virtual void onVideoFragment(const std::string& channel, std::shared_ptr<const std::string> fragment,
+		bool keyframe) = 0;
+};
+
+// Fan-out point between a WebsocketVideoOutput and the sessions watching
+// it. Channels are created on first use by either side, so clients may
+// subscribe before the stream starts.
+class LiveVideoChannel {
+public:
+	explicit LiveVideoChannel(std::string name);
+
+	static std::shared_ptr<LiveVideoChannel> acquire(const std::string& name);
+
+	const std::string& name() const { return name_; }
+
+	void subscribe(const std::shared_ptr<VideoFragmentSink>& sink);
+	void unsubscribe(const VideoFragmentSink* sink);
+
+	void publishInit(std::string mimeType, std::string initSegment);
+	void publishFragment(std::string fragment, bool keyframe);
+	void reset();
+
+private:
+	std::vector<std::shared_ptr<VideoFragmentSink>> liveSinks();
+
+	std::string name_;
+	std::mutex mutex_;
+	std::vector<std::weak_ptr<VideoFragmentSink>> sinks_;
+	std::string mimeType_;
+	std::shared_ptr<const std::string> initSegment_;
+};
+
+// Muxer-only output that repackages the shared encoder's packets as
+// fragmented MP4, one fragment per access unit, for browsers reading the
+// websocket server's binary video channel through Media Source Extensions.
+// Parameter "channel" names the channel; the server fills in the device id,
+// the channel start_streaming subscribes to by default ("live" otherwise).
+class WebsocketVideoOutput final : public StreamOutput {
+public:
+	explicit WebsocketVideoOutput(StreamOutputConfig config);
+	~WebsocketVideoOutput() override;
+
+	bool start() override;
+	void stop() override;
+	void publishFrame(const cv::Mat&) override {}
+	void publishEvents(const std::vector<Detection::DetectionResult>&) override {}
+
+	bool consumesPackets() const override { return true; }
+	void publishPacket(EncodedPacket& packet) override;
+
+	// Appended to by the muxer's custom AVIOContext
+	void appendOutput(const std::uint8_t* data, std::size_t size);
+
+private:
+	bool openMuxer(const EncodedPacket& first);
+	void closeMuxer();
+
+	StreamOutputConfig config_;
+	std::string channelName_{"live"};
+	std::shared_ptr<LiveVideoChannel> channel_;
+
+	std::mutex mutex_;
+	bool started_{false};
+
+	AVFormatContext* formatCtx_{nullptr};
+	AVStream* videoStream_{nullptr};
+	std::shared_ptr<const EncodedStream> stream_;
+	std::int64_t startPts_{0};
+	std::string pending_;
+};
+
+}
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <string>
 
 namespace SnowOwl::Server::Core {
@@ -13,11 +15,58 @@ enum class CaptureSourceKind {
     Other
 };
 
+// What a bounded frame queue does when the producer outruns the consumer.
+enum class FrameDropPolicy {
+    DropOldest,   // evict the oldest queued frame to make room
+    DropNewest,   // reject the incoming frame
+    KeepLatest    // hold at most one frame, always the newest
+};
+
+struct CaptureQueueConfig {
+    std::size_t capacity{3};
+    FrameDropPolicy dropPolicy{FrameDropPolicy::DropOldest};
+};
+
+struct CaptureQueueStats {
+    std::size_t depth{0};
+    std::size_t capacity{0};
+    std::uint64_t enqueued{0};
+    std::uint64_t dropped{0};
+};
+
 struct CaptureSourceConfig {
     CaptureSourceKind kind{CaptureSourceKind::Camera};
+    int deviceId{-1};
     int cameraId{0};
     std::string primaryUri;
     std::string secondaryUri;
+    CaptureQueueConfig queue;
+    // Hand H.264 sources to the encoded sample callback without re-encoding
+    bool passthrough{true};
+    // Rate of decoded frames for detection; 0 keeps the capture rate
+    int detectionFps{0};
 };
 
+inline FrameDropPolicy frameDropPolicyFromString(const std::string& value) {
+    if (value == "drop_newest" || value == "drop-newest") {
+        return FrameDropPolicy::DropNewest;
+    }
+    if (value == "keep_latest" || value == "keep-latest" || value == "latest") {
+        return FrameDropPolicy::KeepLatest;
+    }
+    return FrameDropPolicy::DropOldest;
+}
+
+inline std::string toString(FrameDropPolicy policy) {
+    switch (policy) {
+        case FrameDropPolicy::DropOldest:
+            return "drop_oldest";
+        case FrameDropPolicy::DropNewest:
+            return "drop_newest";
+        case FrameDropPolicy::KeepLatest:
+            return "keep_latest";
+    }
+    return "drop_oldest";
+}
+
 }
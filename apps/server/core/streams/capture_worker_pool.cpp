@@ -0,0 +1,138 @@
+#include "core/streams/capture_worker_pool.hpp"
+
+#include <algorithm>
+#include <exception>
+#include <iostream>
+
+namespace SnowOwl::Server::Core {
+
+namespace {
+
+thread_local const CaptureWorkerPool* t_pool = nullptr;
+thread_local std::size_t t_workerIndex = 0;
+
+}
+
+CaptureWorkerPool::CaptureWorkerPool(std::size_t workerCount) {
+    if (workerCount == 0) {
+        workerCount = std::max(2u, std::thread::hardware_concurrency());
+    }
+
+    queues_.reserve(workerCount);
+    for (std::size_t i = 0; i < workerCount; ++i) {
+        queues_.push_back(std::make_unique<WorkerQueue>());
+    }
+
+    workers_.reserve(workerCount);
+    for (std::size_t i = 0; i < workerCount; ++i) {
+        workers_.emplace_back(&CaptureWorkerPool::workerLoop, this, i);
+    }
+}
+
+CaptureWorkerPool::~CaptureWorkerPool() {
+    stop();
+}
+
+CaptureWorkerPool& CaptureWorkerPool::shared() {
+    static CaptureWorkerPool pool;
+    return pool;
+}
+
+void CaptureWorkerPool::submit(Task task) {
+    if (!task) {
+        return;
+    }
+
+    const std::size_t index = t_pool == this
+        ? t_workerIndex
+        : nextQueue_.fetch_add(1, std::memory_order_relaxed) % queues_.size();
+
+    {
+        auto& queue = *queues_[index];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(std::move(task));
+        // Counted under the queue lock so takers never see it drop below zero
+        pending_.fetch_add(1);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex_);
+    }
+    sleepCv_.notify_one();
+}
+
+void CaptureWorkerPool::stop() {
+    if (!running_.exchange(false)) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex_);
+    }
+    sleepCv_.notify_all();
+
+    for (auto& worker : workers_) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+}
+
+void CaptureWorkerPool::workerLoop(std::size_t index) {
+    t_pool = this;
+    t_workerIndex = index;
+
+    Task task;
+    while (true) {
+        if (popLocal(index, task) || steal(index, task)) {
+            try {
+                task();
+            } catch (const std::exception& e) {
+                std::cerr << "CaptureWorkerPool: task failed: " << e.what() << std::endl;
+            }
+            task = nullptr;
+            continue;
+        }
+
+        // Queued work is still drained after stop() so owners waiting on it can finish
+        std::unique_lock<std::mutex> lock(sleepMutex_);
+        if (!running_.load() && pending_.load() == 0) {
+            break;
+        }
+        sleepCv_.wait(lock, [this] { return pending_.load() > 0 || !running_.load(); });
+    }
+
+    t_pool = nullptr;
+}
+
+bool CaptureWorkerPool::popLocal(std::size_t index, Task& task) {
+    auto& queue = *queues_[index];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty()) {
+        return false;
+    }
+
+    task = std::move(queue.tasks.front());
+    queue.tasks.pop_front();
+    pending_.fetch_sub(1);
+    return true;
+}
+
+bool CaptureWorkerPool::steal(std::size_t thief, Task& task) {
+    const std::size_t count = queues_.size();
+    for (std::size_t offset = 1; offset < count; ++offset) {
+        auto& queue = *queues_[(thief + offset) % count];
+        std::unique_lock<std::mutex> lock(queue.mutex, std::try_to_lock);
+        if (!lock.owns_lock() || queue.tasks.empty()) {
+            continue;
+        }
+
+        task = std::move(queue.tasks.front());
+        queue.tasks.pop_front();
+        pending_.fetch_sub(1);
+        return true;
+    }
+    return false;
+}
+
+}
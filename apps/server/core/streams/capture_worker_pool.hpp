@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace SnowOwl::Server::Core {
+
+// Fixed set of worker threads shared by every VideoCaptureManager.
+//
+// Each worker owns a FIFO deque. Tasks submitted from a worker thread land on
+// that worker's own deque, anything else is spread round-robin; a worker that
+// runs dry steals from the front of its siblings' deques before sleeping.
+// Capture managers keep at most one task in flight and requeue themselves
+// after every frame, so busy cameras take turns instead of starving quiet ones.
+class CaptureWorkerPool {
+public:
+    using Task = std::function<void()>;
+
+    explicit CaptureWorkerPool(std::size_t workerCount = 0);
+    ~CaptureWorkerPool();
+
+    CaptureWorkerPool(const CaptureWorkerPool&) = delete;
+    CaptureWorkerPool& operator=(const CaptureWorkerPool&) = delete;
+
+    // Process-wide pool sized to the available cores.
+    static CaptureWorkerPool& shared();
+
+    void submit(Task task);
+    void stop();
+
+    std::size_t workerCount() const { return queues_.size(); }
+    std::size_t pending() const { return pending_.load(); }
+
+private:
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void workerLoop(std::size_t index);
+    bool popLocal(std::size_t index, Task& task);
+    bool steal(std::size_t thief, Task& task);
+
+    std::vector<std::unique_ptr<WorkerQueue>> queues_;
+    std::vector<std::thread> workers_;
+
+    std::atomic<bool> running_{true};
+    std::atomic<std::size_t> pending_{0};
+    std::atomic<std::size_t> nextQueue_{0};
+
+    std::mutex sleepMutex_;
+    std::condition_variable sleepCv_;
+};
+
+}
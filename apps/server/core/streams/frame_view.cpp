@@ -0,0 +1,230 @@
+#include "core/streams/frame_view.hpp"
+
+#include <cstring>
+
+#include <opencv2/imgproc.hpp>
+
+namespace SnowOwl::Server::Core {
+
+namespace {
+
+struct MappedBuffer {
+    GstBuffer* buffer{nullptr};
+    GstMapInfo map{};
+};
+
+MappedBuffer* mapBuffer(GstBuffer* buffer) {
+    auto* mapped = new MappedBuffer;
+    mapped->buffer = gst_buffer_ref(buffer);
+    if (!gst_buffer_map(mapped->buffer, &mapped->map, GST_MAP_READ)) {
+        gst_buffer_unref(mapped->buffer);
+        delete mapped;
+        return nullptr;
+    }
+    return mapped;
+}
+
+void releaseBuffer(MappedBuffer* mapped) {
+    if (!mapped) {
+        return;
+    }
+    gst_buffer_unmap(mapped->buffer, &mapped->map);
+    gst_buffer_unref(mapped->buffer);
+    delete mapped;
+}
+
+// Owns the MappedBuffer stored in UMatData::userdata. OpenCV calls deallocate()
+// once both refcounts drop to zero, i.e. when the last Mat header is released.
+class GstBufferAllocator final : public cv::MatAllocator {
+public:
+    cv::UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step,
+                           cv::AccessFlag flags, cv::UMatUsageFlags usageFlags) const override {
+        // create() on a view with a different shape gets ordinary heap memory
+        return cv::Mat::getStdAllocator()->allocate(dims, sizes, type, data, step, flags, usageFlags);
+    }
+
+    bool allocate(cv::UMatData* data, cv::AccessFlag, cv::UMatUsageFlags) const override {
+        return data != nullptr;
+    }
+
+    void deallocate(cv::UMatData* data) const override {
+        if (!data) {
+            return;
+        }
+
+        CV_Assert(data->urefcount == 0);
+        CV_Assert(data->refcount == 0);
+
+        releaseBuffer(static_cast<MappedBuffer*>(data->userdata));
+        data->userdata = nullptr;
+        delete data;
+    }
+};
+
+const GstBufferAllocator* bufferAllocator() {
+    static const GstBufferAllocator allocator;
+    return &allocator;
+}
+
+cv::Mat wrapMapped(MappedBuffer* mapped, const GstVideoInfo& info) {
+    const int width = GST_VIDEO_INFO_WIDTH(&info);
+    const int height = GST_VIDEO_INFO_HEIGHT(&info);
+    const std::size_t stride = static_cast<std::size_t>(GST_VIDEO_INFO_PLANE_STRIDE(&info, 0));
+    auto* data = mapped->map.data + GST_VIDEO_INFO_PLANE_OFFSET(&info, 0);
+
+    cv::Mat frame(height, width, CV_8UC3, data, stride);
+
+    auto* u = new cv::UMatData(bufferAllocator());
+    u->data = u->origdata = data;
+    u->size = stride * static_cast<std::size_t>(height);
+    u->userdata = mapped;
+    u->refcount = 1;
+
+    frame.u = u;
+    frame.allocator = bufferAllocator();
+    return frame;
+}
+
+cv::Mat convertI420(const MappedBuffer& mapped, const GstVideoInfo& info) {
+    const int width = GST_VIDEO_INFO_WIDTH(&info);
+    const int height = GST_VIDEO_INFO_HEIGHT(&info);
+    const int strideY = GST_VIDEO_INFO_PLANE_STRIDE(&info, 0);
+    const int strideU = GST_VIDEO_INFO_PLANE_STRIDE(&info, 1);
+    const std::size_t offsetY = GST_VIDEO_INFO_PLANE_OFFSET(&info, 0);
+    const std::size_t offsetU = GST_VIDEO_INFO_PLANE_OFFSET(&info, 1);
+    const std::size_t offsetV = GST_VIDEO_INFO_PLANE_OFFSET(&info, 2);
+    auto* base = mapped.map.data;
+
+    cv::Mat bgr;
+
+    // OpenCV expects the three planes back to back with chroma rows at half the luma stride
+    const bool packed = (height % 2) == 0
+        && strideU * 2 == strideY
+        && offsetU == offsetY + static_cast<std::size_t>(strideY) * height
+        && offsetV == offsetU + static_cast<std::size_t>(strideU) * (height / 2);
+    if (packed) {
+        cv::Mat yuv(height * 3 / 2, width, CV_8UC1, base + offsetY, strideY);
+        cv::cvtColor(yuv, bgr, cv::COLOR_YUV2BGR_I420);
+        return bgr;
+    }
+
+    thread_local cv::Mat scratch;
+    scratch.create(height * 3 / 2, width, CV_8UC1);
+    cv::Mat(height, width, CV_8UC1, base + offsetY, strideY).copyTo(scratch.rowRange(0, height));
+
+    const int chromaWidth = width / 2;
+    const int chromaHeight = height / 2;
+    auto* dstU = scratch.ptr(height);
+    auto* dstV = dstU + static_cast<std::size_t>(chromaWidth) * chromaHeight;
+    for (int row = 0; row < chromaHeight; ++row) {
+        std::memcpy(dstU + static_cast<std::size_t>(row) * chromaWidth,
+                    base + offsetU + static_cast<std::size_t>(row) * strideU, chromaWidth);
+        std::memcpy(dstV + static_cast<std::size_t>(row) * chromaWidth,
+                    base + offsetV + static_cast<std::size_t>(row) * GST_VIDEO_INFO_PLANE_STRIDE(&info, 2), chromaWidth);
+    }
+
+    cv::cvtColor(scratch, bgr, cv::COLOR_YUV2BGR_I420);
+    return bgr;
+}
+
+cv::Mat convertNV12(const MappedBuffer& mapped, const GstVideoInfo& info) {
+    const int width = GST_VIDEO_INFO_WIDTH(&info);
+    const int height = GST_VIDEO_INFO_HEIGHT(&info);
+    auto* base = mapped.map.data;
+
+    cv::Mat y(height, width, CV_8UC1, base + GST_VIDEO_INFO_PLANE_OFFSET(&info, 0),
+              GST_VIDEO_INFO_PLANE_STRIDE(&info, 0));
+    cv::Mat uv(height / 2, width / 2, CV_8UC2, base + GST_VIDEO_INFO_PLANE_OFFSET(&info, 1),
+               GST_VIDEO_INFO_PLANE_STRIDE(&info, 1));
+
+    cv::Mat bgr;
+    cv::cvtColorTwoPlane(y, uv, bgr, cv::COLOR_YUV2BGR_NV12);
+    return bgr;
+}
+
+cv::Mat convertPacked(const MappedBuffer& mapped, const GstVideoInfo& info, int type, int code) {
+    cv::Mat source(GST_VIDEO_INFO_HEIGHT(&info), GST_VIDEO_INFO_WIDTH(&info), type,
+                   mapped.map.data + GST_VIDEO_INFO_PLANE_OFFSET(&info, 0),
+                   GST_VIDEO_INFO_PLANE_STRIDE(&info, 0));
+
+    cv::Mat bgr;
+    cv::cvtColor(source, bgr, code);
+    return bgr;
+}
+
+}
+
+cv::Mat FrameView::fromSample(GstSample* sample) {
+    if (!sample) {
+        return cv::Mat();
+    }
+
+    GstBuffer* buffer = gst_sample_get_buffer(sample);
+    GstCaps* caps = gst_sample_get_caps(sample);
+    if (!buffer || !caps) {
+        return cv::Mat();
+    }
+
+    GstVideoInfo info;
+    if (!gst_video_info_from_caps(&info, caps)) {
+        return cv::Mat();
+    }
+
+    return fromBuffer(buffer, info);
+}
+
+cv::Mat FrameView::fromBuffer(GstBuffer* buffer, const GstVideoInfo& info) {
+    if (!buffer || GST_VIDEO_INFO_WIDTH(&info) <= 0 || GST_VIDEO_INFO_HEIGHT(&info) <= 0) {
+        return cv::Mat();
+    }
+
+    MappedBuffer* mapped = mapBuffer(buffer);
+    if (!mapped) {
+        return cv::Mat();
+    }
+
+    if (mapped->map.size < GST_VIDEO_INFO_SIZE(&info)) {
+        releaseBuffer(mapped);
+        return cv::Mat();
+    }
+
+    cv::Mat frame;
+    try {
+        switch (GST_VIDEO_INFO_FORMAT(&info)) {
+            case GST_VIDEO_FORMAT_BGR:
+                // Ownership of the mapping moves into the Mat
+                return wrapMapped(mapped, info);
+            case GST_VIDEO_FORMAT_RGB:
+                frame = convertPacked(*mapped, info, CV_8UC3, cv::COLOR_RGB2BGR);
+                break;
+            case GST_VIDEO_FORMAT_BGRx:
+            case GST_VIDEO_FORMAT_BGRA:
+                frame = convertPacked(*mapped, info, CV_8UC4, cv::COLOR_BGRA2BGR);
+                break;
+            case GST_VIDEO_FORMAT_RGBx:
+            case GST_VIDEO_FORMAT_RGBA:
+                frame = convertPacked(*mapped, info, CV_8UC4, cv::COLOR_RGBA2BGR);
+                break;
+            case GST_VIDEO_FORMAT_I420:
+                frame = convertI420(*mapped, info);
+                break;
+            case GST_VIDEO_FORMAT_NV12:
+                frame = convertNV12(*mapped, info);
+                break;
+            default:
+                break;
+        }
+    } catch (...) {
+        releaseBuffer(mapped);
+        throw;
+    }
+
+    releaseBuffer(mapped);
+    return frame;
+}
+
+bool FrameView::isMapped(const cv::Mat& frame) {
+    return frame.u && frame.u->currAllocator == bufferAllocator();
+}
+
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <gst/gst.h>
+#include <gst/video/video.h>
+
+namespace SnowOwl::Server::Core {
+
+// Wraps mapped GstBuffers in cv::Mat headers without copying the pixels.
+// The mapping and a buffer reference are owned by the Mat's UMatData and
+// released when the last Mat sharing the data goes away, so views can be
+// handed to detectors and outputs freely. Views are read-only: anything that
+// needs to draw on a frame must clone it first.
+class FrameView {
+public:
+    // Returns a BGR frame for the sample. Packed 3-channel formats are wrapped
+    // in place; I420/NV12 are converted straight out of the mapped buffer.
+    // Returns an empty Mat for non-raw or malformed samples.
+    static cv::Mat fromSample(GstSample* sample);
+    static cv::Mat fromBuffer(GstBuffer* buffer, const GstVideoInfo& info);
+
+    // True when the Mat still references a mapped GstBuffer.
+    static bool isMapped(const cv::Mat& frame);
+};
+
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <type_traits>
+
+#include "core/streams/capture_types.hpp"
+
+namespace SnowOwl::Server::Core {
+
+// Bounded single-producer/single-consumer ring for trivially copyable handles
+// (typically GstSample*). Neither side ever blocks or takes a lock.
+//
+// To honour DropOldest/KeepLatest the producer has to evict from the read end,
+// so the read index is claimed by compare-and-swap on both sides: whoever wins
+// the CAS owns the element in that slot. Indices are 64-bit and only grow, so
+// there is no ABA. Evicted or rejected elements are handed back to the caller,
+// which is responsible for releasing them.
+template <typename T>
+class SpscRing {
+    static_assert(std::is_trivially_copyable_v<T>, "SpscRing slots are exchanged atomically");
+
+public:
+    explicit SpscRing(std::size_t capacity = 3, FrameDropPolicy policy = FrameDropPolicy::DropOldest)
+        : capacity_(policy == FrameDropPolicy::KeepLatest ? 1 : std::max<std::size_t>(capacity, 1))
+        , policy_(policy)
+        , slots_(std::make_unique<std::atomic<T>[]>(capacity_)) {}
+
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    // Producer side. Returns the element that was discarded to respect the drop
+    // policy: the evicted oldest entry, or value itself under DropNewest.
+    std::optional<T> push(T value) {
+        const std::uint64_t head = head_.load(std::memory_order_relaxed);
+        std::uint64_t tail = tail_.load(std::memory_order_acquire);
+        std::optional<T> discarded;
+
+        while (head - tail >= capacity_) {
+            if (policy_ == FrameDropPolicy::DropNewest) {
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+                return value;
+            }
+
+            const T oldest = slots_[tail % capacity_].load(std::memory_order_acquire);
+            if (tail_.compare_exchange_weak(tail, tail + 1, std::memory_order_acq_rel, std::memory_order_acquire)) {
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+                discarded = oldest;
+                break;
+            }
+            // Lost the race: the consumer took that slot, re-check for room
+        }
+
+        slots_[head % capacity_].store(value, std::memory_order_relaxed);
+        head_.store(head + 1, std::memory_order_release);
+        enqueued_.fetch_add(1, std::memory_order_relaxed);
+        return discarded;
+    }
+
+    // Consumer side.
+    std::optional<T> pop() {
+        std::uint64_t tail = tail_.load(std::memory_order_acquire);
+        while (tail < head_.load(std::memory_order_acquire)) {
+            const T value = slots_[tail % capacity_].load(std::memory_order_acquire);
+            if (tail_.compare_exchange_weak(tail, tail + 1, std::memory_order_acq_rel, std::memory_order_acquire)) {
+                return value;
+            }
+        }
+        return std::nullopt;
+    }
+
+    bool empty() const { return size() == 0; }
+
+    std::size_t size() const {
+        const std::uint64_t tail = tail_.load(std::memory_order_acquire);
+        const std::uint64_t head = head_.load(std::memory_order_acquire);
+        return head > tail ? static_cast<std::size_t>(head - tail) : 0;
+    }
+
+    std::size_t capacity() const { return capacity_; }
+    FrameDropPolicy policy() const { return policy_; }
+    std::uint64_t enqueued() const { return enqueued_.load(std::memory_order_relaxed); }
+    std::uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+    const std::size_t capacity_;
+    const FrameDropPolicy policy_;
+    std::unique_ptr<std::atomic<T>[]> slots_;
+
+    alignas(64) std::atomic<std::uint64_t> head_{0};
+    alignas(64) std::atomic<std::uint64_t> tail_{0};
+    alignas(64) std::atomic<std::uint64_t> enqueued_{0};
+    std::atomic<std::uint64_t> dropped_{0};
+};
+
+}
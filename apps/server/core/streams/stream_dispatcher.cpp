@@ -1,6 +1,15 @@
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
 #include <iostream>
+#include <mutex>
+#include <thread>
 
+#include "core/output/hls_output.hpp"
 #include "core/output/rtmp_output.hpp"
+#include "core/output/sample_packetizer.hpp"
+#include "core/output/video_encoder.hpp"
+#include "core/output/websocket_video_output.hpp"
 #include "core/streams/stream_dispatcher.hpp"
 #include "core/streams/video_capture_manager.hpp"
 #include "core/output/rtsp_output.hpp"
@@ -9,6 +18,11 @@ namespace SnowOwl::Server::Core {
 
 namespace {
 
+// Event batches are small but must not pile up behind a dead sink either
+constexpr std::size_t kMaxQueuedEvents = 64;
+// About four seconds of compressed video per muxer
+constexpr std::size_t kMaxQueuedPackets = 120;
+
 class NullStreamOutput : public StreamOutput {
 public:
 	bool start() override { return true; }
@@ -17,9 +31,246 @@ public:
 	void publishEvents(const std::vector<Detection::DetectionResult>&) override {}
 };
 
+// Converts and encodes each frame once on its own worker, then hands the
+// packets to every muxer-only output.
+class EncoderStage : public StreamOutput {
+public:
+	EncoderStage(const StreamOutputConfig& config, VideoEncoder::PacketHandler handler)
+		: encoder_(config)
+		, handler_(std::move(handler)) {}
+
+	bool start() override { return true; }
+	void stop() override { encoder_.close(); }
+	void publishFrame(const cv::Mat& frame) override { encoder_.encode(frame, handler_); }
+	void publishEvents(const std::vector<Detection::DetectionResult>&) override {}
+
+private:
+	VideoEncoder encoder_;
+	VideoEncoder::PacketHandler handler_;
+};
+
+CaptureQueueConfig queueConfigFor(const std::string& name, const StreamOutputConfig& config) {
+	auto queue = config.queue;
+
+	if (auto it = config.parameters.find("queue_capacity"); it != config.parameters.end()) {
+		try {
+			queue.capacity = static_cast<std::size_t>(std::stoul(it->second));
+		} catch (const std::exception&) {
+			std::cerr << "StreamDispatcher: invalid queue_capacity for " << name << ": " << it->second << std::endl;
+		}
+	}
+	if (auto it = config.parameters.find("drop_policy"); it != config.parameters.end()) {
+		queue.dropPolicy = frameDropPolicyFromString(it->second);
+	}
+
+	return queue;
+}
+
 }
 
-StreamDispatcher::StreamDispatcher() = default;
+// Owns one output and the thread that feeds it. Queued frames share pixel
+// data with the caller's Mat, so fanning a frame out to several outputs
+// only costs a reference count per output.
+class StreamDispatcher::OutputWorker {
+public:
+	OutputWorker(std::string name, const CaptureQueueConfig& queue, std::unique_ptr<StreamOutput> output)
+		: name_(std::move(name))
+		, config_(queue)
+		, output_(std::move(output))
+		, consumesPackets_(output_ && output_->consumesPackets()) {
+		config_.capacity = config_.dropPolicy == FrameDropPolicy::KeepLatest ? 1 : std::max<std::size_t>(1, config_.capacity);
+	}
+
+	~OutputWorker() {
+		stop();
+	}
+
+	bool consumesPackets() const { return consumesPackets_; }
+
+	bool start() {
+		if (!output_ || !output_->start()) {
+			return false;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			running_ = true;
+		}
+		thread_ = std::thread(&OutputWorker::run, this);
+		return true;
+	}
+
+	void stop() {
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			if (!running_ && !thread_.joinable()) {
+				return;
+			}
+			running_ = false;
+			frames_.clear();
+			events_.clear();
+			packets_.clear();
+		}
+		cv_.notify_all();
+
+		if (thread_.joinable()) {
+			thread_.join();
+		}
+		if (output_) {
+			output_->stop();
+		}
+	}
+
+	void pushFrame(const cv::Mat& frame) {
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			if (!running_) {
+				return;
+			}
+
+			if (frames_.size() >= config_.capacity) {
+				if (config_.dropPolicy == FrameDropPolicy::DropNewest) {
+					++dropped_;
+					return;
+				}
+				while (frames_.size() >= config_.capacity) {
+					frames_.pop_front();
+					++dropped_;
+				}
+			}
+
+			frames_.push_back(frame);
+			++enqueued_;
+		}
+		cv_.notify_one();
+	}
+
+	void pushEvents(const std::vector<Detection::DetectionResult>& events) {
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			if (!running_) {
+				return;
+			}
+
+			if (events_.size() >= kMaxQueuedEvents) {
+				events_.pop_front();
+				++droppedEvents_;
+			}
+			events_.push_back(events);
+		}
+		cv_.notify_one();
+	}
+
+	void pushPacket(const AVPacket* packet, const std::shared_ptr<const EncodedStream>& stream) {
+		// Our own reference to the payload, taken before locking
+		EncodedPacket entry(packet, stream);
+		if (!entry.valid()) {
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			if (!running_) {
+				return;
+			}
+
+			// Losing any single packet breaks decoding until the next keyframe,
+			// so an overflowing muxer skips ahead to one instead
+			if (packets_.size() >= kMaxQueuedPackets) {
+				dropped_ += packets_.size();
+				packets_.clear();
+				waitingForKeyframe_ = true;
+			}
+			if (waitingForKeyframe_) {
+				if (!entry.keyframe()) {
+					++dropped_;
+					return;
+				}
+				waitingForKeyframe_ = false;
+			}
+
+			packets_.push_back(std::move(entry));
+			++enqueued_;
+		}
+		cv_.notify_one();
+	}
+
+	StreamOutputStats stats() const {
+		std::lock_guard<std::mutex> lock(mutex_);
+		StreamOutputStats stats;
+		stats.name = name_;
+		stats.queue.depth = consumesPackets_ ? packets_.size() : frames_.size();
+		stats.queue.capacity = consumesPackets_ ? kMaxQueuedPackets : config_.capacity;
+		stats.queue.enqueued = enqueued_;
+		stats.queue.dropped = dropped_;
+		stats.droppedEvents = droppedEvents_;
+		return stats;
+	}
+
+private:
+	void run() {
+		std::deque<std::vector<Detection::DetectionResult>> events;
+		std::deque<EncodedPacket> packets;
+		cv::Mat frame;
+
+		std::unique_lock<std::mutex> lock(mutex_);
+		while (true) {
+			cv_.wait(lock, [this] { return !running_ || !frames_.empty() || !events_.empty() || !packets_.empty(); });
+			if (!running_) {
+				break;
+			}
+
+			events.swap(events_);
+			packets.swap(packets_);
+			if (!frames_.empty()) {
+				frame = std::move(frames_.front());
+				frames_.pop_front();
+			}
+			lock.unlock();
+
+			try {
+				for (const auto& batch : events) {
+					output_->publishEvents(batch);
+				}
+				for (auto& packet : packets) {
+					output_->publishPacket(packet);
+				}
+				if (!frame.empty()) {
+					output_->publishFrame(frame);
+				}
+			} catch (const std::exception& e) {
+				std::cerr << "StreamDispatcher: " << name_ << " output failed: " << e.what() << std::endl;
+			}
+			events.clear();
+			packets.clear();
+			frame.release();
+
+			lock.lock();
+		}
+	}
+
+	std::string name_;
+	CaptureQueueConfig config_;
+	std::unique_ptr<StreamOutput> output_;
+
+	mutable std::mutex mutex_;
+	std::condition_variable cv_;
+	std::deque<cv::Mat> frames_;
+	std::deque<std::vector<Detection::DetectionResult>> events_;
+	std::deque<EncodedPacket> packets_;
+	const bool consumesPackets_;
+	bool waitingForKeyframe_{false};
+	std::uint64_t enqueued_{0};
+	std::uint64_t dropped_{0};
+	std::uint64_t droppedEvents_{0};
+	bool running_{false};
+	std::thread thread_;
+};
+
+StreamDispatcher::StreamDispatcher()
+	: packetizer_(std::make_unique<SamplePacketizer>())
+{
+}
 
 StreamDispatcher::~StreamDispatcher() {
 	stopOutputs();
@@ -34,6 +285,11 @@ void StreamDispatcher::configure(const StreamTargetProfile& profile) {
 	profile_ = std::move(profile);
 }
 
+void StreamDispatcher::addOutput(const std::string& name, const StreamOutputConfig& config, std::unique_ptr<StreamOutput> output)
+{
+	outputs_.push_back(std::make_unique<OutputWorker>(name, queueConfigFor(name, config), std::move(output)));
+}
+
 bool StreamDispatcher::startOutputs()
 {
 	if (started_) {
@@ -43,25 +299,55 @@ bool StreamDispatcher::startOutputs()
 	outputs_.clear();
 
 	if (profile_.tcp.enabled) {
-		outputs_.push_back(std::make_unique<NullStreamOutput>());
+		addOutput("tcp", profile_.tcp, std::make_unique<NullStreamOutput>());
 	}
 	if (profile_.rtmp.enabled) {
-		outputs_.push_back(std::make_unique<RtmpOutput>(profile_.rtmp));
+		addOutput("rtmp", profile_.rtmp, std::make_unique<RtmpOutput>(profile_.rtmp));
 	}
 	if (profile_.rtsp.enabled) {
-		outputs_.push_back(std::make_unique<RtspOutput>(profile_.rtsp));
+		addOutput("rtsp", profile_.rtsp, std::make_unique<RtspOutput>(profile_.rtsp));
 	}
 	if (profile_.hls.enabled) {
-		outputs_.push_back(std::make_unique<NullStreamOutput>());
+		addOutput("hls", profile_.hls, std::make_unique<HlsOutput>(profile_.hls));
 	}
 	if (profile_.webrtc.enabled) {
-		outputs_.push_back(std::make_unique<NullStreamOutput>());
+		addOutput("webrtc", profile_.webrtc, std::make_unique<NullStreamOutput>());
+	}
+	if (profile_.websocket.enabled) {
+		addOutput("websocket", profile_.websocket, std::make_unique<WebsocketVideoOutput>(profile_.websocket));
+	}
+
+	// One encoder feeds all muxer-only outputs; it is added last so it
+	// starts after them and, stopping in reverse, stops before them
+	packetOutputs_.clear();
+	for (auto& output : outputs_) {
+		if (output->consumesPackets()) {
+			packetOutputs_.push_back(output.get());
+		}
+	}
+	if (!packetOutputs_.empty()) {
+		addOutput("encoder", profile_.encoder, std::make_unique<EncoderStage>(profile_.encoder,
+			[this](const AVPacket* packet, const std::shared_ptr<const EncodedStream>& stream) {
+				if (passthrough_.load()) {
+					return;
+				}
+				for (auto* output : packetOutputs_) {
+					output->pushPacket(packet, stream);
+				}
+			}));
+		encoder_ = outputs_.back().get();
 	}
 
 	for (auto& output : outputs_) {
 		if (!output->start()) {
 			std::cerr << "StreamDispatcher: failed to start output" << std::endl;
-			stopOutputs();
+			// Outputs that did start still own threads and connections
+			for (auto it = outputs_.rbegin(); it != outputs_.rend(); ++it) {
+				(*it)->stop();
+			}
+			outputs_.clear();
+			packetOutputs_.clear();
+			encoder_ = nullptr;
 			return false;
 		}
 	}
@@ -76,13 +362,17 @@ void StreamDispatcher::stopOutputs()
 		return;
 	}
 
-	for (auto& output : outputs_) {
-		if (output) {
-			output->stop();
+	for (auto it = outputs_.rbegin(); it != outputs_.rend(); ++it) {
+		if (*it) {
+			(*it)->stop();
 		}
 	}
 
 	outputs_.clear();
+	packetOutputs_.clear();
+	encoder_ = nullptr;
+	passthrough_ = false;
+	packetizer_->reset();
 	started_ = false;
 }
 
@@ -92,10 +382,12 @@ void StreamDispatcher::onFrame(const cv::Mat& frame)
 		return;
 	}
 
+	const bool passthrough = passthrough_.load();
 	for (auto& output : outputs_) {
-		if (output) {
-			output->publishFrame(frame);
+		if (!output || output->consumesPackets() || (passthrough && output.get() == encoder_)) {
+			continue;
 		}
+		output->pushFrame(frame);
 	}
 }
 
@@ -107,9 +399,36 @@ void StreamDispatcher::onEvents(const std::vector<Detection::DetectionResult>& e
 
 	for (auto& output : outputs_) {
 		if (output) {
-			output->publishEvents(events);
+			output->pushEvents(events);
+		}
+	}
+}
+
+void StreamDispatcher::onEncodedSample(GstSample* sample)
+{
+	if (!started_ || packetOutputs_.empty() || !sample) {
+		return;
+	}
+
+	// Muxers join on the next keyframe, so switching from the encoder is seamless enough
+	passthrough_ = true;
+	packetizer_->packetize(sample, [this](const AVPacket* packet, const std::shared_ptr<const EncodedStream>& stream) {
+		for (auto* output : packetOutputs_) {
+			output->pushPacket(packet, stream);
+		}
+	});
+}
+
+std::vector<StreamOutputStats> StreamDispatcher::outputStats() const
+{
+	std::vector<StreamOutputStats> stats;
+	stats.reserve(outputs_.size());
+	for (const auto& output : outputs_) {
+		if (output) {
+			stats.push_back(output->stats());
 		}
 	}
+	return stats;
 }
 
 }
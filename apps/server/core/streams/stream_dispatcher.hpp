@@ -1,16 +1,22 @@
 #pragma once
 
+#include <atomic>
 #include <memory>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
 #include <opencv2/core.hpp>
+#include <gst/gst.h>
 
 #include "detection/detection_types.hpp"
+#include "core/streams/capture_types.hpp"
 
 namespace SnowOwl::Server::Core {
 
+struct EncodedPacket;
+class SamplePacketizer;
+
 class StreamOutput {
 public:
 	virtual ~StreamOutput() = default;
@@ -18,11 +24,27 @@ public:
 	virtual void stop() = 0;
 	virtual void publishFrame(const cv::Mat& frame) = 0;
 	virtual void publishEvents(const std::vector<Detection::DetectionResult>& events) = 0;
+
+	// Muxer-only outputs take packets from the dispatcher's shared encoder
+	// instead of raw frames. The packet holds this output's own reference.
+	virtual bool consumesPackets() const { return false; }
+	virtual void publishPacket(EncodedPacket& packet) { (void)packet; }
 };
 
 struct StreamOutputConfig {
 	bool enabled{false};
 	std::unordered_map<std::string, std::string> parameters;
+	// Frames waiting for this output's worker; "queue_capacity" and
+	// "drop_policy" in parameters override it
+	CaptureQueueConfig queue{2, FrameDropPolicy::DropOldest};
+};
+
+struct StreamOutputStats {
+	std::string name;
+	// Frames, or packets for muxer outputs; queue.dropped counts only these
+	CaptureQueueStats queue;
+	// Detection batches discarded while the worker was behind
+	std::uint64_t droppedEvents{0};
 };
 
 struct StreamTargetProfile {
@@ -31,10 +53,20 @@ struct StreamTargetProfile {
 	StreamOutputConfig rtsp;
 	StreamOutputConfig hls;
 	StreamOutputConfig webrtc;
+	// fMP4 over the websocket server's binary video channel
+	StreamOutputConfig websocket;
+	// Settings of the H.264 encoder shared by every packet output
+	StreamOutputConfig encoder;
 };
 
 inline bool hasAnyEnabled(const StreamTargetProfile& profile) {
-	return profile.tcp.enabled || profile.rtmp.enabled || profile.rtsp.enabled || profile.hls.enabled || profile.webrtc.enabled;
+	return profile.tcp.enabled || profile.rtmp.enabled || profile.rtsp.enabled || profile.hls.enabled || profile.webrtc.enabled
+		|| profile.websocket.enabled;
+}
+
+// Outputs fed from the shared encoder or a passthrough capture
+inline bool hasPacketOutputs(const StreamTargetProfile& profile) {
+	return profile.rtmp.enabled || profile.rtsp.enabled || profile.hls.enabled || profile.websocket.enabled;
 }
 
 class StreamDispatcher {
@@ -51,11 +83,27 @@ public:
 	bool startOutputs();
 	void stopOutputs();
 
+	// Both only queue work: every output publishes on its own worker thread,
+	// so a slow sink drops its own frames instead of stalling the caller
 	void onFrame(const cv::Mat& frame);
 	void onEvents(const std::vector<Detection::DetectionResult>& events);
+	// Compressed H.264 from a passthrough capture (borrowed). Once it flows,
+	// the shared encoder is bypassed and the access units go straight to
+	// the muxers.
+	void onEncodedSample(GstSample* sample);
+
+	std::vector<StreamOutputStats> outputStats() const;
 
 private:
-	std::vector<std::unique_ptr<StreamOutput>> outputs_;
+	class OutputWorker;
+
+	void addOutput(const std::string& name, const StreamOutputConfig& config, std::unique_ptr<StreamOutput> output);
+
+	std::vector<std::unique_ptr<OutputWorker>> outputs_;
+	std::vector<OutputWorker*> packetOutputs_;
+	OutputWorker* encoder_{nullptr};
+	std::unique_ptr<SamplePacketizer> packetizer_;
+	std::atomic<bool> passthrough_{false};
 	StreamTargetProfile profile_;
 	bool started_{false};
 };
@@ -26,17 +26,38 @@ bool isRtmpUri(const std::string& uri) {
     return uri.rfind("rtmp://", 0) == 0;
 }
 
-GstFlowReturn on_new_sample_from_sink(GstAppSink* appsink, gpointer user_data) {
-    SnowOwl::Server::Core::VideoCapture* capture = static_cast<SnowOwl::Server::Core::VideoCapture*>(user_data);
-    
-    GstSample* sample = gst_app_sink_pull_sample(appsink);
-    if (sample) {
-        QMetaObject::invokeMethod(capture, [capture, sample]() {
-            emit capture->sampleReady(sample);
-        }, Qt::QueuedConnection);
+// Byte-stream with SPS/PPS repeated on every IDR, one access unit per buffer,
+// so any muxer can start on a keyframe without out-of-band codec data
+constexpr const char* kEncodedCaps =
+    "h264parse config-interval=-1 ! video/x-h264,stream-format=byte-stream,alignment=au";
+
+// Compressed video the probe links to, so audio pads stay unlinked
+constexpr const char* kProbeCaps =
+    "capsfilter caps=\"video/x-h264;video/x-h265;video/mpeg;video/x-vp8;video/x-vp9;video/x-av1;image/jpeg\"";
+constexpr auto kProbeTimeout = std::chrono::seconds(5);
+
+bool hasElement(const char* name) {
+    GstElementFactory* factory = gst_element_factory_find(name);
+    if (!factory) {
+        return false;
     }
-    
-    return GST_FLOW_OK;
+    gst_object_unref(factory);
+    return true;
+}
+
+// First H.264 encoder this GStreamer install has, with its bitrate in kbps;
+// empty when there is none and the stream outputs must encode themselves
+std::string h264EncoderString(int bitrateKbps) {
+    std::ostringstream encoder;
+    if (hasElement("vaapih264enc")) {
+        encoder << "vaapipostproc ! vaapih264enc bitrate=" << bitrateKbps;
+    } else if (hasElement("x264enc")) {
+        encoder << "videoconvert ! x264enc bitrate=" << bitrateKbps
+                << " tune=zerolatency speed-preset=veryfast";
+    } else if (hasElement("openh264enc")) {
+        encoder << "videoconvert ! openh264enc bitrate=" << bitrateKbps * 1000;
+    }
+    return encoder.str();
 }
 
 }
@@ -83,13 +104,59 @@ VideoCapture::VideoCapture(QObject* parent,
 }
 
 VideoCapture::~VideoCapture() {
-    if (VideoCaptureManager::getInstance()) {
-        VideoCaptureManager::getInstance()->removeVideoCapture(cameraId_);
-    }
-    
     stopVideoCaptureSystem();
 }
 
+void VideoCapture::setSampleHandler(SampleHandler handler) {
+    sampleHandler_ = std::move(handler);
+}
+
+void VideoCapture::setEncodedSampleHandler(SampleHandler handler, bool passthrough) {
+    encodedSampleHandler_ = std::move(handler);
+    passthrough_ = passthrough;
+}
+
+void VideoCapture::setDetectionFps(int fps) {
+    detectionFps_ = std::max(0, fps);
+}
+
+GstFlowReturn VideoCapture::onNewSample(GstAppSink* appsink, gpointer userData) {
+    auto* capture = static_cast<VideoCapture*>(userData);
+
+    GstSample* sample = gst_app_sink_pull_sample(appsink);
+    if (!sample) {
+        return GST_FLOW_OK;
+    }
+
+    if (capture->sampleHandler_) {
+        capture->sampleHandler_(sample);
+        return GST_FLOW_OK;
+    }
+
+    QMetaObject::invokeMethod(capture, [capture, sample]() {
+        emit capture->sampleReady(sample);
+    }, Qt::QueuedConnection);
+
+    return GST_FLOW_OK;
+}
+
+GstFlowReturn VideoCapture::onNewEncodedSample(GstAppSink* appsink, gpointer userData) {
+    auto* capture = static_cast<VideoCapture*>(userData);
+
+    GstSample* sample = gst_app_sink_pull_sample(appsink);
+    if (!sample) {
+        return GST_FLOW_OK;
+    }
+
+    if (capture->encodedSampleHandler_) {
+        capture->encodedSampleHandler_(sample);
+    } else {
+        gst_sample_unref(sample);
+    }
+
+    return GST_FLOW_OK;
+}
+
 bool VideoCapture::startVideoCaptureSystem() {
     if (isRunning_.load()) {
         return true;
@@ -100,10 +167,6 @@ bool VideoCapture::startVideoCaptureSystem() {
         return false;
     }
 
-    if (VideoCaptureManager::getInstance()) {
-        VideoCaptureManager::getInstance()->addVideoCapture(cameraId_, this);
-    }
-
     isRunning_ = true;
     captureThread_ = std::thread(&VideoCapture::captureLoop, this);
     return true;
@@ -125,6 +188,10 @@ bool VideoCapture::stopVideoCaptureSystem() {
             appsink_ = nullptr;
             bus_ = nullptr;
         }
+        if (encodedSink_) {
+            gst_object_unref(encodedSink_);
+            encodedSink_ = nullptr;
+        }
     }
 
     activeUri_.clear();
@@ -186,9 +253,9 @@ void VideoCapture::updateConfig(const CaptureConfig& config) {
     configUpdated_ = true;
 }
 
-std::string VideoCapture::buildPipelineString() const {
+std::string VideoCapture::rawSourceString() const {
     std::ostringstream pipeline;
-    
+
     switch (sourceKind_) {
         case CaptureSourceKind::Camera:
             pipeline << "v4l2src device=/dev/video" << cameraId_ << " ! videoconvert ! videoscale ! ";
@@ -202,40 +269,146 @@ std::string VideoCapture::buildPipelineString() const {
                     height = resolution.substr(x_pos + 1);
                 }
                 pipeline << "video/x-raw,width=" << width << ",height=" << height 
-                         << ",framerate=" << config_.fps << "/1 ! "
-                         << "videorate ! video/x-raw,framerate=" << config_.fps << "/1 ! "
-                         << "vaapipostproc ! vaapih264enc bitrate=" << config_.bitrate_kbps << " ! "
-                         << "h264parse ! appsink name=appsink";
+                         << ",framerate=" << config_.fps << "/1 ! ";
             }
             break;
-            
+
         case CaptureSourceKind::File:
             pipeline << "filesrc location=" << activeUri_ << " ! decodebin ! videoconvert ! ";
-            pipeline << "video/x-raw,framerate=" << config_.fps << "/1 ! "
-                     << "videorate ! video/x-raw,framerate=" << config_.fps << "/1 ! "
-                     << "vaapipostproc ! vaapih264enc bitrate=" << config_.bitrate_kbps << " ! "
-                     << "h264parse ! appsink name=appsink";
             break;
-            
+
         case CaptureSourceKind::NetworkStream:
         case CaptureSourceKind::RTMPStream:
         case CaptureSourceKind::RTSPStream:
+        case CaptureSourceKind::Other:
             if (isRtmpUri(activeUri_)) {
                 pipeline << "rtmpsrc location=" << activeUri_ << " ! flvdemux ! h264parse ! avdec_h264 ! videoconvert ! ";
-                pipeline << "video/x-raw,framerate=" << config_.fps << "/1 ! "
-                         << "videorate ! video/x-raw,framerate=" << config_.fps << "/1 ! "
-                         << "vaapipostproc ! vaapih264enc bitrate=" << config_.bitrate_kbps << " ! "
-                         << "h264parse ! appsink name=appsink";
             } else {
-                pipeline << "urisourcebin uri=" << activeUri_ << " ! videoconvert ! ";
-                pipeline << "video/x-raw,framerate=" << config_.fps << "/1 ! "
-                         << "videorate ! video/x-raw,framerate=" << config_.fps << "/1 ! "
-                         << "vaapipostproc ! vaapih264enc bitrate=" << config_.bitrate_kbps << " ! "
-                         << "h264parse ! appsink name=appsink";
+                pipeline << "uridecodebin uri=" << activeUri_ << " ! videoconvert ! ";
             }
             break;
     }
-    
+
+    pipeline << "videorate ! video/x-raw,framerate=" << config_.fps << "/1";
+    return pipeline.str();
+}
+
+std::string VideoCapture::compressedSourceString() const {
+    switch (sourceKind_) {
+        case CaptureSourceKind::File:
+            return "filesrc location=" + activeUri_ + " ! parsebin";
+        case CaptureSourceKind::NetworkStream:
+        case CaptureSourceKind::RTMPStream:
+        case CaptureSourceKind::RTSPStream:
+            if (isRtmpUri(activeUri_)) {
+                return "rtmpsrc location=" + activeUri_ + " ! flvdemux";
+            }
+            return "urisourcebin uri=" + activeUri_ + " ! parsebin";
+        case CaptureSourceKind::Camera:
+        case CaptureSourceKind::Other:
+            break;
+    }
+
+    // Raw sources have no bitstream to pass through
+    return {};
+}
+
+std::string VideoCapture::probeSourceCodec(const std::string& compressed) const {
+    const std::string description = compressed + " ! " + kProbeCaps + " ! fakesink name=probe";
+
+    GError* error = nullptr;
+    GstElement* probe = gst_parse_launch(description.c_str(), &error);
+    if (error) {
+        std::cerr << "VideoCapture: failed to create codec probe: " << error->message << std::endl;
+        g_error_free(error);
+        if (probe) {
+            gst_object_unref(probe);
+        }
+        return {};
+    }
+    if (!probe) {
+        return {};
+    }
+
+    GstElement* sink = gst_bin_get_by_name(GST_BIN(probe), "probe");
+    GstPad* pad = sink ? gst_element_get_static_pad(sink, "sink") : nullptr;
+    GstBus* bus = gst_pipeline_get_bus(GST_PIPELINE(probe));
+
+    // Live sources never preroll, so run until the sink pad has its caps
+    std::string codec;
+    if (pad && gst_element_set_state(probe, GST_STATE_PLAYING) != GST_STATE_CHANGE_FAILURE) {
+        const auto deadline = std::chrono::steady_clock::now() + kProbeTimeout;
+        while (std::chrono::steady_clock::now() < deadline) {
+            if (GstCaps* caps = gst_pad_get_current_caps(pad)) {
+                if (gst_caps_get_size(caps) > 0) {
+                    codec = gst_structure_get_name(gst_caps_get_structure(caps, 0));
+                }
+                gst_caps_unref(caps);
+                break;
+            }
+
+            GstMessage* msg = gst_bus_timed_pop_filtered(bus, 50 * GST_MSECOND,
+                static_cast<GstMessageType>(GST_MESSAGE_ERROR | GST_MESSAGE_EOS));
+            if (msg) {
+                gst_message_unref(msg);
+                break;
+            }
+        }
+    }
+
+    gst_element_set_state(probe, GST_STATE_NULL);
+    if (bus) {
+        gst_object_unref(bus);
+    }
+    if (pad) {
+        gst_object_unref(pad);
+    }
+    if (sink) {
+        gst_object_unref(sink);
+    }
+    gst_object_unref(probe);
+    return codec;
+}
+
+std::string VideoCapture::decodedSinkString() const {
+    std::ostringstream sink;
+    if (detectionFps_ > 0) {
+        sink << "videorate drop-only=true max-rate=" << detectionFps_ << " ! ";
+    }
+    sink << "videoconvert ! video/x-raw,format=BGR ! appsink name=appsink";
+    return sink.str();
+}
+
+std::string VideoCapture::buildPipelineString() const {
+    std::ostringstream pipeline;
+
+    if (!encodedSampleHandler_) {
+        pipeline << rawSourceString() << " ! " << decodedSinkString();
+        return pipeline.str();
+    }
+
+    const std::string compressed = passthrough_ ? compressedSourceString() : std::string{};
+    if (!compressed.empty() && sourceCodec_ == "video/x-h264") {
+        // The source's own H.264 goes to the outputs untouched; detection gets
+        // a decoded copy of the same access units
+        pipeline << compressed << " ! " << kEncodedCaps << " ! tee name=t "
+                 << "t. ! queue ! appsink name=encsink "
+                 << "t. ! queue ! avdec_h264 ! " << decodedSinkString();
+        return pipeline.str();
+    }
+
+    // Anything else is decoded and, if GStreamer has an H.264 encoder,
+    // encoded once here; otherwise the stream outputs encode the frames
+    const std::string encoder = h264EncoderString(config_.bitrate_kbps);
+    if (encoder.empty()) {
+        pipeline << rawSourceString() << " ! " << decodedSinkString();
+        return pipeline.str();
+    }
+
+    pipeline << rawSourceString() << " ! tee name=t "
+             << "t. ! queue ! " << encoder << " ! "
+             << kEncodedCaps << " ! appsink name=encsink "
+             << "t. ! queue leaky=downstream max-size-buffers=2 ! " << decodedSinkString();
     return pipeline.str();
 }
 
@@ -249,6 +422,22 @@ bool VideoCapture::openCapture() {
         appsink_ = nullptr;
         bus_ = nullptr;
     }
+    if (encodedSink_) {
+        gst_object_unref(encodedSink_);
+        encodedSink_ = nullptr;
+    }
+
+    if (encodedSampleHandler_ && passthrough_ && probedUri_ != activeUri_) {
+        const std::string compressed = compressedSourceString();
+        sourceCodec_ = compressed.empty() ? std::string{} : probeSourceCodec(compressed);
+        // A failed probe is retried on the next reconnect
+        probedUri_ = sourceCodec_.empty() ? std::string{} : activeUri_;
+        if (!compressed.empty() && sourceCodec_ != "video/x-h264") {
+            std::cout << "VideoCapture: " << describeSource() << " is "
+                      << (sourceCodec_.empty() ? "of unknown codec" : sourceCodec_)
+                      << ", re-encoding for the stream outputs" << std::endl;
+        }
+    }
 
     std::string pipeline_str = buildPipelineString();
     
@@ -275,14 +464,24 @@ bool VideoCapture::openCapture() {
     }
 
     g_object_set(appsink_, "emit-signals", TRUE, nullptr);
-    GstAppSinkCallbacks callbacks = { nullptr, nullptr, on_new_sample_from_sink };
+    GstAppSinkCallbacks callbacks = { nullptr, nullptr, &VideoCapture::onNewSample };
     gst_app_sink_set_callbacks(GST_APP_SINK(appsink_), &callbacks, this, nullptr);
+
+    encodedSink_ = gst_bin_get_by_name(GST_BIN(pipeline_), "encsink");
+    if (encodedSink_) {
+        GstAppSinkCallbacks encodedCallbacks = { nullptr, nullptr, &VideoCapture::onNewEncodedSample };
+        gst_app_sink_set_callbacks(GST_APP_SINK(encodedSink_), &encodedCallbacks, this, nullptr);
+    }
     
     bus_ = gst_pipeline_get_bus(GST_PIPELINE(pipeline_));
 
     GstStateChangeReturn ret = gst_element_set_state(pipeline_, GST_STATE_PLAYING);
     if (ret == GST_STATE_CHANGE_FAILURE) {
         std::cerr << "VideoCapture: failed to start pipeline" << std::endl;
+        if (encodedSink_) {
+            gst_object_unref(encodedSink_);
+            encodedSink_ = nullptr;
+        }
         gst_object_unref(appsink_);
         gst_object_unref(pipeline_);
         pipeline_ = nullptr;
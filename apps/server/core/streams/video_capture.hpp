@@ -3,6 +3,7 @@
 #include <QObject>
 #include <atomic>
 #include <chrono>
+#include <functional>
 #include <mutex>
 #include <string>
 #include <thread>
@@ -39,6 +40,22 @@ public:
                           std::string secondary_uri = {});
     ~VideoCapture();
 
+    // Invoked on the GStreamer streaming thread for every appsink sample; the
+    // handler takes ownership of the sample. Must be set before starting.
+    using SampleHandler = std::function<void(GstSample*)>;
+    void setSampleHandler(SampleHandler handler);
+
+    // Adds a second appsink carrying H.264 access units (byte-stream, one AU
+    // per sample) for the stream outputs. Network and file sources whose
+    // probed codec is H.264 then skip the decode/re-encode and hand over the
+    // camera's own bitstream, with a separate decode branch feeding the
+    // sample handler; other sources are encoded by the first GStreamer H.264
+    // encoder found, or get no encoded samples if there is none. Same
+    // ownership rules as the sample handler; must be set before starting.
+    void setEncodedSampleHandler(SampleHandler handler, bool passthrough = true);
+    // Caps the rate of decoded frames; 0 delivers every frame
+    void setDetectionFps(int fps);
+
     bool startVideoCaptureSystem();
     bool stopVideoCaptureSystem();
 
@@ -52,6 +69,8 @@ public:
     void updateConfig(const CaptureConfig& config);
 
 private:
+    static GstFlowReturn onNewSample(GstAppSink* appsink, gpointer userData);
+    static GstFlowReturn onNewEncodedSample(GstAppSink* appsink, gpointer userData);
     void captureLoop();
     bool openCapture();
     bool openCameraLocked();
@@ -63,6 +82,11 @@ private:
     bool isFileSource() const;
     std::string describeSource() const;
     std::string buildPipelineString() const;
+    std::string compressedSourceString() const;
+    // Caps name of the source's video stream, e.g. "video/x-h264"; empty on failure
+    std::string probeSourceCodec(const std::string& compressed) const;
+    std::string rawSourceString() const;
+    std::string decodedSinkString() const;
     
     void applyConfigUpdates();
 
@@ -78,6 +102,7 @@ private:
     
     GstElement* pipeline_;
     GstElement* appsink_;
+    GstElement* encodedSink_{nullptr};
     GstBus* bus_;
     
     std::thread captureThread_;
@@ -86,6 +111,12 @@ private:
     
     GstSample* currentSample_;
     std::mutex sampleMutex_;
+    SampleHandler sampleHandler_;
+    SampleHandler encodedSampleHandler_;
+    bool passthrough_{false};
+    std::string sourceCodec_;
+    std::string probedUri_;
+    int detectionFps_{0};
     mutable std::mutex captureMutex_;
     
     CaptureConfig config_;
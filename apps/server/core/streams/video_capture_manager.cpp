@@ -1,5 +1,6 @@
 #include "video_capture_manager.hpp"
 #include "video_capture.hpp"
+#include "frame_view.hpp"
 
 #include <iostream>
 
@@ -8,64 +9,15 @@
 
 namespace SnowOwl::Server::Core {
 
-static VideoCaptureManager* g_instance = nullptr;
+std::unordered_map<int, VideoCapture*> VideoCaptureManager::deviceCaptures_;
+std::mutex VideoCaptureManager::captureMutex_;
 
-namespace {
-cv::Mat sampleToMat(GstSample* sample) {
-    if (!sample) {
-        return cv::Mat();
-    }
-
-    GstBuffer* buffer = gst_sample_get_buffer(sample);
-    if (!buffer) {
-        return cv::Mat();
-    }
-
-    GstMapInfo map;
-    if (!gst_buffer_map(buffer, &map, GST_MAP_READ)) {
-        return cv::Mat();
-    }
-
-    GstCaps* caps = gst_sample_get_caps(sample);
-    if (!caps) {
-        gst_buffer_unmap(buffer, &map);
-        return cv::Mat();
-    }
-
-    GstStructure* structure = gst_caps_get_structure(caps, 0);
-    int width, height;
-    gst_structure_get_int(structure, "width", &width);
-    gst_structure_get_int(structure, "height", &height);
-    
-    const char* format = gst_structure_get_string(structure, "format");
-    
-    cv::Mat frame;
-    if (format && strcmp(format, "RGB") == 0) {
-        frame = cv::Mat(height, width, CV_8UC3, map.data).clone();
-    } else if (format && strcmp(format, "I420") == 0) {
-        frame = cv::Mat(height * 3/2, width, CV_8UC1, map.data).clone();
-        cv::cvtColor(frame, frame, cv::COLOR_YUV2BGR_I420);
-    } else {
-        frame = cv::Mat(height, width, CV_8UC3, map.data).clone();
-    }
-
-    gst_buffer_unmap(buffer, &map);
-    return frame;
-}
-}
-
-VideoCaptureManager::VideoCaptureManager() {
-    g_instance = this;
+VideoCaptureManager::VideoCaptureManager(CaptureWorkerPool& pool)
+	: pool_(pool) {
 }
 
 VideoCaptureManager::~VideoCaptureManager() {
 	stop();
-    g_instance = nullptr;
-}
-
-
-VideoCaptureManager* VideoCaptureManager::getInstance() {
-    return g_instance;
 }
 
 bool VideoCaptureManager::start(const CaptureSourceConfig& config, SampleCallback sampleCallback, DetectionCallback detectionCallback) {
@@ -78,26 +30,7 @@ bool VideoCaptureManager::start(const CaptureSourceConfig& config, SampleCallbac
     frameCallback_ = nullptr;
 	detectionCallback_ = std::move(detectionCallback);
 
-	capture_ = std::make_unique<VideoCapture>(
-		nullptr, 
-		config_.kind, 
-		config_.cameraId, 
-		config_.primaryUri, 
-		config_.secondaryUri
-	);
-
-	if (!capture_->startVideoCaptureSystem()) {
-		capture_.reset();
-		return false;
-	}
-
-	running_ = true;
-	captureActive_ = true;
-
-	captureThread_ = std::thread(&VideoCaptureManager::captureLoop, this);
-	processingThread_ = std::thread(&VideoCaptureManager::processingLoop, this);
-
-	return true;
+	return launch();
 }
 
 bool VideoCaptureManager::start(const CaptureSourceConfig& config, FrameCallback frameCallback, DetectionCallback detectionCallback) {
@@ -110,6 +43,12 @@ bool VideoCaptureManager::start(const CaptureSourceConfig& config, FrameCallback
     frameCallback_ = std::move(frameCallback);
 	detectionCallback_ = std::move(detectionCallback);
 
+	return launch();
+}
+
+bool VideoCaptureManager::launch() {
+	sampleQueue_ = std::make_unique<SpscRing<GstSample*>>(config_.queue.capacity, config_.queue.dropPolicy);
+
 	capture_ = std::make_unique<VideoCapture>(
 		nullptr, 
 		config_.kind, 
@@ -117,99 +56,154 @@ bool VideoCaptureManager::start(const CaptureSourceConfig& config, FrameCallback
 		config_.primaryUri, 
 		config_.secondaryUri
 	);
-
-	if (!capture_->startVideoCaptureSystem()) {
-		capture_.reset();
-		return false;
+	capture_->setSampleHandler([this](GstSample* sample) {
+		enqueueSample(sample);
+	});
+	if (encodedSampleCallback_) {
+		capture_->setEncodedSampleHandler([this](GstSample* sample) {
+			encodedSampleCallback_(sample);
+			gst_sample_unref(sample);
+		}, config_.passthrough);
 	}
+	capture_->setDetectionFps(config_.detectionFps);
 
 	running_ = true;
-	captureActive_ = true;
 
-	captureThread_ = std::thread(&VideoCaptureManager::captureLoop, this);
-	processingThread_ = std::thread(&VideoCaptureManager::processingLoop, this);
+	if (!capture_->startVideoCaptureSystem()) {
+		stop();
+		return false;
+	}
 
+	addVideoCapture(deviceId(), capture_.get());
 	return true;
 }
 
 bool VideoCaptureManager::restart(const CaptureSourceConfig& config) {
 	stop();
+	if (frameCallback_) {
+		return start(config, frameCallback_, detectionCallback_);
+	}
 	return start(config, sampleCallback_, detectionCallback_);
 }
 
 void VideoCaptureManager::stop() {
 	running_ = false;
-	captureActive_ = false;
 
+	// Tearing the pipeline down stops the producer before the ring is drained
 	if (capture_) {
+		removeVideoCapture(deviceId(), capture_.get());
 		capture_->stopVideoCaptureSystem();
 		capture_.reset();
 	}
 
+	// A queued drain task still references this manager; let it run out
+	{
+		std::unique_lock<std::mutex> lock(idleMutex_);
+		idleCv_.wait(lock, [this] { return !scheduled_.load(); });
+	}
+
 	clearQueue();
+}
 
-	if (captureThread_.joinable()) {
-		captureThread_.join();
+CaptureQueueStats VideoCaptureManager::queueStats() const {
+	CaptureQueueStats stats;
+	if (sampleQueue_) {
+		stats.depth = sampleQueue_->size();
+		stats.capacity = sampleQueue_->capacity();
+		stats.enqueued = sampleQueue_->enqueued();
+		stats.dropped = sampleQueue_->dropped();
+	}
+	return stats;
+}
+
+int VideoCaptureManager::deviceId() const {
+	return config_.deviceId >= 0 ? config_.deviceId : config_.cameraId;
+}
+
+void VideoCaptureManager::enqueueSample(GstSample* sample) {
+	if (!running_.load() || !sampleQueue_) {
+		gst_sample_unref(sample);
+		return;
 	}
 
-	if (processingThread_.joinable()) {
-		processingThread_.join();
+	if (auto discarded = sampleQueue_->push(sample)) {
+		gst_sample_unref(*discarded);
 	}
+
+	schedule();
 }
 
-void VideoCaptureManager::captureLoop() {
-	while (captureActive_.load()) {
-		std::this_thread::sleep_for(std::chrono::milliseconds(5));
+void VideoCaptureManager::schedule() {
+	if (scheduled_.exchange(true)) {
+		return;
 	}
+	pool_.submit([this] { drain(); });
 }
 
-void VideoCaptureManager::processingLoop() {
-	while (running_.load()) {
-		GstSample* sample = nullptr;
-		
-		{
-			std::unique_lock<std::mutex> lock(queueMutex_);
-			queueCv_.wait(lock, [this] { return !sampleQueue_.empty() || !running_.load(); });
-			
-			if (!running_.load() || sampleQueue_.empty()) {
-				continue;
-			}
-			
-			sample = sampleQueue_.front();
-			sampleQueue_.pop_front();
+void VideoCaptureManager::drain() {
+	if (running_.load()) {
+		if (auto next = sampleQueue_->pop()) {
+			processSample(*next);
+		}
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(idleMutex_);
+		// A push that raced with us saw the flag still set and skipped scheduling,
+		// so drop it first and take it back if the ring is not empty after all
+		scheduled_.exchange(false);
+		if (!running_.load() || sampleQueue_->empty() || scheduled_.exchange(true)) {
+			// Notify under the lock: stop() may destroy the manager as soon as the flag drops
+			idleCv_.notify_all();
+			return;
 		}
-		
-		if (sample) {
-			cv::Mat frame = sampleToMat(sample);
-			
-			if (sampleCallback_) {
-				sampleCallback_(sample);
-			}
-			
-			if (!frame.empty()) {
-				auto detections = processor_.processFrame(frame);
-                
-                if (frameCallback_) {
-                    VideoProcessor::drawDetections(frame, detections);
-                    frameCallback_(frame);
+	}
+
+	// One frame per turn, then requeue behind the other devices
+	pool_.submit([this] { drain(); });
+}
+
+void VideoCaptureManager::processSample(GstSample* sample) {
+	if (!sample) {
+		return;
+	}
+
+	cv::Mat frame = FrameView::fromSample(sample);
+	
+	if (sampleCallback_) {
+		sampleCallback_(sample);
+	}
+	
+	if (!frame.empty()) {
+		auto detections = processor_.processFrame(frame);
+        
+        if (frameCallback_) {
+            if (!detections.empty()) {
+                // Views alias the GStreamer buffer, so overlays go on a private copy
+                if (FrameView::isMapped(frame)) {
+                    frame = frame.clone();
                 }
+                VideoProcessor::drawDetections(frame, detections);
+            }
+            frameCallback_(frame);
+        }
 
-				if (detectionCallback_ && !detections.empty()) {
-					detectionCallback_(detections);
-				}
-			}
-			
-			gst_sample_unref(sample);
+		if (detectionCallback_ && !detections.empty()) {
+			detectionCallback_(detections);
 		}
 	}
+	
+	gst_sample_unref(sample);
 }
 
 void VideoCaptureManager::clearQueue() {
-	std::lock_guard<std::mutex> lock(queueMutex_);
-	for (auto* sample : sampleQueue_) {
-		gst_sample_unref(sample);
+	if (!sampleQueue_) {
+		return;
+	}
+
+	while (auto sample = sampleQueue_->pop()) {
+		gst_sample_unref(*sample);
 	}
-	sampleQueue_.clear();
 }
 
 
@@ -218,9 +212,12 @@ void VideoCaptureManager::addVideoCapture(int deviceId, VideoCapture* capture) {
     deviceCaptures_[deviceId] = capture;
 }
 
-void VideoCaptureManager::removeVideoCapture(int deviceId) {
+void VideoCaptureManager::removeVideoCapture(int deviceId, VideoCapture* capture) {
     std::lock_guard<std::mutex> lock(captureMutex_);
-    deviceCaptures_.erase(deviceId);
+    auto it = deviceCaptures_.find(deviceId);
+    if (it != deviceCaptures_.end() && (!capture || it->second == capture)) {
+        deviceCaptures_.erase(it);
+    }
 }
 
 VideoCapture* VideoCaptureManager::getVideoCapture(int deviceId) {
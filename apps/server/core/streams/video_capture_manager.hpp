@@ -2,12 +2,10 @@
 
 #include <atomic>
 #include <condition_variable>
-#include <deque>
 #include <functional>
 #include <memory>
 #include <mutex>
 #include <string>
-#include <thread>
 #include <vector>
 #include <unordered_map>
 
@@ -15,19 +13,24 @@
 #include <gst/app/gstappsink.h>
 #include "core/streams/video_processor.hpp"
 #include "core/streams/capture_types.hpp"
+#include "core/streams/spsc_ring.hpp"
+#include "core/streams/capture_worker_pool.hpp"
 #include "detection/detection_types.hpp"
 
 namespace SnowOwl::Server::Core {
 
 class VideoCapture;
 
+// Drives one capture source. Any number of managers can run side by side:
+// their appsinks push into per-device rings and the frames are processed on
+// a CaptureWorkerPool shared between them, one task per device at a time.
 class VideoCaptureManager {
 public:
 	using SampleCallback = std::function<void(GstSample*)>;
     using FrameCallback = std::function<void(cv::Mat&)>;
 	using DetectionCallback = std::function<void(const std::vector<Detection::DetectionResult>&)>;
 
-	VideoCaptureManager();
+	explicit VideoCaptureManager(CaptureWorkerPool& pool = CaptureWorkerPool::shared());
 	~VideoCaptureManager();
 
 	VideoCaptureManager(const VideoCaptureManager&) = delete;
@@ -38,45 +41,52 @@ public:
 	bool start(const CaptureSourceConfig& config, SampleCallback sampleCallback, DetectionCallback detectionCallback);
     bool start(const CaptureSourceConfig& config, FrameCallback frameCallback, DetectionCallback detectionCallback);
 
+	// Receives the compressed H.264 stream (one access unit per sample) on the
+	// GStreamer thread; the sample is only borrowed. Set before start().
+	void setEncodedSampleCallback(SampleCallback callback) { encodedSampleCallback_ = std::move(callback); }
+
 	bool restart(const CaptureSourceConfig& config);
 	void stop();
 
 	bool isRunning() const { return running_.load(); }
+	CaptureQueueStats queueStats() const;
+	int deviceId() const;
 	
 	VideoProcessor& getProcessor() { return processor_; }
-    
-    static VideoCaptureManager* getInstance();
 
-    void addVideoCapture(int deviceId, VideoCapture* capture);
-    void removeVideoCapture(int deviceId);
-    VideoCapture* getVideoCapture(int deviceId);
+    // Registry of running pipelines across all managers, keyed by device id
+    static void addVideoCapture(int deviceId, VideoCapture* capture);
+    static void removeVideoCapture(int deviceId, VideoCapture* capture = nullptr);
+    static VideoCapture* getVideoCapture(int deviceId);
 
 private:
-	void captureLoop();
-	void processingLoop();
+	bool launch();
+	void schedule();
+	void drain();
+	void processSample(GstSample* sample);
+	void enqueueSample(GstSample* sample);
 	void clearQueue();
 
+	CaptureWorkerPool& pool_;
 	CaptureSourceConfig config_;
 	std::unique_ptr<VideoCapture> capture_;
 	VideoProcessor processor_;
 
 	SampleCallback sampleCallback_;
+	SampleCallback encodedSampleCallback_;
     FrameCallback frameCallback_;
 	DetectionCallback detectionCallback_;
 
 	std::atomic<bool> running_{false};
-	std::atomic<bool> captureActive_{false};
-
-	std::thread captureThread_;
-	std::thread processingThread_;
 
-	std::mutex queueMutex_;
-	std::condition_variable queueCv_;
-	std::deque<GstSample*> sampleQueue_;
-    const std::size_t queueCapacity_{3};
+	// appsink streaming thread -> drain() on the pool; only one drain task is ever queued
+	std::unique_ptr<SpscRing<GstSample*>> sampleQueue_;
+	std::atomic<bool> scheduled_{false};
+	std::mutex idleMutex_;
+	std::condition_variable idleCv_;
     
-    std::unordered_map<int, VideoCapture*> deviceCaptures_;
-    std::mutex captureMutex_;
+    static std::unordered_map<int, VideoCapture*> deviceCaptures_;
+    static std::mutex captureMutex_;
 };
 
-}
\ No newline at end of file
+}
@@ -1,12 +1,19 @@
 #include <algorithm>
+#include <chrono>
+#include <condition_variable>
 #include <iostream>
+#include <iterator>
+#include <mutex>
 
 #include <opencv2/imgproc.hpp>
 #include <opencv4/opencv2/imgcodecs.hpp>
 
 #include "video_processor.hpp"
+#include "frame_view.hpp"
+#include "capture_worker_pool.hpp"
 #include "modules/detection/detector.hpp"
 #include "modules/detection/unified_detector.hpp"
+#include "modules/detection/detection_batcher.hpp"
 #include "modules/network/network_server.hpp"
 
 namespace SnowOwl::Server::Core {
@@ -17,9 +24,19 @@ using ServerDetector = SnowOwl::Server::Modules::Detection::IDetector;
 
 namespace {
 
-template <typename DetectorT, typename ContainerT>
-void addDetector(ContainerT& storage, std::map<DetectionType, ServerDetector*>& index) {
-    auto detector = std::make_unique<DetectorT>();
+std::mutex g_inferenceMutex;
+InferenceOptions g_inferenceOptions;
+
+// Kept apart from the capture pool: capture workers block in processFrame
+// until their detectors finish, so sharing threads could deadlock.
+CaptureWorkerPool& detectorPool() {
+    static CaptureWorkerPool pool;
+    return pool;
+}
+
+template <typename DetectorT, typename ContainerT, typename... Args>
+void addDetector(ContainerT& storage, std::map<DetectionType, ServerDetector*>& index, Args&&... args) {
+    auto detector = std::make_unique<DetectorT>(std::forward<Args>(args)...);
     ServerDetector* raw = detector.get();
     index[raw->type()] = raw;
     storage.push_back(std::move(detector));
@@ -43,11 +60,39 @@ std::vector<DetectionResult> VideoProcessor::processFrame(const cv::Mat& frame)
     }
 
     try {
-        for (auto& detector : detectors_) {
+        const auto start = std::chrono::steady_clock::now();
+
+        activeDetectors_.clear();
+        bool gateEvaluated = false;
+        for (std::size_t i = 0; i < detectors_.size(); ++i) {
+            auto& detector = detectors_[i];
             if (!detector->enabled()) {
                 continue;
             }
-            detector->process(frame, results);
+
+            if (detector->gatedByMotion()) {
+                if (!gateEvaluated) {
+                    lastMotion_ = motionGate_.evaluate(frame);
+                    gateEvaluated = true;
+                }
+                if (!lastMotion_.shouldInfer()) {
+                    continue;
+                }
+            }
+
+            activeDetectors_.push_back(i);
+        }
+
+        runActiveDetectors(frame);
+
+        for (const auto index : activeDetectors_) {
+            auto& local = detectorResults_[index];
+            results.insert(results.end(), std::make_move_iterator(local.begin()), std::make_move_iterator(local.end()));
+            local.clear();
+        }
+
+        if (!activeDetectors_.empty()) {
+            frameLatency_.record(std::chrono::steady_clock::now() - start);
         }
         
         if (networkServer_ && !results.empty()) {
@@ -62,80 +107,89 @@ std::vector<DetectionResult> VideoProcessor::processFrame(const cv::Mat& frame)
     return results;
 }
 
-std::vector<DetectionResult> VideoProcessor::processSample(GstSample* sample) {
-
-    ensureDetectors();
-
-    std::vector<DetectionResult> results;
-
-    if (!sample) {
-        return results;
-    }
+void VideoProcessor::runDetector(std::size_t index, const cv::Mat& frame) {
+    auto& detector = *detectors_[index];
+    auto& local = detectorResults_[index];
+    local.clear();
 
+    const auto start = std::chrono::steady_clock::now();
     try {
-        cv::Mat frame = sampleToMat(sample);
-        
-        if (frame.empty()) {
-            return results;
-        }
-
-        for (auto& detector : detectors_) {
-            if (!detector->enabled()) {
-                continue;
-            }
-            detector->process(frame, results);
-        }
-        
-        if (networkServer_ && !results.empty()) {
-            networkServer_->broadcastEvents(results);
+        if (detector.gatedByMotion() && lastMotion_.motion) {
+            detector.processRegions(frame, lastMotion_.regions, local);
+        } else {
+            detector.process(frame, local);
         }
+    } catch (const cv::Exception& e) {
+        std::cerr << "VideoProcessor OpenCV error in " << SnowOwl::Detection::detectionTypeToString(detector.type()) << ": " << e.what() << std::endl;
+        local.clear();
     } catch (const std::exception& e) {
-        std::cerr << "VideoProcessor error: " << e.what() << std::endl;
+        std::cerr << "VideoProcessor error in " << SnowOwl::Detection::detectionTypeToString(detector.type()) << ": " << e.what() << std::endl;
+        local.clear();
     }
-
-    return results;
+    detectorLatency_[index]->record(std::chrono::steady_clock::now() - start);
 }
 
-cv::Mat VideoProcessor::sampleToMat(GstSample* sample) {
-    if (!sample) {
-        return cv::Mat();
+void VideoProcessor::runActiveDetectors(const cv::Mat& frame) {
+    if (activeDetectors_.empty()) {
+        return;
+    }
+    if (activeDetectors_.size() == 1) {
+        runDetector(activeDetectors_.front(), frame);
+        return;
     }
 
-    GstBuffer* buffer = gst_sample_get_buffer(sample);
-    if (!buffer) {
-        return cv::Mat();
+    // Fan the other detectors out and run the first one on this thread, so a
+    // frame takes as long as its slowest detector rather than the sum of them
+    std::mutex doneMutex;
+    std::condition_variable doneCv;
+    std::size_t remaining = activeDetectors_.size() - 1;
+
+    auto& pool = detectorPool();
+    for (std::size_t i = 1; i < activeDetectors_.size(); ++i) {
+        const std::size_t index = activeDetectors_[i];
+        pool.submit([this, index, &frame, &doneMutex, &doneCv, &remaining] {
+            runDetector(index, frame);
+            std::lock_guard<std::mutex> lock(doneMutex);
+            if (--remaining == 0) {
+                doneCv.notify_one();
+            }
+        });
     }
 
-    GstMapInfo map;
-    if (!gst_buffer_map(buffer, &map, GST_MAP_READ)) {
-        return cv::Mat();
+    runDetector(activeDetectors_.front(), frame);
+
+    std::unique_lock<std::mutex> lock(doneMutex);
+    doneCv.wait(lock, [&remaining] { return remaining == 0; });
+}
+
+std::vector<DetectorLatency> VideoProcessor::detectorLatencies() const {
+    std::vector<DetectorLatency> latencies;
+    latencies.reserve(detectors_.size());
+    for (std::size_t i = 0; i < detectors_.size() && i < detectorLatency_.size(); ++i) {
+        latencies.push_back({detectors_[i]->type(), detectorLatency_[i]->summary()});
     }
+    return latencies;
+}
 
-    GstCaps* caps = gst_sample_get_caps(sample);
-    if (!caps) {
-        gst_buffer_unmap(buffer, &map);
-        return cv::Mat();
+const UnifiedDetector* VideoProcessor::inferenceDetector() const {
+    for (const auto& detector : detectors_) {
+        if (const auto* unified = dynamic_cast<const UnifiedDetector*>(detector.get())) {
+            return unified;
+        }
+        if (const auto* batched = dynamic_cast<const SnowOwl::Server::Modules::Detection::BatchedDetector*>(detector.get())) {
+            return batched->batcher() ? &batched->batcher()->detector() : nullptr;
+        }
     }
+    return nullptr;
+}
 
-    GstStructure* structure = gst_caps_get_structure(caps, 0);
-    int width, height;
-    gst_structure_get_int(structure, "width", &width);
-    gst_structure_get_int(structure, "height", &height);
-    
-    const char* format = gst_structure_get_string(structure, "format");
-    
-    cv::Mat frame;
-    if (format && strcmp(format, "RGB") == 0) {
-        frame = cv::Mat(height, width, CV_8UC3, map.data).clone();
-    } else if (format && strcmp(format, "I420") == 0) {
-        frame = cv::Mat(height * 3/2, width, CV_8UC1, map.data).clone();
-        cv::cvtColor(frame, frame, cv::COLOR_YUV2BGR_I420);
-    } else {
-        frame = cv::Mat(height, width, CV_8UC3, map.data).clone();
+std::vector<DetectionResult> VideoProcessor::processSample(GstSample* sample) {
+    if (!sample) {
+        return {};
     }
 
-    gst_buffer_unmap(buffer, &map);
-    return frame;
+    // The view borrows the sample's buffer; detectors only ever read from it
+    return processFrame(FrameView::fromSample(sample));
 }
 
 void VideoProcessor::setIntrusionDetection(bool enabled) {
@@ -189,12 +243,36 @@ bool VideoProcessor::isAnyDetectionEnabled() const {
            isDetectionEnabled(DetectionType::FaceRecognition);
 }
 
+void VideoProcessor::registerDetector(std::unique_ptr<ServerDetector> detector) {
+    if (!detector) {
+        return;
+    }
+
+    ensureDetectors();
+    detectorIndex_[detector->type()] = detector.get();
+    detectors_.push_back(std::move(detector));
+    detectorLatency_.push_back(std::make_unique<LatencyHistogram>());
+    detectorResults_.emplace_back();
+}
+
 void VideoProcessor::applyConfiguration(const Config::ConfigManager& configManager) {
     if (configManager.has("detection.motion.enabled")) {
         bool enabled = configManager.get("detection.motion.enabled").get<bool>();
         setMotionDetection(enabled);
     }
     
+    if (configManager.has("detection.motion.parameters")) {
+        auto gateConfig = MotionGateConfig::fromJson(configManager.get("detection.motion.parameters"));
+        if (configManager.has("detection.motion.gate_enabled")) {
+            gateConfig.enabled = configManager.get("detection.motion.gate_enabled").get<bool>();
+        }
+        setMotionGateConfig(gateConfig);
+    } else if (configManager.has("detection.motion.gate_enabled")) {
+        auto gateConfig = motionGate_.config();
+        gateConfig.enabled = configManager.get("detection.motion.gate_enabled").get<bool>();
+        setMotionGateConfig(gateConfig);
+    }
+    
     if (configManager.has("detection.intrusion.enabled")) {
         bool enabled = configManager.get("detection.intrusion.enabled").get<bool>();
         setIntrusionDetection(enabled);
@@ -247,7 +325,19 @@ void VideoProcessor::ensureDetectors() {
     detectorIndex_.clear();
 
     // Use our new unified detector instead of the multiple specialized detectors
-    addDetector<SnowOwl::Server::Modules::Detection::UnifiedDetector>(detectors_, detectorIndex_);
+    const auto options = inferenceOptions();
+    if (options.maxBatch > 1) {
+        addDetector<SnowOwl::Server::Modules::Detection::BatchedDetector>(
+            detectors_, detectorIndex_, SnowOwl::Server::Modules::Detection::DetectionBatcher::shared(options));
+    } else {
+        addDetector<SnowOwl::Server::Modules::Detection::UnifiedDetector>(detectors_, detectorIndex_, options);
+    }
+
+    detectorLatency_.clear();
+    for (std::size_t i = 0; i < detectors_.size(); ++i) {
+        detectorLatency_.push_back(std::make_unique<LatencyHistogram>());
+    }
+    detectorResults_.assign(detectors_.size(), {});
 
     // Enable the detector by default
     if (auto* detector = findDetector(DetectionType::EquipmentFailure)) {
@@ -255,6 +345,16 @@ void VideoProcessor::ensureDetectors() {
     }
 }
 
+void VideoProcessor::setInferenceOptions(const InferenceOptions& options) {
+    std::lock_guard<std::mutex> lock(g_inferenceMutex);
+    g_inferenceOptions = options;
+}
+
+InferenceOptions VideoProcessor::inferenceOptions() {
+    std::lock_guard<std::mutex> lock(g_inferenceMutex);
+    return g_inferenceOptions;
+}
+
 void VideoProcessor::drawDetections(cv::Mat& frame, const std::vector<DetectionResult>& detections) {
     for (const auto& detection : detections) {
         cv::Scalar color(0, 255, 0);
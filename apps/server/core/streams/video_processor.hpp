@@ -9,7 +9,10 @@
 
 #include "config/config_manager.hpp"
 #include "detection/detection_types.hpp"
+#include "utils/latency_histogram.hpp"
 #include "modules/detection/detector.hpp"
+#include "modules/detection/unified_detector.hpp"
+#include "modules/detection/motion_gate.hpp"
 #include "modules/network/network_server.hpp"
 #include "stream_dispatcher.hpp"
 
@@ -18,6 +21,18 @@ namespace SnowOwl::Server::Core {
 using SnowOwl::Detection::DetectionResult;
 using SnowOwl::Detection::DetectionType;
 using ServerDetector = SnowOwl::Server::Modules::Detection::IDetector;
+using InferenceOptions = SnowOwl::Server::Modules::Detection::InferenceOptions;
+using UnifiedDetector = SnowOwl::Server::Modules::Detection::UnifiedDetector;
+using MotionGate = SnowOwl::Server::Modules::Detection::MotionGate;
+using MotionGateConfig = SnowOwl::Server::Modules::Detection::MotionGateConfig;
+using MotionGateResult = SnowOwl::Server::Modules::Detection::MotionGateResult;
+using LatencyHistogram = SnowOwl::Utils::Metrics::LatencyHistogram;
+using LatencySummary = SnowOwl::Utils::Metrics::LatencySummary;
+
+struct DetectorLatency {
+    DetectionType type;
+    LatencySummary latency;
+};
 
 class VideoProcessor {
 public:
@@ -43,25 +58,53 @@ public:
     bool isDetectionEnabled(DetectionType type) const;
     bool isAnyDetectionEnabled() const;
 
+    // Adds a detector next to the built-in ones; call before frames are processed.
+    // Enabled detectors run in parallel, one per detector pool thread.
+    void registerDetector(std::unique_ptr<ServerDetector> detector);
+
     void applyConfiguration(const Config::ConfigManager& configManager);
+
+    void setMotionGateConfig(const MotionGateConfig& config) { motionGate_.configure(config); }
+    const MotionGateConfig& getMotionGateConfig() const { return motionGate_.config(); }
+    // Outcome of the gate for the most recent frame
+    const MotionGateResult& lastMotion() const { return lastMotion_; }
     
     void setStreamProfile(const StreamTargetProfile& profile) { streamProfile_ = profile; }
     const StreamTargetProfile& getStreamProfile() const { return streamProfile_; }
 
     static void drawDetections(cv::Mat& frame, const std::vector<DetectionResult>& detections);
 
+    // Time spent in each detector, and in the whole detection stage of a frame
+    std::vector<DetectorLatency> detectorLatencies() const;
+    LatencySummary frameLatency() const { return frameLatency_.summary(); }
+    // The model detector, direct or behind the shared batcher; null when none is registered
+    const UnifiedDetector* inferenceDetector() const;
+
+    // Process-wide model settings, picked up by processors created afterwards.
+    // With maxBatch > 1 all processors share one batching detector.
+    static void setInferenceOptions(const InferenceOptions& options);
+    static InferenceOptions inferenceOptions();
+
 private:
     std::vector<std::unique_ptr<ServerDetector>> detectors_;
     std::map<DetectionType, ServerDetector*> detectorIndex_;
     bool detectorsInitialized_ = false;
     SnowOwl::Server::Modules::Network::NetworkServer* networkServer_ = nullptr;
     StreamTargetProfile streamProfile_;
+    MotionGate motionGate_;
+    MotionGateResult lastMotion_;
+
+    // Indexed like detectors_; each detector writes only to its own slot
+    std::vector<std::unique_ptr<LatencyHistogram>> detectorLatency_;
+    std::vector<std::vector<DetectionResult>> detectorResults_;
+    std::vector<std::size_t> activeDetectors_;
+    LatencyHistogram frameLatency_;
 
     ServerDetector* findDetector(DetectionType type);
     const ServerDetector* findDetector(DetectionType type) const;
     void ensureDetectors();
-    
-    cv::Mat sampleToMat(GstSample* sample);
+    void runDetector(std::size_t index, const cv::Mat& frame);
+    void runActiveDetectors(const cv::Mat& frame);
 };
 
 }
\ No newline at end of file
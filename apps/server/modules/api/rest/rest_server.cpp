@@ -1,6 +1,8 @@
 #include <algorithm>
 #include <cctype>
+#include <chrono>
 #include <cstdlib>
+#include <functional>
 #include <iostream>
 #include <memory>
 #include <optional>
@@ -10,6 +12,7 @@
 
 #include <boost/asio/io_context.hpp>
 #include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/steady_timer.hpp>
 #include <boost/beast/core.hpp>
 #include <boost/beast/http.hpp>
 #include <boost/beast/version.hpp>
@@ -17,6 +20,7 @@
 
 #include "modules/api/rest/rest_server.hpp"
 #include "config/device_registry.hpp"
+#include "core/output/hls_output.hpp"
 #include "core/streams/video_processor.hpp"
 #include "core/streams/video_capture_manager.hpp"
 #include "core/streams/video_capture.hpp"
@@ -116,6 +120,11 @@ void processRequest() {
             handleDetectionStatus(req);
             return;
         }
+
+        if (req.target().starts_with("/hls/")) {
+            handleHls(req);
+            return;
+        }
     } 
     else if (req.method() == http::verb::post) {
         if (req.target() == "/api/v1/devices") {
@@ -693,15 +702,7 @@ void handleCaptureConfigUpdate(const http::request<http::string_body>& req) {
         response["device_id"] = deviceId;
         response["action"] = action;
         
-        auto* captureManager = SnowOwl::Server::Core::VideoCaptureManager::getInstance();
-        if (!captureManager) {
-            response["status"] = "error";
-            response["error"] = "VideoCaptureManager not available";
-            send(buildJson(http::status::internal_server_error, response.dump()));
-            return;
-        }
-        
-        auto* videoCapture = captureManager->getVideoCapture(deviceId);
+        auto* videoCapture = SnowOwl::Server::Core::VideoCaptureManager::getVideoCapture(deviceId);
         if (!videoCapture) {
             response["status"] = "error";
             response["error"] = "VideoCapture not found for device " + deviceIdStr;
@@ -1002,6 +1003,24 @@ void handleDetectionStatus(const http::request<http::string_body>& req) {
                          
         response["type"] = detectionType;
         response["enabled"] = anyEnabled;
+
+        if (const auto* detector = videoProcessor_->inferenceDetector()) {
+            nlohmann::json inference = nlohmann::json::object();
+            inference["frames"] = detector->framesInferred();
+            inference["allocations"] = detector->inferenceAllocations();
+            inference["allocations_per_frame"] = detector->allocationsPerFrame();
+            response["inference"] = inference;
+        }
+
+        nlohmann::json latency = nlohmann::json::object();
+        latency["frame"] = latencyToJson(videoProcessor_->frameLatency());
+        latency["detectors"] = nlohmann::json::array();
+        for (const auto& detector : videoProcessor_->detectorLatencies()) {
+            nlohmann::json entry = latencyToJson(detector.latency);
+            entry["type"] = SnowOwl::Detection::detectionTypeToString(detector.type);
+            latency["detectors"].push_back(entry);
+        }
+        response["latency"] = latency;
     } else {
         using SnowOwl::Detection::DetectionType;
         
@@ -1033,6 +1052,137 @@ void handleDetectionStatus(const http::request<http::string_body>& req) {
     send(buildJson(http::status::ok, response.dump()));
 }
 
+void handleHls(const http::request<http::string_body>& req) {
+    const std::string target(req.target().data(), req.target().size());
+    const auto queryPos = target.find('?');
+    const std::string path = target.substr(0, queryPos);
+    const std::string query = queryPos == std::string::npos ? std::string() : target.substr(queryPos + 1);
+
+    const std::string_view prefix = "/hls/";
+    const auto slash = path.find('/', prefix.size());
+    if (slash == std::string::npos) {
+        send(buildError(http::status::not_found, "Not Found"));
+        return;
+    }
+
+    const std::string name = path.substr(prefix.size(), slash - prefix.size());
+    const std::string file = path.substr(slash + 1);
+    auto store = SnowOwl::Server::Core::HlsSegmentStore::find(name);
+    if (!store) {
+        send(buildError(http::status::not_found, "HLS stream not found"));
+        return;
+    }
+
+    // Requests for media that is not there yet are held back rather than
+    // refused; LL-HLS clients ask for the next part before it is written
+    const auto deadline = std::chrono::steady_clock::now()
+        + std::chrono::milliseconds(static_cast<int>(store->options().segmentSeconds * 3000.0));
+
+    if (file == "index.m3u8") {
+        std::optional<std::int64_t> msn;
+        std::optional<int> part;
+        try {
+            if (auto value = queryValue(query, "_HLS_msn")) {
+                msn = std::stoll(*value);
+            }
+            if (auto value = queryValue(query, "_HLS_part")) {
+                part = std::stoi(*value);
+            }
+        } catch (const std::exception&) {
+            send(buildError(http::status::bad_request, "Invalid _HLS_msn or _HLS_part"));
+            return;
+        }
+
+        auto respond = [this, store]() {
+            send(buildMedia("application/vnd.apple.mpegurl", store->playlist()));
+        };
+        if (!msn) {
+            respond();
+            return;
+        }
+        waitUntil([store, msn, part]() { return store->contains(*msn, part); }, deadline, respond);
+        return;
+    }
+
+    std::int64_t sequence = -1;
+    int partIndex = -1;
+    try {
+        const auto extension = file.rfind(".ts");
+        if (extension == std::string::npos || extension + 3 != file.size()) {
+            throw std::invalid_argument(file);
+        }
+        const std::string stem = file.substr(0, extension);
+        const auto dot = stem.find('.');
+        sequence = std::stoll(stem.substr(0, dot));
+        if (dot != std::string::npos) {
+            partIndex = std::stoi(stem.substr(dot + 1));
+        }
+    } catch (const std::exception&) {
+        send(buildError(http::status::not_found, "Not Found"));
+        return;
+    }
+
+    auto fetch = [store, sequence, partIndex]() {
+        return partIndex < 0 ? store->segment(sequence) : store->part(sequence, partIndex);
+    };
+    waitUntil([fetch]() { return fetch().has_value(); }, deadline, [this, fetch]() {
+        auto data = fetch();
+        if (!data) {
+            send(buildError(http::status::not_found, "HLS media not available"));
+            return;
+        }
+        send(buildMedia("video/mp2t", std::move(*data)));
+    });
+}
+
+// The io_context serves every session on one thread, so waiting is done by
+// re-arming a short timer instead of blocking
+void waitUntil(std::function<bool()> ready,
+               std::chrono::steady_clock::time_point deadline,
+               std::function<void()> respond) {
+    if (ready() || std::chrono::steady_clock::now() >= deadline) {
+        respond();
+        return;
+    }
+
+    if (!waitTimer_) {
+        waitTimer_.emplace(socket_.get_executor());
+    }
+    waitTimer_->expires_after(std::chrono::milliseconds(25));
+
+    auto self = shared_from_this();
+    waitTimer_->async_wait([self, ready = std::move(ready), deadline, respond = std::move(respond)](beast::error_code ec) mutable {
+        if (!ec) {
+            self->waitUntil(std::move(ready), deadline, std::move(respond));
+        }
+    });
+}
+
+static std::optional<std::string> queryValue(const std::string& query, std::string_view key) {
+    std::size_t start = 0;
+    while (start <= query.size()) {
+        const auto end = std::min(query.find('&', start), query.size());
+        const std::string_view pair(query.data() + start, end - start);
+        const auto equals = pair.find('=');
+        if (pair.substr(0, equals) == key) {
+            return equals == std::string_view::npos ? std::string() : std::string(pair.substr(equals + 1));
+        }
+        start = end + 1;
+    }
+    return std::nullopt;
+}
+
+static nlohmann::json latencyToJson(const SnowOwl::Utils::Metrics::LatencySummary& summary) {
+    return {
+        {"count", summary.count},
+        {"mean_ms", summary.meanMs},
+        {"p50_ms", summary.p50Ms},
+        {"p95_ms", summary.p95Ms},
+        {"p99_ms", summary.p99Ms},
+        {"max_ms", summary.maxMs},
+    };
+}
+
 template <typename Body>
 void send(http::response<Body>&& msg) {
     auto self = shared_from_this();
@@ -1064,12 +1214,22 @@ static http::response<http::string_body> buildJson(http::status status, std::str
     return res;
 }
 
+static http::response<http::string_body> buildMedia(const char* contentType, std::string body) {
+    http::response<http::string_body> res{http::status::ok, 11};
+    res.set(http::field::content_type, contentType);
+    res.set(http::field::cache_control, "no-cache");
+    res.set(http::field::access_control_allow_origin, "*");
+    res.body() = std::move(body);
+    return res;
+}
+
 boost::asio::ip::tcp::socket socket_;
 beast::flat_buffer buffer_;
 std::optional<http::request_parser<http::string_body>> parser_;
 SnowOwl::Config::DeviceRegistry& registry_;
 SnowOwl::Server::Core::VideoProcessor* videoProcessor_;
 std::unique_ptr<SnowOwl::Server::Modules::Discovery::DeviceDiscovery> deviceDiscovery_ {nullptr};
+std::optional<boost::asio::steady_timer> waitTimer_;
 };
 
 class Listener : public std::enable_shared_from_this<Listener> {
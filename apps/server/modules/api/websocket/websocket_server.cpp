@@ -3,21 +3,26 @@
 #include <algorithm>
 #include <chrono>
 #include <cstdlib>
+#include <deque>
 #include <functional>
 #include <iostream>
 #include <memory>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <thread>
 #include <vector>
 
 #include <boost/asio/io_context.hpp>
 #include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/post.hpp>
 #include <boost/asio/steady_timer.hpp>
 #include <boost/beast/core.hpp>
 #include <boost/beast/websocket.hpp>
 #include <nlohmann/json.hpp>
 
 #include "config/device_registry.hpp"
+#include "core/output/websocket_video_output.hpp"
 #include "core/streams/video_processor.hpp"
 #include "modules/utils/server_utils.hpp"
 
@@ -30,8 +35,20 @@ namespace websocket = beast::websocket;
 namespace net = boost::asio;
 using tcp = net::ip::tcp;
 
+// Video is sent as binary messages: one type byte (0 init segment,
+// 1 fragment), one channel name length byte, the name, then the payload.
+// A "video_init" text message with the MSE mime type precedes each init.
+constexpr unsigned char kVideoInitMessage = 0;
+constexpr unsigned char kVideoFragmentMessage = 1;
+// Longer names are truncated to fit the length byte
+constexpr std::size_t kMaxChannelNameLength = 255;
+// Queued fragments beyond this are dropped and the client resumes at the
+// next keyframe, so a slow reader falls back to live instead of behind
+constexpr std::size_t kMaxQueuedVideoBytes = 2 * 1024 * 1024;
+
 class WebsocketSession;
-class WebsocketSession : public std::enable_shared_from_this<WebsocketSession> {
+class WebsocketSession : public std::enable_shared_from_this<WebsocketSession>
+    , public SnowOwl::Server::Core::VideoFragmentSink {
 public:
     explicit WebsocketSession(tcp::socket socket, SnowOwl::Config::DeviceRegistry& registry)
         : websocket_(std::move(socket))
@@ -54,13 +71,45 @@ public:
         videoProcessor_ = processor;
     }
 
+    void onVideoInit(const std::string& channel, const std::string& mimeType,
+                     std::shared_ptr<const std::string> initSegment) override {
+        net::post(websocket_.get_executor(),
+            [self = shared_from_this(), channel, mimeType, initSegment = std::move(initSegment)]() {
+                self->queueVideoInit(channel, mimeType, *initSegment);
+            });
+    }
+
+    void onVideoFragment(const std::string& channel, std::shared_ptr<const std::string> fragment,
+                         bool keyframe) override {
+        net::post(websocket_.get_executor(),
+            [self = shared_from_this(), channel, fragment = std::move(fragment), keyframe]() {
+                self->queueVideoFragment(channel, *fragment, keyframe);
+            });
+    }
+
 private:
+    struct Outgoing {
+        std::shared_ptr<const std::string> payload;
+        bool binary{false};
+        // Fragments may be dropped under backpressure; text and init may not
+        bool droppable{false};
+    };
+
+    struct VideoSubscription {
+        std::shared_ptr<SnowOwl::Server::Core::LiveVideoChannel> channel;
+        bool waitingForKeyframe{true};
+    };
+
     websocket::stream<tcp::socket> websocket_;
     beast::flat_buffer buffer_;
     SnowOwl::Config::DeviceRegistry& registry_;
     SnowOwl::Server::Core::VideoProcessor* videoProcessor_;
     net::steady_timer heartbeatTimer_;
     std::vector<std::string> subscriptions_;
+    std::vector<VideoSubscription> videoSubscriptions_;
+    std::deque<Outgoing> writeQueue_;
+    std::size_t queuedVideoBytes_{0};
+    bool writing_{false};
 
     void onAccept() {
         nlohmann::json welcomeMsg;
@@ -271,6 +320,9 @@ private:
         response["stream_type"] = streamType;
         response["message"] = "Streaming started for device ID: " + std::to_string(deviceId);
         
+        const std::string channel = msg.value("channel", std::to_string(deviceId));
+        response["channel"] = channel;
+
         std::string streamTopic = "stream_" + std::to_string(deviceId);
         if (std::find(subscriptions_.begin(), subscriptions_.end(), streamTopic) == subscriptions_.end()) {
             subscriptions_.push_back(streamTopic);
@@ -278,7 +330,7 @@ private:
         
         sendText(response.dump());
         
-        sendStreamUpdates(deviceId);
+        subscribeVideo(channel);
     }
 
     void handleStopStreaming(const nlohmann::json& msg) {
@@ -289,50 +341,174 @@ private:
         response["device_id"] = deviceId;
         response["message"] = "Streaming stopped for device ID: " + std::to_string(deviceId);
         
+        const std::string channel = msg.value("channel", std::to_string(deviceId));
+        response["channel"] = channel;
+
         std::string streamTopic = "stream_" + std::to_string(deviceId);
         subscriptions_.erase(
             std::remove(subscriptions_.begin(), subscriptions_.end(), streamTopic),
             subscriptions_.end()
         );
+        unsubscribeVideo(channel);
         
         sendText(response.dump());
     }
 
-    void sendStreamUpdates(int deviceId) {
-        std::string streamTopic = "stream_" + std::to_string(deviceId);
-        if (std::find(subscriptions_.begin(), subscriptions_.end(), streamTopic) == subscriptions_.end()) {
+    void subscribeVideo(const std::string& channelName) {
+        auto existing = std::find_if(videoSubscriptions_.begin(), videoSubscriptions_.end(),
+            [&channelName](const VideoSubscription& entry) { return entry.channel->name() == channelName; });
+        if (existing != videoSubscriptions_.end()) {
             return;
         }
-        
-        nlohmann::json update;
-        update["type"] = "stream_update";
-        update["device_id"] = deviceId;
-        update["timestamp"] = std::time(nullptr);
-        
-        static int frameCount = 0;
-        update["frame_count"] = ++frameCount;
-        update["bitrate"] = 4000 + (rand() % 1000);
-        
-        sendText(update.dump());
-        
-        auto timer = std::make_shared<net::steady_timer>(websocket_.get_executor());
-        timer->expires_after(std::chrono::seconds(2));
-        timer->async_wait([self = shared_from_this(), deviceId, timer](beast::error_code ec) {
-            if (!ec) {
-                self->sendStreamUpdates(deviceId);
+
+        auto channel = SnowOwl::Server::Core::LiveVideoChannel::acquire(channelName);
+        videoSubscriptions_.push_back({channel, true});
+        channel->subscribe(shared_from_this());
+    }
+
+    void unsubscribeVideo(const std::string& channelName) {
+        auto it = std::find_if(videoSubscriptions_.begin(), videoSubscriptions_.end(),
+            [&channelName](const VideoSubscription& entry) { return entry.channel->name() == channelName; });
+        if (it != videoSubscriptions_.end()) {
+            it->channel->unsubscribe(this);
+            videoSubscriptions_.erase(it);
+        }
+    }
+
+    VideoSubscription* findVideoSubscription(const std::string& channelName) {
+        auto it = std::find_if(videoSubscriptions_.begin(), videoSubscriptions_.end(),
+            [&channelName](const VideoSubscription& entry) { return entry.channel->name() == channelName; });
+        return it == videoSubscriptions_.end() ? nullptr : &*it;
+    }
+
+    static std::shared_ptr<const std::string> videoMessage(unsigned char type, const std::string& channel,
+                                                           const std::string& payload) {
+        auto message = std::make_shared<std::string>();
+        const auto nameLength = std::min(channel.size(), kMaxChannelNameLength);
+        message->reserve(2 + nameLength + payload.size());
+        message->push_back(static_cast<char>(type));
+        message->push_back(static_cast<char>(nameLength));
+        message->append(channel, 0, nameLength);
+        message->append(payload);
+        return message;
+    }
+
+    // Channel name of a message built by videoMessage
+    static std::string_view videoChannel(const std::string& message) {
+        if (message.size() < 2) {
+            return {};
+        }
+        const auto nameLength = std::min<std::size_t>(static_cast<unsigned char>(message[1]), message.size() - 2);
+        return std::string_view(message).substr(2, nameLength);
+    }
+
+    void queueVideoInit(const std::string& channel, const std::string& mimeType, const std::string& initSegment) {
+        auto* subscription = findVideoSubscription(channel);
+        if (!subscription) {
+            return;
+        }
+        // Fragments queued for the old init segment cannot be decoded any
+        // more; other channels keep theirs
+        dropQueuedVideo(std::string_view(channel).substr(0, kMaxChannelNameLength));
+        subscription->waitingForKeyframe = true;
+
+        nlohmann::json initMsg;
+        initMsg["type"] = "video_init";
+        initMsg["channel"] = channel;
+        initMsg["mime"] = mimeType;
+        sendText(initMsg.dump());
+        enqueue({videoMessage(kVideoInitMessage, channel, initSegment), true, false});
+    }
+
+    void queueVideoFragment(const std::string& channel, const std::string& fragment, bool keyframe) {
+        auto* subscription = findVideoSubscription(channel);
+        if (!subscription) {
+            return;
+        }
+
+        if (queuedVideoBytes_ + fragment.size() > kMaxQueuedVideoBytes) {
+            dropQueuedVideo();
+            for (auto& entry : videoSubscriptions_) {
+                entry.waitingForKeyframe = true;
             }
-        });
+        }
+
+        if (subscription->waitingForKeyframe) {
+            if (!keyframe) {
+                return;
+            }
+            subscription->waitingForKeyframe = false;
+        }
+
+        auto message = videoMessage(kVideoFragmentMessage, channel, fragment);
+        queuedVideoBytes_ += message->size();
+        enqueue({std::move(message), true, true});
+    }
+
+    // Drops the queued fragments of one channel, or of every channel
+    void dropQueuedVideo(std::optional<std::string_view> channel = std::nullopt) {
+        // The front message may be in flight and has to stay
+        const auto first = writing_ && !writeQueue_.empty() ? writeQueue_.begin() + 1 : writeQueue_.begin();
+        writeQueue_.erase(std::remove_if(first, writeQueue_.end(), [&channel](const Outgoing& out) {
+                return out.droppable && (!channel || videoChannel(*out.payload) == *channel);
+            }),
+            writeQueue_.end());
+
+        queuedVideoBytes_ = 0;
+        for (const auto& out : writeQueue_) {
+            if (out.droppable) {
+                queuedVideoBytes_ += out.payload->size();
+            }
+        }
     }
 
     void sendText(const std::string& text) {
+        enqueue({std::make_shared<const std::string>(text), false, false});
+    }
+
+    // Beast allows one outstanding write per stream, so messages go out in order
+    void enqueue(Outgoing out) {
+        writeQueue_.push_back(std::move(out));
+        if (!writing_) {
+            doWrite();
+        }
+    }
+
+    void doWrite() {
+        writing_ = true;
+        const auto& front = writeQueue_.front();
+        websocket_.binary(front.binary);
         websocket_.async_write(
-            net::buffer(text),
+            net::buffer(*front.payload),
             [self = shared_from_this()](beast::error_code ec, std::size_t) {
+                self->onWrite(ec);
             });
     }
 
+    void onWrite(beast::error_code ec) {
+        const auto sent = std::move(writeQueue_.front());
+        writeQueue_.pop_front();
+        if (sent.droppable) {
+            queuedVideoBytes_ -= std::min(queuedVideoBytes_, sent.payload->size());
+        }
+
+        if (ec || writeQueue_.empty()) {
+            writing_ = false;
+            if (ec) {
+                writeQueue_.clear();
+                queuedVideoBytes_ = 0;
+            }
+            return;
+        }
+        doWrite();
+    }
+
     void onClose() {
         heartbeatTimer_.cancel();
+        for (auto& subscription : videoSubscriptions_) {
+            subscription.channel->unsubscribe(this);
+        }
+        videoSubscriptions_.clear();
     }
 };
 
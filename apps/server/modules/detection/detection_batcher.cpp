@@ -0,0 +1,166 @@
+#include "detection_batcher.hpp"
+#include "roi_tiler.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+namespace SnowOwl::Server::Modules::Detection {
+
+DetectionBatcher::DetectionBatcher(const InferenceOptions& options)
+    : detector_(options)
+    , maxWait_(std::max(std::chrono::milliseconds(0), options.maxWait)) {
+    worker_ = std::thread(&DetectionBatcher::run, this);
+}
+
+DetectionBatcher::~DetectionBatcher() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_ = false;
+    }
+    requestCv_.notify_all();
+
+    if (worker_.joinable()) {
+        worker_.join();
+    }
+}
+
+std::shared_ptr<DetectionBatcher> DetectionBatcher::shared(const InferenceOptions& options) {
+    static std::mutex sharedMutex;
+    static std::weak_ptr<DetectionBatcher> instance;
+
+    std::lock_guard<std::mutex> lock(sharedMutex);
+    auto batcher = instance.lock();
+    if (!batcher) {
+        batcher = std::make_shared<DetectionBatcher>(options);
+        instance = batcher;
+    }
+    return batcher;
+}
+
+void DetectionBatcher::process(const cv::Mat& frame, std::vector<DetectionResult>& outResults) {
+    if (frame.empty()) {
+        return;
+    }
+
+    process(std::vector<cv::Mat>{frame}, {&outResults});
+}
+
+void DetectionBatcher::process(const std::vector<cv::Mat>& frames,
+                               const std::vector<std::vector<DetectionResult>*>& outResults) {
+    if (frames.empty() || frames.size() != outResults.size() || !available()) {
+        return;
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+    std::vector<Request> requests(frames.size());
+    for (std::size_t i = 0; i < frames.size(); ++i) {
+        requests[i].frame = &frames[i];
+        requests[i].results = outResults[i];
+        requests[i].enqueuedAt = now;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!running_) {
+        return;
+    }
+    for (auto& request : requests) {
+        pending_.push_back(&request);
+    }
+    requestCv_.notify_one();
+
+    // The requests live on this stack frame, so wait until the worker is done with all of them
+    doneCv_.wait(lock, [&requests] {
+        return std::all_of(requests.begin(), requests.end(), [](const Request& request) { return request.done; });
+    });
+}
+
+void DetectionBatcher::run() {
+    const std::size_t maxBatch = std::max<std::size_t>(1, detector_.maxBatch());
+
+    std::vector<Request*> batch;
+    std::vector<cv::Mat> frames;
+    std::vector<std::vector<DetectionResult>*> outputs;
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        requestCv_.wait(lock, [this] { return !pending_.empty() || !running_; });
+        if (pending_.empty()) {
+            break;
+        }
+
+        // Give the other streams until the oldest frame's deadline to join in
+        const auto deadline = pending_.front()->enqueuedAt + maxWait_;
+        requestCv_.wait_until(lock, deadline, [this, maxBatch] {
+            return pending_.size() >= maxBatch || !running_;
+        });
+
+        const std::size_t count = std::min(maxBatch, pending_.size());
+        batch.assign(pending_.begin(), pending_.begin() + count);
+        pending_.erase(pending_.begin(), pending_.begin() + count);
+        lock.unlock();
+
+        frames.clear();
+        outputs.clear();
+        for (auto* request : batch) {
+            frames.push_back(*request->frame);
+            outputs.push_back(request->results);
+        }
+
+        try {
+            detector_.processBatch(frames, outputs);
+        } catch (const std::exception& e) {
+            std::cerr << "DetectionBatcher: batch of " << batch.size() << " failed: " << e.what() << std::endl;
+        }
+        frames.clear();
+
+        lock.lock();
+        for (auto* request : batch) {
+            request->done = true;
+        }
+        doneCv_.notify_all();
+    }
+}
+
+BatchedDetector::BatchedDetector(std::shared_ptr<DetectionBatcher> batcher)
+    : batcher_(std::move(batcher)) {
+    enabled_ = batcher_ && batcher_->available();
+}
+
+void BatchedDetector::process(const cv::Mat& frame, std::vector<DetectionResult>& outResults) {
+    if (!enabled_ || frame.empty()) {
+        return;
+    }
+
+    batcher_->process(frame, outResults);
+}
+
+void BatchedDetector::processRegions(const cv::Mat& frame, const std::vector<cv::Rect>& regions,
+                                     std::vector<DetectionResult>& outResults) {
+    if (!enabled_ || frame.empty()) {
+        return;
+    }
+
+    const auto& detector = batcher_->detector();
+    const auto tiles = planTiles(regions, frame.size(), detector.inputSize());
+    if (tiles.size() == 1 && tiles.front().size() == frame.size()) {
+        batcher_->process(frame, outResults);
+        return;
+    }
+
+    std::vector<cv::Mat> crops;
+    std::vector<std::vector<DetectionResult>> tileResults(tiles.size());
+    std::vector<std::vector<DetectionResult>*> outputs;
+    crops.reserve(tiles.size());
+    outputs.reserve(tiles.size());
+    for (std::size_t i = 0; i < tiles.size(); ++i) {
+        crops.push_back(frame(tiles[i]));
+        outputs.push_back(&tileResults[i]);
+    }
+
+    batcher_->process(crops, outputs);
+
+    auto merged = mergeTileDetections(tiles, tileResults, detector.overlapThreshold());
+    outResults.insert(outResults.end(), merged.begin(), merged.end());
+}
+
+}
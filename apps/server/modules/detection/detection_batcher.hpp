@@ -0,0 +1,81 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "detector.hpp"
+#include "unified_detector.hpp"
+
+namespace SnowOwl::Server::Modules::Detection {
+
+// Collects frames from any number of VideoProcessors and runs them through a
+// single UnifiedDetector as one batch. A batch is dispatched once it holds
+// maxBatch frames or the oldest frame has waited maxWait, whichever is first.
+// Callers block in process() until their own results have been scattered back.
+class DetectionBatcher {
+public:
+    explicit DetectionBatcher(const InferenceOptions& options);
+    ~DetectionBatcher();
+
+    DetectionBatcher(const DetectionBatcher&) = delete;
+    DetectionBatcher& operator=(const DetectionBatcher&) = delete;
+
+    // One batcher per process; created on first use with the given options
+    static std::shared_ptr<DetectionBatcher> shared(const InferenceOptions& options);
+
+    bool available() const { return detector_.enabled(); }
+    const UnifiedDetector& detector() const { return detector_; }
+    void process(const cv::Mat& frame, std::vector<DetectionResult>& outResults);
+    // Queues all frames at once so they can share a batch, then waits for every one
+    void process(const std::vector<cv::Mat>& frames,
+                 const std::vector<std::vector<DetectionResult>*>& outResults);
+
+private:
+    struct Request {
+        const cv::Mat* frame{nullptr};
+        std::vector<DetectionResult>* results{nullptr};
+        std::chrono::steady_clock::time_point enqueuedAt;
+        bool done{false};
+    };
+
+    void run();
+
+    UnifiedDetector detector_;
+    std::chrono::milliseconds maxWait_;
+
+    std::mutex mutex_;
+    std::condition_variable requestCv_;
+    std::condition_variable doneCv_;
+    std::deque<Request*> pending_;
+    bool running_{true};
+
+    std::thread worker_;
+};
+
+// IDetector front-end that hands frames to the shared DetectionBatcher.
+class BatchedDetector : public IDetector {
+public:
+    explicit BatchedDetector(std::shared_ptr<DetectionBatcher> batcher);
+
+    DetectionType type() const override { return DetectionType::EquipmentFailure; }
+    bool enabled() const override { return enabled_; }
+    void setEnabled(bool enabled) override { enabled_ = enabled && batcher_ && batcher_->available(); }
+    void process(const cv::Mat& frame, std::vector<DetectionResult>& outResults) override;
+    bool gatedByMotion() const override { return true; }
+    void processRegions(const cv::Mat& frame, const std::vector<cv::Rect>& regions,
+                        std::vector<DetectionResult>& outResults) override;
+
+    const DetectionBatcher* batcher() const { return batcher_.get(); }
+
+private:
+    std::shared_ptr<DetectionBatcher> batcher_;
+    bool enabled_{false};
+};
+
+}
@@ -17,6 +17,16 @@ public:
     virtual bool enabled() const = 0;
     virtual void setEnabled(bool enabled) = 0;
     virtual void process(const cv::Mat& frame, std::vector<DetectionResult>& outResults) = 0;
+
+    // Expensive detectors only run on frames the motion gate lets through
+    virtual bool gatedByMotion() const { return false; }
+
+    // Restricts the work to the given moving regions; by default the whole frame is processed
+    virtual void processRegions(const cv::Mat& frame, const std::vector<cv::Rect>& regions,
+                                std::vector<DetectionResult>& outResults) {
+        (void)regions;
+        process(frame, outResults);
+    }
 };
 
 // Forward declaration of our unified detector
@@ -0,0 +1,140 @@
+#include "motion_gate.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <opencv2/imgproc.hpp>
+
+namespace SnowOwl::Server::Modules::Detection {
+
+MotionGateConfig MotionGateConfig::fromJson(const nlohmann::json& motion) {
+    MotionGateConfig config;
+    if (!motion.is_object()) {
+        return config;
+    }
+
+    config.enabled = motion.value("gate_enabled", config.enabled);
+    const auto& params = motion.contains("parameters") && motion["parameters"].is_object()
+        ? motion["parameters"]
+        : motion;
+
+    config.historyLength = params.value("history_length", config.historyLength);
+    config.learningRate = params.value("learning_rate", config.learningRate);
+    config.varianceThreshold = params.value("variance_threshold", config.varianceThreshold);
+    config.detectShadows = params.value("detect_shadows", config.detectShadows);
+    config.shadowThreshold = params.value("shadow_threshold", config.shadowThreshold);
+    config.minArea = params.value("min_area", config.minArea);
+    config.dilationSize = params.value("dilation_size", config.dilationSize);
+    config.erosionSize = params.value("erosion_size", config.erosionSize);
+    config.analysisWidth = params.value("analysis_width", config.analysisWidth);
+    config.keepAlive = std::chrono::milliseconds(
+        params.value("keep_alive_ms", static_cast<long long>(config.keepAlive.count())));
+    return config;
+}
+
+MotionGate::MotionGate(const MotionGateConfig& config) {
+    configure(config);
+}
+
+void MotionGate::configure(const MotionGateConfig& config) {
+    config_ = config;
+    config_.analysisWidth = std::max(32, config_.analysisWidth);
+
+    subtractor_ = cv::createBackgroundSubtractorMOG2(
+        std::max(1, config_.historyLength), config_.varianceThreshold, config_.detectShadows);
+    subtractor_->setShadowThreshold(config_.shadowThreshold);
+
+    erodeKernel_ = config_.erosionSize > 0
+        ? cv::getStructuringElement(cv::MORPH_RECT, cv::Size(config_.erosionSize, config_.erosionSize))
+        : cv::Mat();
+    dilateKernel_ = config_.dilationSize > 0
+        ? cv::getStructuringElement(cv::MORPH_RECT, cv::Size(config_.dilationSize, config_.dilationSize))
+        : cv::Mat();
+
+    reset();
+}
+
+void MotionGate::reset() {
+    if (subtractor_) {
+        subtractor_->clear();
+    }
+    lastInference_ = {};
+}
+
+MotionGateResult MotionGate::evaluate(const cv::Mat& frame) {
+    MotionGateResult result;
+    if (frame.empty()) {
+        return result;
+    }
+
+    if (!config_.enabled) {
+        result.motion = true;
+        result.regions.emplace_back(0, 0, frame.cols, frame.rows);
+        return result;
+    }
+
+    // Work on a small grey copy; resize and cvtColor are vectorised in OpenCV
+    const double scale = std::min(1.0, static_cast<double>(config_.analysisWidth) / frame.cols);
+    if (scale < 1.0) {
+        cv::resize(frame, small_, cv::Size(), scale, scale, cv::INTER_AREA);
+    } else {
+        small_ = frame;
+    }
+    if (small_.channels() == 3) {
+        cv::cvtColor(small_, grey_, cv::COLOR_BGR2GRAY);
+    } else if (small_.channels() == 4) {
+        cv::cvtColor(small_, grey_, cv::COLOR_BGRA2GRAY);
+    } else {
+        grey_ = small_;
+    }
+
+    subtractor_->apply(grey_, mask_, config_.learningRate);
+
+    // Shadows are marked 127 by MOG2; only solid foreground counts
+    cv::threshold(mask_, mask_, 200, 255, cv::THRESH_BINARY);
+    if (!erodeKernel_.empty()) {
+        cv::erode(mask_, mask_, erodeKernel_);
+    }
+    if (!dilateKernel_.empty()) {
+        cv::dilate(mask_, mask_, dilateKernel_);
+    }
+
+    contours_.clear();
+    cv::findContours(mask_, contours_, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE);
+
+    const double areaScale = scale * scale;
+    const double minArea = config_.minArea * areaScale;
+    const double inverse = 1.0 / scale;
+    const cv::Rect bounds(0, 0, frame.cols, frame.rows);
+
+    for (const auto& contour : contours_) {
+        // No upper bound here: a large change still has to reach the detector
+        if (cv::contourArea(contour) < minArea) {
+            continue;
+        }
+
+        const cv::Rect box = cv::boundingRect(contour);
+        const cv::Rect full(
+            static_cast<int>(box.x * inverse),
+            static_cast<int>(box.y * inverse),
+            static_cast<int>(std::ceil(box.width * inverse)),
+            static_cast<int>(std::ceil(box.height * inverse)));
+        const cv::Rect clipped = full & bounds;
+        if (clipped.area() > 0) {
+            result.regions.push_back(clipped);
+        }
+    }
+
+    result.motion = !result.regions.empty();
+
+    const auto now = std::chrono::steady_clock::now();
+    if (!result.motion && now - lastInference_ >= config_.keepAlive) {
+        result.keepAlive = true;
+    }
+    if (result.shouldInfer()) {
+        lastInference_ = now;
+    }
+
+    return result;
+}
+
+}
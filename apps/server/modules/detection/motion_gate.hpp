@@ -0,0 +1,66 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <opencv2/video/background_segm.hpp>
+#include <nlohmann/json.hpp>
+#include <chrono>
+#include <vector>
+
+namespace SnowOwl::Server::Modules::Detection {
+
+// Mirrors detection.motion.parameters in config/detection_config.json
+struct MotionGateConfig {
+    bool enabled{true};
+    int historyLength{500};
+    double learningRate{0.01};
+    double varianceThreshold{16.0};
+    bool detectShadows{true};
+    double shadowThreshold{0.5};
+    // Smallest blob, in full-resolution pixels, that counts as motion
+    double minArea{200.0};
+    int dilationSize{3};
+    int erosionSize{2};
+    // Width the frame is reduced to before background subtraction
+    int analysisWidth{320};
+    // Run the gated detectors at least this often even without motion
+    std::chrono::milliseconds keepAlive{5000};
+
+    // Accepts either the "motion" object or its "parameters" member
+    static MotionGateConfig fromJson(const nlohmann::json& motion);
+};
+
+struct MotionGateResult {
+    bool motion{false};
+    bool keepAlive{false};
+    // Moving regions in full-resolution frame coordinates
+    std::vector<cv::Rect> regions;
+
+    bool shouldInfer() const { return motion || keepAlive; }
+};
+
+// Cheap prefilter in front of the expensive detectors: background subtraction
+// on a downscaled grey copy of the frame, cleaned up and reduced to bounding
+// boxes. A quiet scene only reaches the model on the keep-alive interval.
+class MotionGate {
+public:
+    explicit MotionGate(const MotionGateConfig& config = {});
+
+    void configure(const MotionGateConfig& config);
+    const MotionGateConfig& config() const { return config_; }
+
+    MotionGateResult evaluate(const cv::Mat& frame);
+    void reset();
+
+private:
+    MotionGateConfig config_;
+    cv::Ptr<cv::BackgroundSubtractorMOG2> subtractor_;
+    cv::Mat small_;
+    cv::Mat grey_;
+    cv::Mat mask_;
+    cv::Mat erodeKernel_;
+    cv::Mat dilateKernel_;
+    std::vector<std::vector<cv::Point>> contours_;
+    std::chrono::steady_clock::time_point lastInference_{};
+};
+
+}
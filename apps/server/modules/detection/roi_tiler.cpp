@@ -0,0 +1,153 @@
+#include "roi_tiler.hpp"
+
+#include <algorithm>
+
+namespace SnowOwl::Server::Modules::Detection {
+
+namespace {
+
+// Fraction of the smaller box that has to be covered for two boxes to count
+// as one object cut by a tile border
+constexpr double kContainmentThreshold = 0.7;
+
+int clampOrigin(int centre, int extent, int limit) {
+    return std::max(0, std::min(centre - extent / 2, limit - extent));
+}
+
+// Evenly spaced tile origins covering [start, start + length) with overlap
+std::vector<int> tileOrigins(int start, int length, int tile, int limit) {
+    std::vector<int> origins;
+    if (length <= tile) {
+        origins.push_back(clampOrigin(start + length / 2, tile, limit));
+        return origins;
+    }
+
+    const int overlap = tile / 4;
+    const int stride = tile - overlap;
+    const int count = 1 + (length - tile + stride - 1) / stride;
+    for (int i = 0; i < count; ++i) {
+        const int origin = start + static_cast<int>(static_cast<long long>(length - tile) * i / (count - 1));
+        origins.push_back(std::max(0, std::min(origin, limit - tile)));
+    }
+    return origins;
+}
+
+}
+
+std::vector<cv::Rect> planTiles(const std::vector<cv::Rect>& regions,
+                                const cv::Size& frameSize,
+                                const cv::Size& tileSize,
+                                const RoiTilingOptions& options) {
+    const cv::Rect frame(0, 0, frameSize.width, frameSize.height);
+    if (frame.area() <= 0) {
+        return {};
+    }
+
+    const cv::Size tile(std::min(tileSize.width, frame.width), std::min(tileSize.height, frame.height));
+    if (regions.empty() || tile.width <= 0 || tile.height <= 0
+        || (tile.width == frame.width && tile.height == frame.height)) {
+        return {frame};
+    }
+
+    std::vector<cv::Rect> merged;
+    merged.reserve(regions.size());
+    for (const auto& region : regions) {
+        const cv::Rect padded = cv::Rect(region.x - options.margin, region.y - options.margin,
+                                         region.width + 2 * options.margin,
+                                         region.height + 2 * options.margin) & frame;
+        if (padded.area() > 0) {
+            merged.push_back(padded);
+        }
+    }
+
+    // Merge boxes that overlap or would share a tile anyway
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (std::size_t i = 0; i < merged.size() && !changed; ++i) {
+            for (std::size_t j = i + 1; j < merged.size(); ++j) {
+                const cv::Rect combined = merged[i] | merged[j];
+                const bool overlapping = (merged[i] & merged[j]).area() > 0;
+                const bool fitsOneTile = combined.width <= tile.width && combined.height <= tile.height;
+                if (overlapping || fitsOneTile) {
+                    merged[i] = combined;
+                    merged.erase(merged.begin() + static_cast<std::ptrdiff_t>(j));
+                    changed = true;
+                    break;
+                }
+            }
+        }
+    }
+
+    std::vector<cv::Rect> tiles;
+    for (const auto& area : merged) {
+        for (const int y : tileOrigins(area.y, area.height, tile.height, frame.height)) {
+            for (const int x : tileOrigins(area.x, area.width, tile.width, frame.width)) {
+                const cv::Rect candidate(x, y, tile.width, tile.height);
+                const bool covered = std::any_of(tiles.begin(), tiles.end(), [&](const cv::Rect& existing) {
+                    return (existing & candidate) == candidate;
+                });
+                if (!covered) {
+                    tiles.push_back(candidate);
+                }
+            }
+        }
+    }
+
+    long long coveredArea = 0;
+    for (const auto& t : tiles) {
+        coveredArea += t.area();
+    }
+
+    if (tiles.empty() || tiles.size() > options.maxTiles
+        || coveredArea > options.maxCoverage * static_cast<double>(frame.area())) {
+        return {frame};
+    }
+
+    return tiles;
+}
+
+std::vector<DetectionResult> mergeTileDetections(const std::vector<cv::Rect>& tiles,
+                                                 std::vector<std::vector<DetectionResult>>& tileResults,
+                                                 float overlapThreshold) {
+    std::vector<DetectionResult> candidates;
+    for (std::size_t t = 0; t < tiles.size() && t < tileResults.size(); ++t) {
+        for (auto& detection : tileResults[t]) {
+            detection.boundingBox.x += tiles[t].x;
+            detection.boundingBox.y += tiles[t].y;
+            candidates.push_back(std::move(detection));
+        }
+    }
+
+    if (tiles.size() <= 1) {
+        return candidates;
+    }
+
+    std::sort(candidates.begin(), candidates.end(), [](const DetectionResult& a, const DetectionResult& b) {
+        return a.confidence > b.confidence;
+    });
+
+    std::vector<DetectionResult> kept;
+    for (auto& candidate : candidates) {
+        const cv::Rect& box = candidate.boundingBox;
+        const bool duplicate = std::any_of(kept.begin(), kept.end(), [&](const DetectionResult& other) {
+            if (other.type != candidate.type || other.description != candidate.description) {
+                return false;
+            }
+            const double overlap = (other.boundingBox & box).area();
+            if (overlap <= 0.0) {
+                return false;
+            }
+            const double unionArea = other.boundingBox.area() + box.area() - overlap;
+            const double smaller = std::min(other.boundingBox.area(), box.area());
+            return overlap / unionArea > overlapThreshold || overlap / smaller > kContainmentThreshold;
+        });
+        if (!duplicate) {
+            kept.push_back(std::move(candidate));
+        }
+    }
+
+    return kept;
+}
+
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <cstddef>
+#include <vector>
+
+#include "detector.hpp"
+
+namespace SnowOwl::Server::Modules::Detection {
+
+struct RoiTilingOptions {
+    // Context added around every motion box before merging
+    int margin{32};
+    // Beyond this many tiles a single full-frame pass is cheaper
+    std::size_t maxTiles{4};
+    // Likewise once the tiles would cover this fraction of the frame
+    double maxCoverage{0.6};
+};
+
+// Turns motion boxes into a few crop tiles of the model's input size, so the
+// detector sees moving areas at native resolution. Nearby boxes are merged;
+// areas larger than one tile are split into an overlapping grid. Returns a
+// single full-frame rect when tiling would not save work.
+std::vector<cv::Rect> planTiles(const std::vector<cv::Rect>& regions,
+                                const cv::Size& frameSize,
+                                const cv::Size& tileSize,
+                                const RoiTilingOptions& options = {});
+
+// Shifts per-tile detections into frame coordinates and drops duplicates of
+// objects seen by more than one tile, including boxes cut by a tile border.
+std::vector<DetectionResult> mergeTileDetections(const std::vector<cv::Rect>& tiles,
+                                                 std::vector<std::vector<DetectionResult>>& tileResults,
+                                                 float overlapThreshold);
+
+}
@@ -1,16 +1,67 @@
 #include "unified_detector.hpp"
+#include "roi_tiler.hpp"
+#include "yolo_output.hpp"
+#include "utils/allocation_counter.hpp"
 
+#include <algorithm>
+#include <cmath>
 #include <iostream>
+#include <numeric>
 #include <opencv2/imgproc.hpp>
-#include <opencv4/opencv2/dnn.hpp>
 
 #ifdef HAVE_ONNXRUNTIME
 #include <onnxruntime_cxx_api.h>
+#else
+// Complete types for the header's unique_ptr members, which stay null
+namespace Ort {
+class Env {};
+class Session {};
+}
 #endif
 
 namespace SnowOwl::Server::Modules::Detection {
 
-UnifiedDetector::UnifiedDetector() {
+using SnowOwl::Utils::Metrics::AllocationCounter;
+
+struct UnifiedDetector::IoState {
+#ifdef HAVE_ONNXRUNTIME
+    struct Slot {
+        Ort::Value input{nullptr};
+        Ort::Value output{nullptr};
+        std::unique_ptr<Ort::IoBinding> binding;
+    };
+
+    Ort::MemoryInfo memoryInfo{nullptr};
+    Ort::RunOptions runOptions{nullptr};
+    std::string inputName;
+    std::string outputName;
+
+    // Per-image output dims (batch dimension stripped)
+    std::vector<int64_t> outputDims;
+    size_t outputPerImage{0};
+    bool channelMajor{true};
+    bool outputBound{false};
+    std::vector<float> output;
+
+    // slots[n - 1] binds a batch of n frames; a model with a fixed batch
+    // dimension only gets the slot of that size
+    std::vector<Slot> slots;
+#endif
+};
+
+#ifdef HAVE_ONNXRUNTIME
+namespace {
+
+// YOLOv8 exports [84, anchors] per image; some exporters transpose to [anchors, 84]
+bool isChannelMajor(const std::vector<int64_t>& dims, int64_t channels) {
+    return !(dims.size() == 2 && dims[1] == channels && dims[0] != channels);
+}
+
+}
+#endif
+
+UnifiedDetector::UnifiedDetector(const InferenceOptions& options)
+    : options_(options) {
     // COCO dataset class names
     classNames_ = {
         "person", "bicycle", "car", "motorcycle", "airplane", "bus", "train", "truck", "boat",
@@ -52,7 +103,8 @@ void UnifiedDetector::initializeModel() {
     };
     
     Ort::SessionOptions session_options;
-    session_options.SetIntraOpNumThreads(1);
+    session_options.SetIntraOpNumThreads(std::max(1, options_.intraOpThreads));
+    session_options.SetInterOpNumThreads(std::max(1, options_.interOpThreads));
     session_options.SetGraphOptimizationLevel(GraphOptimizationLevel::ORT_ENABLE_EXTENDED);
     
     bool model_loaded = false;
@@ -71,166 +123,422 @@ void UnifiedDetector::initializeModel() {
     if (!model_loaded) {
         throw std::runtime_error("Failed to load YOLO model from any of the expected paths");
     }
+
+    // Models exported with a fixed batch dimension reject any other size, so
+    // every run uses exactly that many slots and short batches are padded
+    maxBatch_ = std::max<std::size_t>(1, options_.maxBatch);
+    fixedBatch_ = 0;
+    const auto inputShape = session_->GetInputTypeInfo(0).GetTensorTypeAndShapeInfo().GetShape();
+    if (!inputShape.empty() && inputShape.front() > 0) {
+        fixedBatch_ = static_cast<std::size_t>(inputShape.front());
+        if (fixedBatch_ != maxBatch_) {
+            std::cerr << "UnifiedDetector: model batch dimension is fixed at " << fixedBatch_
+                      << ", running every batch at that size" << std::endl;
+        }
+        maxBatch_ = fixedBatch_;
+    }
+
+    bindTensors();
 #else
     std::cerr << "ONNX Runtime not available. Unified detector will not function." << std::endl;
     throw std::runtime_error("ONNX Runtime not available");
 #endif
 }
 
+void UnifiedDetector::bindTensors() {
+#ifdef HAVE_ONNXRUNTIME
+    io_ = std::make_unique<IoState>();
+    io_->memoryInfo = Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault);
+
+    Ort::AllocatorWithDefaultOptions allocator;
+    io_->inputName = session_->GetInputNameAllocated(0, allocator).get();
+    io_->outputName = session_->GetOutputNameAllocated(0, allocator).get();
+
+    // A model with fixed spatial dims overrides the 640x640 default
+    const auto inputShape = session_->GetInputTypeInfo(0).GetTensorTypeAndShapeInfo().GetShape();
+    if (inputShape.size() == 4 && inputShape[2] > 0 && inputShape[3] > 0) {
+        inputHeight_ = static_cast<int>(inputShape[2]);
+        inputWidth_ = static_cast<int>(inputShape[3]);
+    }
+
+    const auto outputShape = session_->GetOutputTypeInfo(0).GetTensorTypeAndShapeInfo().GetShape();
+    if (!outputShape.empty()) {
+        io_->outputDims.assign(outputShape.begin() + 1, outputShape.end());
+    }
+    io_->outputBound = !io_->outputDims.empty()
+        && std::all_of(io_->outputDims.begin(), io_->outputDims.end(), [](int64_t dim) { return dim > 0; });
+    io_->channelMajor = isChannelMajor(io_->outputDims, static_cast<int64_t>(4 + classNames_.size()));
+
+    if (io_->outputBound) {
+        io_->outputPerImage = 1;
+        for (const auto dim : io_->outputDims) {
+            io_->outputPerImage *= static_cast<size_t>(dim);
+        }
+        io_->output.assign(maxBatch_ * io_->outputPerImage, 0.0f);
+    } else {
+        std::cerr << "UnifiedDetector: output " << io_->outputName
+                  << " has dynamic dimensions, outputs will be allocated per run" << std::endl;
+    }
+
+    // Every binding points into these buffers, so they are sized once and never grow
+    const size_t image_size = static_cast<size_t>(3) * inputHeight_ * inputWidth_;
+    batchInput_.assign(maxBatch_ * image_size, 0.0f);
+    letterboxes_.reserve(maxBatch_);
+
+    io_->slots.resize(maxBatch_);
+    for (size_t n = fixedBatch_ > 0 ? fixedBatch_ : 1; n <= maxBatch_; ++n) {
+        auto& slot = io_->slots[n - 1];
+
+        const int64_t input_shape[] = {static_cast<int64_t>(n), 3, inputHeight_, inputWidth_};
+        slot.input = Ort::Value::CreateTensor<float>(
+            io_->memoryInfo, batchInput_.data(), n * image_size, input_shape, 4);
+
+        slot.binding = std::make_unique<Ort::IoBinding>(*session_);
+        slot.binding->BindInput(io_->inputName.c_str(), slot.input);
+
+        if (io_->outputBound) {
+            std::vector<int64_t> output_shape{static_cast<int64_t>(n)};
+            output_shape.insert(output_shape.end(), io_->outputDims.begin(), io_->outputDims.end());
+            slot.output = Ort::Value::CreateTensor<float>(
+                io_->memoryInfo, io_->output.data(), n * io_->outputPerImage,
+                output_shape.data(), output_shape.size());
+            slot.binding->BindOutput(io_->outputName.c_str(), slot.output);
+        } else {
+            slot.binding->BindOutput(io_->outputName.c_str(), io_->memoryInfo);
+        }
+    }
+#endif
+}
+
 void UnifiedDetector::process(const cv::Mat& frame, std::vector<DetectionResult>& outResults) {
     if (!enabled_ || frame.empty()) {
         return;
     }
-    
+
+    std::vector<DetectionResult>* output = &outResults;
+    processBatch(&frame, &output, 1);
+}
+
+void UnifiedDetector::processRegions(const cv::Mat& frame, const std::vector<cv::Rect>& regions,
+                                     std::vector<DetectionResult>& outResults) {
+    if (!enabled_ || frame.empty()) {
+        return;
+    }
+
+    // Counted as one frame, together with the tile planning and merging
+    AllocationCounter counter;
+    const auto tiles = planTiles(regions, frame.size(), inputSize());
+    if (tiles.size() == 1 && tiles.front().size() == frame.size()) {
+        std::vector<DetectionResult>* output = &outResults;
+        inferBatches(&frame, &output, 1);
+        recordAllocations(counter.count(), 1);
+        return;
+    }
+
+    // Tiles are views into the frame; preprocessing reads them row by row.
+    // The per-tile buffers keep their capacity from one frame to the next.
+    if (tileResults_.size() < tiles.size()) {
+        tileResults_.resize(tiles.size());
+    }
+    crops_.clear();
+    tileOutputs_.clear();
+    for (size_t i = 0; i < tiles.size(); ++i) {
+        tileResults_[i].clear();
+        crops_.push_back(frame(tiles[i]));
+        tileOutputs_.push_back(&tileResults_[i]);
+    }
+
+    inferBatches(crops_.data(), tileOutputs_.data(), tiles.size());
+
+    auto merged = mergeTileDetections(tiles, tileResults_, nmsThreshold_);
+    outResults.insert(outResults.end(), merged.begin(), merged.end());
+    recordAllocations(counter.count(), 1);
+}
+
+void UnifiedDetector::processBatch(const std::vector<cv::Mat>& frames,
+                                   const std::vector<std::vector<DetectionResult>*>& outResults) {
+    if (frames.size() != outResults.size()) {
+        return;
+    }
+    processBatch(frames.data(), outResults.data(), frames.size());
+}
+
+void UnifiedDetector::processBatch(const cv::Mat* frames, std::vector<DetectionResult>* const* outResults,
+                                   std::size_t count) {
+    if (!enabled_ || !frames || !outResults || count == 0) {
+        return;
+    }
+
+    AllocationCounter counter;
+    inferBatches(frames, outResults, count);
+    recordAllocations(counter.count(), count);
+}
+
+void UnifiedDetector::recordAllocations(std::uint64_t allocations, std::size_t frames) {
+    allocations_ += allocations;
+    frames_ += frames;
+    lastAllocationsPerFrame_ = static_cast<double>(allocations) / frames;
+}
+
+void UnifiedDetector::inferBatches(const cv::Mat* frames, std::vector<DetectionResult>* const* outResults,
+                                   std::size_t count) {
 #ifdef HAVE_ONNXRUNTIME
-    if (!session_) {
+    if (!session_ || !io_) {
         return;
     }
 
-    // Preprocess the image
-    cv::Mat processedImage = preprocessImage(frame);
+    const size_t image_size = static_cast<size_t>(3) * inputHeight_ * inputWidth_;
+    const int64_t channels = static_cast<int64_t>(4 + classNames_.size());
 
-    // Prepare input tensor
-    std::vector<int64_t> input_shape = {1, 3, inputHeight_, inputWidth_};
-    size_t input_tensor_size = 1 * 3 * inputHeight_ * inputWidth_;
+    for (size_t begin = 0; begin < count; begin += maxBatch_) {
+        const size_t end = std::min(count, begin + maxBatch_);
+        const size_t batch = end - begin;
+        // Padding slots past batch stay zeroed and their outputs are ignored
+        const size_t runBatch = fixedBatch_ > 0 ? fixedBatch_ : batch;
 
-    auto memory_info = Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault);
-    Ort::Value input_tensor = Ort::Value::CreateTensor<float>(
-        memory_info, 
-        (float*)processedImage.data, 
-        input_tensor_size, 
-        input_shape.data(), 
-        input_shape.size()
-    );
+        // Preprocess the frames back to back into the bound {N,3,H,W} input;
+        // empty or unconvertible frames keep a zeroed slot so indices line up
+        // with outResults, and their detections are dropped
+        letterboxes_.assign(runBatch, Letterbox{});
+        for (size_t i = begin; i < end; ++i) {
+            float* slot = batchInput_.data() + (i - begin) * image_size;
+            if (frames[i].empty()) {
+                std::fill(slot, slot + image_size, 0.0f);
+                continue;
+            }
+            letterboxes_[i - begin] = preprocessInto(frames[i], slot);
+            if (!letterboxes_[i - begin].valid) {
+                std::fill(slot, slot + image_size, 0.0f);
+            }
+        }
+        std::fill(batchInput_.data() + batch * image_size, batchInput_.data() + runBatch * image_size, 0.0f);
 
-    // Define input and output names
-    const char* input_names[] = {"images"};
-    const char* output_names[] = {"output0"};
+        auto& binding = *io_->slots[runBatch - 1].binding;
+        try {
+            session_->Run(io_->runOptions, binding);
+        } catch (const Ort::Exception& e) {
+            std::cerr << "UnifiedDetector: inference failed for a batch of " << runBatch << ": " << e.what() << std::endl;
+            continue;
+        }
 
-    // Run inference
-    auto output_tensors = session_->Run(
-        Ort::RunOptions{nullptr}, 
-        input_names, 
-        &input_tensor, 
-        1, 
-        output_names, 
-        1
-    );
+        const float* floatarr = io_->output.data();
+        size_t per_image = io_->outputPerImage;
+        bool channel_major = io_->channelMajor;
 
-    // Process output
-    if (!output_tensors.empty()) {
-        auto& output_tensor = output_tensors.front();
-        std::vector<float> output_data;
+        std::vector<Ort::Value> runtime_outputs;
+        if (!io_->outputBound) {
+            runtime_outputs = binding.GetOutputValues();
+            if (runtime_outputs.empty()) {
+                continue;
+            }
 
-        float* floatarr = output_tensor.GetTensorMutableData<float>();
-        size_t output_count = output_tensor.GetTensorTypeAndShapeInfo().GetElementCount();
-        output_data.assign(floatarr, floatarr + output_count);
+            const auto output_info = runtime_outputs.front().GetTensorTypeAndShapeInfo();
+            const auto output_shape = output_info.GetShape();
+            floatarr = runtime_outputs.front().GetTensorData<float>();
+            per_image = output_info.GetElementCount() / runBatch;
+            channel_major = isChannelMajor(
+                std::vector<int64_t>(output_shape.begin() + (output_shape.empty() ? 0 : 1), output_shape.end()),
+                channels);
+        }
 
-        // Post-process detections
-        std::vector<DetectionResult> detections = postprocessDetections(output_data, frame.size());
+        // Scatter: each image owns an equal slice of the output
+        const size_t anchors = per_image / static_cast<size_t>(channels);
+        for (size_t i = begin; i < end; ++i) {
+            if (!letterboxes_[i - begin].valid || !outResults[i]) {
+                continue;
+            }
 
-        // Add detections to output
-        outResults.insert(outResults.end(), detections.begin(), detections.end());
+            postprocessDetections(floatarr + (i - begin) * per_image, anchors, channel_major,
+                                  letterboxes_[i - begin], frames[i].size(), *outResults[i]);
+        }
     }
 #endif
 }
 
-cv::Mat UnifiedDetector::preprocessImage(const cv::Mat& image) {
-    cv::Mat resizedImage;
-    cv::resize(image, resizedImage, cv::Size(inputWidth_, inputHeight_));
+UnifiedDetector::Letterbox UnifiedDetector::preprocessInto(const cv::Mat& image, float* tensor) {
+    cv::Mat source = image;
+    if (image.type() != CV_8UC3) {
+        if (image.type() == CV_8UC1) {
+            cv::cvtColor(image, source, cv::COLOR_GRAY2BGR);
+        } else if (image.type() == CV_8UC4) {
+            cv::cvtColor(image, source, cv::COLOR_BGRA2BGR);
+        } else {
+            image.convertTo(source, CV_8U);
+            if (source.channels() != 3) {
+                return Letterbox{};
+            }
+        }
+    }
 
-    // Convert BGR to RGB
-    cv::cvtColor(resizedImage, resizedImage, cv::COLOR_BGR2RGB);
+    const int src_width = source.cols;
+    const int src_height = source.rows;
 
-    // Normalize to [0,1]
-    cv::Mat floatImage;
-    resizedImage.convertTo(floatImage, CV_32F, 1.0 / 255.0);
+    // Fit the longer side, keep the aspect ratio and centre the image
+    Letterbox letterbox;
+    letterbox.scale = std::min(static_cast<float>(inputWidth_) / src_width,
+                               static_cast<float>(inputHeight_) / src_height);
+    const int new_width = std::max(1, std::min(inputWidth_, static_cast<int>(std::lround(src_width * letterbox.scale))));
+    const int new_height = std::max(1, std::min(inputHeight_, static_cast<int>(std::lround(src_height * letterbox.scale))));
+    const int pad_x = (inputWidth_ - new_width) / 2;
+    const int pad_y = (inputHeight_ - new_height) / 2;
+    letterbox.padX = static_cast<float>(pad_x);
+    letterbox.padY = static_cast<float>(pad_y);
+    letterbox.valid = true;
 
-    // Create blob from image
-    cv::Mat blob;
-    cv::dnn::blobFromImage(floatImage, blob);
-    
-    return blob;
-}
+    // Bilinear taps along x are the same for every row (half-pixel centres, as cv::INTER_LINEAR)
+    if (tapSourceWidth_ != src_width || tapTargetWidth_ != new_width) {
+        tapLeft_.resize(new_width);
+        tapRight_.resize(new_width);
+        tapWeight_.resize(new_width);
+        const float ratio = static_cast<float>(src_width) / new_width;
+        for (int x = 0; x < new_width; ++x) {
+            const float sx = std::max(0.0f, (x + 0.5f) * ratio - 0.5f);
+            const int x0 = std::min(static_cast<int>(sx), src_width - 1);
+            const int x1 = std::min(x0 + 1, src_width - 1);
+            tapLeft_[x] = x0 * 3;
+            tapRight_[x] = x1 * 3;
+            tapWeight_[x] = sx - x0;
+        }
+        tapSourceWidth_ = src_width;
+        tapTargetWidth_ = new_width;
+    }
 
-std::vector<DetectionResult> UnifiedDetector::postprocessDetections(
-    const std::vector<float>& output, 
-    const cv::Size& originalSize) {
-    std::vector<DetectionResult> detections;
-    
-#ifdef HAVE_ONNXRUNTIME
-    const int num_classes = classNames_.size();
-    const int num_detections = output.size() / (4 + num_classes);
-    
-    std::vector<cv::Rect> boxes;
-    std::vector<float> confidences;
-    std::vector<int> class_ids;
-    
-    for (int i = 0; i < num_detections; ++i) {
-        // Extract class scores
-        std::vector<float> scores;
-        for (int c = 0; c < num_classes; ++c) {
-            scores.push_back(output[i * (4 + num_classes) + 4 + c]);
+    constexpr float kNorm = 1.0f / 255.0f;
+    constexpr float kPad = 114.0f / 255.0f;
+    const size_t plane = static_cast<size_t>(inputWidth_) * inputHeight_;
+    float* red = tensor;
+    float* green = tensor + plane;
+    float* blue = tensor + 2 * plane;
+    const float ratio_y = static_cast<float>(src_height) / new_height;
+
+    for (int y = 0; y < inputHeight_; ++y) {
+        const size_t row = static_cast<size_t>(y) * inputWidth_;
+        float* r = red + row;
+        float* g = green + row;
+        float* b = blue + row;
+
+        if (y < pad_y || y >= pad_y + new_height) {
+            std::fill(r, r + inputWidth_, kPad);
+            std::fill(g, g + inputWidth_, kPad);
+            std::fill(b, b + inputWidth_, kPad);
+            continue;
         }
 
-        // Find the class with the highest score
-        auto max_score_it = std::max_element(scores.begin(), scores.end());
-        float max_score = *max_score_it;
-        int class_id = std::distance(scores.begin(), max_score_it);
-
-        // Filter by confidence threshold
-        if (max_score > confidenceThreshold_) {
-            // Extract bounding box coordinates
-            float x = output[i * (4 + num_classes) + 0];
-            float y = output[i * (4 + num_classes) + 1];
-            float w = output[i * (4 + num_classes) + 2];
-            float h = output[i * (4 + num_classes) + 3];
-
-            // Convert to pixel coordinates
-            int left = (int)((x - w / 2) * originalSize.width / inputWidth_);
-            int top = (int)((y - h / 2) * originalSize.height / inputHeight_);
-            int width = (int)(w * originalSize.width / inputWidth_);
-            int height = (int)(h * originalSize.height / inputHeight_);
-            
-            // Ensure bounding box is within image bounds
-            left = std::max(0, std::min(left, originalSize.width - 1));
-            top = std::max(0, std::min(top, originalSize.height - 1));
-            width = std::max(1, std::min(width, originalSize.width - left));
-            height = std::max(1, std::min(height, originalSize.height - top));
-
-            boxes.emplace_back(left, top, width, height);
-            confidences.push_back(max_score);
-            class_ids.push_back(class_id);
+        std::fill(r, r + pad_x, kPad);
+        std::fill(g, g + pad_x, kPad);
+        std::fill(b, b + pad_x, kPad);
+        std::fill(r + pad_x + new_width, r + inputWidth_, kPad);
+        std::fill(g + pad_x + new_width, g + inputWidth_, kPad);
+        std::fill(b + pad_x + new_width, b + inputWidth_, kPad);
+
+        const float sy = std::max(0.0f, (y - pad_y + 0.5f) * ratio_y - 0.5f);
+        const int y0 = std::min(static_cast<int>(sy), src_height - 1);
+        const int y1 = std::min(y0 + 1, src_height - 1);
+        const float wy = sy - y0;
+        const uchar* top = source.ptr<uchar>(y0);
+        const uchar* bottom = source.ptr<uchar>(y1);
+
+        r += pad_x;
+        g += pad_x;
+        b += pad_x;
+        for (int x = 0; x < new_width; ++x) {
+            const int left = tapLeft_[x];
+            const int right = tapRight_[x];
+            const float wx = tapWeight_[x];
+
+            float px[3];
+            for (int c = 0; c < 3; ++c) {
+                const float upper = top[left + c] + (top[right + c] - top[left + c]) * wx;
+                const float lower = bottom[left + c] + (bottom[right + c] - bottom[left + c]) * wx;
+                px[c] = (upper + (lower - upper) * wy) * kNorm;
+            }
+
+            // BGR in, planar RGB out
+            b[x] = px[0];
+            g[x] = px[1];
+            r[x] = px[2];
         }
     }
+
+    return letterbox;
+}
+
+void UnifiedDetector::postprocessDetections(
+    const float* output, 
+    size_t anchors,
+    bool channelMajor,
+    const Letterbox& letterbox,
+    const cv::Size& originalSize,
+    std::vector<DetectionResult>& out) {
+#ifdef HAVE_ONNXRUNTIME
+    const size_t num_classes = classNames_.size();
+    if (!output || anchors == 0 || num_classes == 0) {
+        return;
+    }
+
+    boxes_.clear();
+    confidences_.clear();
+    classIds_.clear();
+
+    const float inv_scale = letterbox.scale > 0.0f ? 1.0f / letterbox.scale : 1.0f;
+
+    auto addCandidate = [&](float x, float y, float w, float h, float score, int class_id) {
+        // Undo the letterbox: remove the padding, then the resize
+        int left = static_cast<int>((x - w / 2 - letterbox.padX) * inv_scale);
+        int top = static_cast<int>((y - h / 2 - letterbox.padY) * inv_scale);
+        int width = static_cast<int>(w * inv_scale);
+        int height = static_cast<int>(h * inv_scale);
+
+        // Ensure bounding box is within image bounds
+        left = std::max(0, std::min(left, originalSize.width - 1));
+        top = std::max(0, std::min(top, originalSize.height - 1));
+        width = std::max(1, std::min(width, originalSize.width - left));
+        height = std::max(1, std::min(height, originalSize.height - top));
+
+        boxes_.emplace_back(left, top, width, height);
+        confidences_.push_back(score);
+        classIds_.push_back(class_id);
+    };
+
+    scanYoloOutput(output, anchors, num_classes, channelMajor, confidenceThreshold_,
+                   bestScores_, bestClasses_, addCandidate);
     
     // Apply Non-Maximum Suppression
-    std::vector<int> indices = applyNMS(boxes, confidences);
+    applyNMS();
     
     // Create detection results
-    for (int idx : indices) {
-        DetectionResult result;
-        result.type = mapClassToDetectionType(classNames_[class_ids[idx]]);
-        result.boundingBox = boxes[idx];
-        result.confidence = confidences[idx];
-        result.description = classNames_[class_ids[idx]];
-        detections.push_back(result);
+    for (int idx : nmsIndices_) {
+        const std::string& name = classNames_[classIds_[idx]];
+        DetectionResult& result = out.emplace_back();
+        result.type = mapClassToDetectionType(name);
+        result.boundingBox = boxes_[idx];
+        result.confidence = confidences_[idx];
+        result.description = name;
     }
 #endif
-    
-    return detections;
 }
 
-std::vector<int> UnifiedDetector::applyNMS(
-    const std::vector<cv::Rect>& boxes, 
-    const std::vector<float>& scores) {
-    std::vector<int> indices;
-    
-#ifdef HAVE_ONNXRUNTIME
-    cv::dnn::NMSBoxes(boxes, scores, confidenceThreshold_, nmsThreshold_, indices);
-#endif
-    
-    return indices;
+void UnifiedDetector::applyNMS() {
+    nmsIndices_.clear();
+    nmsOrder_.resize(boxes_.size());
+    std::iota(nmsOrder_.begin(), nmsOrder_.end(), 0);
+    // Ties keep their original order, as the stable sort in NMSBoxes does
+    std::sort(nmsOrder_.begin(), nmsOrder_.end(), [this](int a, int b) {
+        return confidences_[a] > confidences_[b] || (confidences_[a] == confidences_[b] && a < b);
+    });
+
+    for (const int candidate : nmsOrder_) {
+        const cv::Rect& box = boxes_[candidate];
+        const bool suppressed = std::any_of(nmsIndices_.begin(), nmsIndices_.end(), [&](int kept) {
+            const cv::Rect& other = boxes_[kept];
+            const double overlap = (box & other).area();
+            const double unionArea = box.area() + other.area() - overlap;
+            return unionArea > 0.0 && overlap / unionArea > nmsThreshold_;
+        });
+        if (!suppressed) {
+            nmsIndices_.push_back(candidate);
+        }
+    }
 }
 
 DetectionType UnifiedDetector::mapClassToDetectionType(const std::string& className) const {
@@ -1,23 +1,37 @@
 #pragma once
 
 #include <opencv2/core.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
 #include <vector>
 #include <memory>
 
 #include "detector.hpp"
 
-#ifdef HAVE_ONNXRUNTIME
+// Declared unconditionally: HAVE_ONNXRUNTIME is private to the detector
+// library, and the class layout must not depend on who includes this header
 namespace Ort {
 class Env;
 class Session;
 }
-#endif
 
 namespace SnowOwl::Server::Modules::Detection {
 
+struct InferenceOptions {
+    int intraOpThreads{1};
+    int interOpThreads{1};
+    // Frames from different streams folded into one Run(); 1 disables batching
+    std::size_t maxBatch{1};
+    // How long the first queued frame may wait for the batch to fill
+    std::chrono::milliseconds maxWait{5};
+};
+
 class UnifiedDetector : public IDetector {
 public:
-    UnifiedDetector();
+    explicit UnifiedDetector(const InferenceOptions& options = {});
     ~UnifiedDetector();
 
     // Return a general detection type since this detector can detect multiple types
@@ -25,15 +39,86 @@ public:
     bool enabled() const override { return enabled_; }
     void setEnabled(bool enabled) override { enabled_ = enabled; }
     void process(const cv::Mat& frame, std::vector<DetectionResult>& outResults) override;
+    bool gatedByMotion() const override { return true; }
+
+    // Crops tiles of the model input size around the regions and runs them at
+    // native resolution; falls back to the whole frame when that is cheaper.
+    void processRegions(const cv::Mat& frame, const std::vector<cv::Rect>& regions,
+                        std::vector<DetectionResult>& outResults) override;
+
+    // Runs the frames through the model in batches of at most maxBatch() and
+    // appends each frame's detections to the matching outResults entry.
+    void processBatch(const std::vector<cv::Mat>& frames,
+                      const std::vector<std::vector<DetectionResult>*>& outResults);
+    // Same over count frames, without building the vectors
+    void processBatch(const cv::Mat* frames, std::vector<DetectionResult>* const* outResults,
+                      std::size_t count);
+
+    // Largest batch per run: the configured maxBatch, or the model's fixed
+    // batch dimension, which shorter batches are zero-padded up to
+    std::size_t maxBatch() const { return maxBatch_; }
+    cv::Size inputSize() const { return cv::Size(inputWidth_, inputHeight_); }
+    float overlapThreshold() const { return nmsThreshold_; }
+
+    // operator new calls made on the calling thread by processBatch, process
+    // and processRegions, including OpenCV and ONNX Runtime internals and
+    // the tile planning. Once warm the per-frame figure should stay at zero.
+    double allocationsPerFrame() const { return lastAllocationsPerFrame_.load(); }
+    std::uint64_t inferenceAllocations() const { return allocations_.load(); }
+    std::uint64_t framesInferred() const { return frames_.load(); }
 
 private:
     bool enabled_{false};
+    InferenceOptions options_;
+    std::size_t maxBatch_{1};
+    // Batch dimension the model was exported with; 0 when it is dynamic
+    std::size_t fixedBatch_{0};
     
-#ifdef HAVE_ONNXRUNTIME
     std::unique_ptr<Ort::Env> env_;
     std::unique_ptr<Ort::Session> session_;
-#endif
+
+    // Bound input/output tensors, one binding per batch size
+    struct IoState;
+    std::unique_ptr<IoState> io_;
+
+    std::atomic<std::uint64_t> allocations_{0};
+    std::atomic<std::uint64_t> frames_{0};
+    std::atomic<double> lastAllocationsPerFrame_{0.0};
     
+    // Maps model input coordinates back to the source frame
+    struct Letterbox {
+        float scale{1.0f};
+        float padX{0.0f};
+        float padY{0.0f};
+        // False when the frame could not be converted; its slot is zeroed
+        // and its detections must be dropped
+        bool valid{false};
+    };
+
+    std::vector<float> batchInput_;
+    std::vector<Letterbox> letterboxes_;
+
+    // Horizontal resize taps, rebuilt only when the source width changes
+    std::vector<int> tapLeft_;
+    std::vector<int> tapRight_;
+    std::vector<float> tapWeight_;
+    int tapSourceWidth_{0};
+    int tapTargetWidth_{0};
+
+    // Postprocess scratch, reused across frames
+    std::vector<float> bestScores_;
+    std::vector<int> bestClasses_;
+    std::vector<cv::Rect> boxes_;
+    std::vector<float> confidences_;
+    std::vector<int> classIds_;
+    std::vector<int> nmsOrder_;
+    std::vector<int> nmsIndices_;
+
+    // processRegions scratch
+    std::vector<cv::Mat> crops_;
+    std::vector<std::vector<DetectionResult>> tileResults_;
+    std::vector<std::vector<DetectionResult>*> tileOutputs_;
+
     int inputWidth_ = 640;
     int inputHeight_ = 640;
     float confidenceThreshold_ = 0.5f;
@@ -42,13 +127,26 @@ private:
     std::vector<std::string> classNames_;
     
     void initializeModel();
-    cv::Mat preprocessImage(const cv::Mat& image);
-    std::vector<DetectionResult> postprocessDetections(
-        const std::vector<float>& output, 
-        const cv::Size& originalSize);
-    std::vector<int> applyNMS(
-        const std::vector<cv::Rect>& boxes, 
-        const std::vector<float>& scores);
+    void bindTensors();
+    // processBatch without the allocation accounting
+    void inferBatches(const cv::Mat* frames, std::vector<DetectionResult>* const* outResults,
+                      std::size_t count);
+    void recordAllocations(std::uint64_t allocations, std::size_t frames);
+    // Letterboxes the BGR frame into the model input and writes it as
+    // normalised planar RGB straight into tensor, in one pass.
+    Letterbox preprocessInto(const cv::Mat& image, float* tensor);
+    // Reads one image's slice of the output tensor in place and appends its
+    // detections to out. channelMajor is the YOLOv8 export layout
+    // [4 + classes, anchors]; otherwise [anchors, 4 + classes].
+    void postprocessDetections(
+        const float* output, 
+        size_t anchors,
+        bool channelMajor,
+        const Letterbox& letterbox,
+        const cv::Size& originalSize,
+        std::vector<DetectionResult>& out);
+    // Greedy NMS over boxes_/confidences_ into nmsIndices_, like cv::dnn::NMSBoxes
+    void applyNMS();
         
     DetectionType mapClassToDetectionType(const std::string& className) const;
 };
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace SnowOwl::Server::Modules::Detection {
+
+// Reads one image's slice of a YOLO output tensor in place and calls
+// emit(x, y, w, h, score, classId) for every anchor whose best class score
+// is above threshold. channelMajor is the YOLOv8 export layout
+// [4 + classes, anchors]; otherwise [anchors, 4 + classes]. bestScores and
+// bestClasses are scratch that keeps its capacity between calls.
+template <typename Emit>
+void scanYoloOutput(const float* output, std::size_t anchors, std::size_t numClasses, bool channelMajor,
+                    float threshold, std::vector<float>& bestScores, std::vector<int>& bestClasses,
+                    Emit&& emit) {
+    if (!output || anchors == 0 || numClasses == 0) {
+        return;
+    }
+
+    if (channelMajor) {
+        // Each class is a contiguous row over all anchors, so the argmax is a
+        // running max across rows; the branchless inner loop vectorises
+        bestScores.assign(output + 4 * anchors, output + 5 * anchors);
+        bestClasses.assign(anchors, 0);
+        float* best = bestScores.data();
+        int* best_class = bestClasses.data();
+
+        for (std::size_t c = 1; c < numClasses; ++c) {
+            const float* row = output + (4 + c) * anchors;
+            const int class_id = static_cast<int>(c);
+            for (std::size_t a = 0; a < anchors; ++a) {
+                const bool higher = row[a] > best[a];
+                best[a] = higher ? row[a] : best[a];
+                best_class[a] = higher ? class_id : best_class[a];
+            }
+        }
+
+        const float* xs = output;
+        const float* ys = output + anchors;
+        const float* ws = output + 2 * anchors;
+        const float* hs = output + 3 * anchors;
+        for (std::size_t a = 0; a < anchors; ++a) {
+            if (best[a] > threshold) {
+                emit(xs[a], ys[a], ws[a], hs[a], best[a], best_class[a]);
+            }
+        }
+        return;
+    }
+
+    // Anchor-major: the class scores of one anchor are contiguous
+    const std::size_t channels = 4 + numClasses;
+    for (std::size_t a = 0; a < anchors; ++a) {
+        const float* row = output + a * channels;
+        const float* scores = row + 4;
+
+        float max_score = scores[0];
+        int class_id = 0;
+        for (std::size_t c = 1; c < numClasses; ++c) {
+            if (scores[c] > max_score) {
+                max_score = scores[c];
+                class_id = static_cast<int>(c);
+            }
+        }
+
+        if (max_score > threshold) {
+            emit(row[0], row[1], row[2], row[3], max_score, class_id);
+        }
+    }
+}
+
+}
@@ -2,12 +2,87 @@
 #include <algorithm>
 #include <array>
 #include <iostream>
+#include <optional>
 #include <nlohmann/json.hpp>
 
+#include "core/streams/capture_worker_pool.hpp"
+#include "modules/ingest/video_packet_decoder.hpp"
+
 namespace SnowOwl::Modules::Ingest {
 
 namespace {
 
+// Larger messages are treated as a corrupt stream and close the connection
+constexpr std::uint32_t kMaxPayloadBytes = 32 * 1024 * 1024;
+constexpr std::size_t kMaxPooledBuffers = 32;
+constexpr std::size_t kMaxPooledCapacity = 8 * 1024 * 1024;
+
+SnowOwl::Server::Core::CaptureWorkerPool& decodePool()
+{
+    static SnowOwl::Server::Core::CaptureWorkerPool pool;
+    return pool;
+}
+
+// Reads the frame size from the JPEG's SOF segment without decoding
+bool jpegDimensions(const std::vector<std::uint8_t>& data, int& width, int& height)
+{
+    std::size_t pos = 2;
+    if (data.size() < 4 || data[0] != 0xFF || data[1] != 0xD8) {
+        return false;
+    }
+
+    while (pos + 4 <= data.size()) {
+        if (data[pos] != 0xFF) {
+            return false;
+        }
+        const std::uint8_t marker = data[pos + 1];
+        if (marker == 0xFF) {
+            ++pos;
+            continue;
+        }
+        if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7)) {
+            pos += 2;
+            continue;
+        }
+
+        const std::size_t length = (static_cast<std::size_t>(data[pos + 2]) << 8) | data[pos + 3];
+        const bool startOfFrame = marker >= 0xC0 && marker <= 0xCF
+            && marker != 0xC4 && marker != 0xC8 && marker != 0xCC;
+        if (startOfFrame) {
+            if (pos + 9 > data.size()) {
+                return false;
+            }
+            height = (data[pos + 5] << 8) | data[pos + 6];
+            width = (data[pos + 7] << 8) | data[pos + 8];
+            return width > 0 && height > 0;
+        }
+        pos += 2 + length;
+    }
+    return false;
+}
+
+// Largest libjpeg DCT scaling that keeps the long side at or above target
+int decodeFlags(const std::vector<std::uint8_t>& payload, int target)
+{
+    int width = 0;
+    int height = 0;
+    if (target <= 0 || !jpegDimensions(payload, width, height)) {
+        return cv::IMREAD_COLOR;
+    }
+
+    const int longSide = std::max(width, height);
+    if (longSide / 8 >= target) {
+        return cv::IMREAD_REDUCED_COLOR_8;
+    }
+    if (longSide / 4 >= target) {
+        return cv::IMREAD_REDUCED_COLOR_4;
+    }
+    if (longSide / 2 >= target) {
+        return cv::IMREAD_REDUCED_COLOR_2;
+    }
+    return cv::IMREAD_COLOR;
+}
+
 std::string safeDeviceId(const nlohmann::json& payload)
 {
     if (payload.contains("device_id") && payload["device_id"].is_string()) {
@@ -18,6 +93,193 @@ std::string safeDeviceId(const nlohmann::json& payload)
 
 }
 
+class StreamReceiver::Connection : public std::enable_shared_from_this<Connection> {
+public:
+    Connection(StreamReceiver& owner, boost::asio::ip::tcp::socket socket)
+        : owner_(owner)
+        , socket_(std::move(socket))
+        , idleTimer_(socket_.get_executor())
+    {
+    }
+
+    void start()
+    {
+        boost::system::error_code ec;
+        const auto remote = socket_.remote_endpoint(ec);
+        if (!ec) {
+            std::cout << "StreamReceiver: client from " << remote << std::endl;
+        }
+
+        armIdleTimer();
+        readHeader();
+    }
+
+    // Safe from any thread
+    void close()
+    {
+        boost::asio::post(socket_.get_executor(), [self = shared_from_this()]() {
+            self->shutdown();
+        });
+    }
+
+    // Called from the decode pool once a frame of this connection is done
+    void onDecoded()
+    {
+        boost::asio::post(socket_.get_executor(), [self = shared_from_this()]() {
+            self->decoding_ = false;
+            if (self->queuedFrame_) {
+                auto payload = std::move(*self->queuedFrame_);
+                self->queuedFrame_.reset();
+                self->decode(self->queuedType_, std::move(payload));
+                self->readHeader();
+            }
+        });
+    }
+
+    // Only used by the single decode task in flight for this connection
+    VideoPacketDecoder& videoDecoder()
+    {
+        if (!videoDecoder_) {
+            videoDecoder_ = std::make_unique<VideoPacketDecoder>();
+        }
+        return *videoDecoder_;
+    }
+
+    std::string deviceId() const
+    {
+        std::lock_guard<std::mutex> lock(deviceMutex_);
+        return deviceId_;
+    }
+
+    void setDeviceId(std::string deviceId)
+    {
+        std::lock_guard<std::mutex> lock(deviceMutex_);
+        deviceId_ = std::move(deviceId);
+    }
+
+private:
+    void armIdleTimer()
+    {
+        idleTimer_.expires_after(owner_.idleTimeout_);
+        idleTimer_.async_wait([weak = weak_from_this()](const boost::system::error_code& ec) {
+            if (ec) {
+                return;
+            }
+            if (auto self = weak.lock()) {
+                std::cerr << "StreamReceiver: closing idle connection "
+                          << (self->deviceId().empty() ? std::string("unknown") : self->deviceId()) << std::endl;
+                self->shutdown();
+            }
+        });
+    }
+
+    void readHeader()
+    {
+        boost::asio::async_read(socket_, boost::asio::buffer(header_),
+            [self = shared_from_this()](const boost::system::error_code& ec, std::size_t) {
+                self->onHeader(ec);
+            });
+    }
+
+    void onHeader(const boost::system::error_code& ec)
+    {
+        if (ec) {
+            finish();
+            return;
+        }
+
+        type_ = static_cast<SnowOwl::Protocol::MessageType>(header_[0]);
+        const std::uint32_t length =
+            header_[1] | (static_cast<std::uint32_t>(header_[2]) << 8) |
+            (static_cast<std::uint32_t>(header_[3]) << 16) |
+            (static_cast<std::uint32_t>(header_[4]) << 24);
+        if (length > kMaxPayloadBytes) {
+            std::cerr << "StreamReceiver: message of " << length << " bytes exceeds limit, closing connection" << std::endl;
+            finish();
+            return;
+        }
+
+        payload_ = owner_.acquireBuffer();
+        payload_.resize(length);
+        boost::asio::async_read(socket_, boost::asio::buffer(payload_),
+            [self = shared_from_this()](const boost::system::error_code& readEc, std::size_t) {
+                self->onPayload(readEc);
+            });
+    }
+
+    void onPayload(const boost::system::error_code& ec)
+    {
+        if (ec) {
+            finish();
+            return;
+        }
+
+        armIdleTimer();
+
+        if (type_ == SnowOwl::Protocol::MessageType::Frame
+            || type_ == SnowOwl::Protocol::MessageType::VideoPacket) {
+            auto payload = std::move(payload_);
+            payload_ = {};
+            if (decoding_) {
+                // One frame decoding and one waiting; reading resumes in onDecoded
+                queuedFrame_ = std::move(payload);
+                queuedType_ = type_;
+                return;
+            }
+            decode(type_, std::move(payload));
+            readHeader();
+            return;
+        }
+
+        switch (type_) {
+        case SnowOwl::Protocol::MessageType::Control:
+            owner_.handleControl(*this, payload_);
+            break;
+        default:
+            break;
+        }
+
+        owner_.releaseBuffer(std::move(payload_));
+        payload_ = {};
+        readHeader();
+    }
+
+    void decode(SnowOwl::Protocol::MessageType type, std::vector<std::uint8_t> payload)
+    {
+        decoding_ = owner_.decodeFrame(shared_from_this(), type, std::move(payload));
+    }
+
+    void shutdown()
+    {
+        idleTimer_.cancel();
+        if (socket_.is_open()) {
+            boost::system::error_code ec;
+            socket_.shutdown(boost::asio::ip::tcp::socket::shutdown_both, ec);
+            socket_.close(ec);
+        }
+    }
+
+    void finish()
+    {
+        shutdown();
+        owner_.removeConnection(shared_from_this());
+    }
+
+    StreamReceiver& owner_;
+    boost::asio::ip::tcp::socket socket_;
+    boost::asio::steady_timer idleTimer_;
+    std::array<std::uint8_t, 5> header_{};
+    SnowOwl::Protocol::MessageType type_{SnowOwl::Protocol::MessageType::Control};
+    std::vector<std::uint8_t> payload_;
+    bool decoding_{false};
+    std::optional<std::vector<std::uint8_t>> queuedFrame_;
+    SnowOwl::Protocol::MessageType queuedType_{SnowOwl::Protocol::MessageType::Frame};
+    std::unique_ptr<VideoPacketDecoder> videoDecoder_;
+
+    mutable std::mutex deviceMutex_;
+    std::string deviceId_;
+};
+
 StreamReceiver::StreamReceiver() = default;
 
 StreamReceiver::~StreamReceiver()
@@ -33,22 +295,30 @@ bool StreamReceiver::start(std::uint16_t port)
 
     try {
         ioContext_ = std::make_unique<boost::asio::io_context>();
+        workGuard_ = std::make_unique<boost::asio::executor_work_guard<boost::asio::io_context::executor_type>>(
+            ioContext_->get_executor());
         acceptor_ = std::make_unique<boost::asio::ip::tcp::acceptor>(
             *ioContext_,
             boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), port));
 
         running_ = true;
-        acceptThread_ = std::thread([this]() {
-            try {
-                acceptLoop();
-                ioContext_->run();
-            } catch (const std::exception& ex) {
-                std::cerr << "StreamReceiver accept loop error: " << ex.what() << std::endl;
-            }
-        });
+        doAccept();
+
+        // A few threads serve every device; frames are decoded on them too
+        const unsigned threadCount = std::clamp(std::thread::hardware_concurrency() / 2, 1u, 4u);
+        for (unsigned i = 0; i < threadCount; ++i) {
+            workers_.emplace_back([this]() {
+                try {
+                    ioContext_->run();
+                } catch (const std::exception& ex) {
+                    std::cerr << "StreamReceiver io error: " << ex.what() << std::endl;
+                }
+            });
+        }
         return true;
     } catch (const std::exception& ex) {
         std::cerr << "StreamReceiver failed to start: " << ex.what() << std::endl;
+        running_ = true;
         stop();
         return false;
     }
@@ -60,38 +330,42 @@ void StreamReceiver::stop()
         return;
     }
 
-    if (acceptor_) {
-        boost::system::error_code ec;
-        acceptor_->close(ec);
+    {
+        std::lock_guard<std::mutex> lock(frameMutex_);
     }
+    frameCv_.notify_all();
 
-    if (ioContext_) {
-        ioContext_->stop();
+    if (acceptor_) {
+        boost::asio::post(*ioContext_, [this]() {
+            boost::system::error_code ec;
+            acceptor_->close(ec);
+        });
     }
 
     {
         std::lock_guard<std::mutex> lock(clientsMutex_);
         for (auto& client : clients_) {
-            client->running = false;
-            if (client->socket && client->socket->is_open()) {
-                boost::system::error_code ec;
-                client->socket->shutdown(boost::asio::ip::tcp::socket::shutdown_both, ec);
-                client->socket->close(ec);
-            }
+            client->close();
         }
     }
 
-    if (acceptThread_.joinable()) {
-        acceptThread_.join();
+    // Decode tasks post back to the connections, so the pool must still run
+    {
+        std::unique_lock<std::mutex> lock(decodeMutex_);
+        decodeCv_.wait(lock, [this]() { return decodesInFlight_ == 0; });
+    }
+
+    // Once the sockets are closed every read fails and the pool runs dry
+    workGuard_.reset();
+    for (auto& worker : workers_) {
+        if (worker.joinable()) {
+            worker.join();
+        }
     }
+    workers_.clear();
 
     {
         std::lock_guard<std::mutex> lock(clientsMutex_);
-        for (auto& client : clients_) {
-            if (client->worker.joinable()) {
-                client->worker.join();
-            }
-        }
         clients_.clear();
     }
 
@@ -109,119 +383,197 @@ bool StreamReceiver::latestFrame(ReceivedFrame& out) const
     return true;
 }
 
+bool StreamReceiver::latestFrame(const std::string& deviceId, ReceivedFrame& out) const
+{
+    std::lock_guard<std::mutex> lock(frameMutex_);
+    auto it = deviceFrames_.find(deviceId);
+    if (it == deviceFrames_.end()) {
+        return false;
+    }
+    out = it->second;
+    return true;
+}
+
+bool StreamReceiver::waitForFrame(ReceivedFrame& out, std::uint64_t afterSequence,
+                                  std::chrono::milliseconds timeout, const std::string& deviceId) const
+{
+    std::unique_lock<std::mutex> lock(frameMutex_);
+    const ReceivedFrame* found = nullptr;
+    const bool ready = frameCv_.wait_for(lock, timeout, [&]() {
+        if (!running_.load()) {
+            return true;
+        }
+        if (deviceId.empty()) {
+            found = lastFrame_.sequence > afterSequence ? &lastFrame_ : nullptr;
+        } else {
+            auto it = deviceFrames_.find(deviceId);
+            found = it != deviceFrames_.end() && it->second.sequence > afterSequence ? &it->second : nullptr;
+        }
+        return found != nullptr;
+    });
+
+    if (!ready || !found) {
+        return false;
+    }
+    out = *found;
+    return true;
+}
+
+std::size_t StreamReceiver::subscribe(FrameCallback callback)
+{
+    std::lock_guard<std::mutex> lock(subscriberMutex_);
+    const std::size_t id = nextSubscriberId_++;
+    subscribers_.emplace_back(id, std::make_shared<const FrameCallback>(std::move(callback)));
+    return id;
+}
+
+void StreamReceiver::unsubscribe(std::size_t id)
+{
+    std::lock_guard<std::mutex> lock(subscriberMutex_);
+    subscribers_.erase(std::remove_if(subscribers_.begin(), subscribers_.end(), [id](const auto& entry) {
+        return entry.first == id;
+    }), subscribers_.end());
+}
+
 std::vector<std::string> StreamReceiver::connectedDevices() const
 {
     std::vector<std::string> devices;
     std::lock_guard<std::mutex> lock(clientsMutex_);
     devices.reserve(clients_.size());
     for (const auto& client : clients_) {
-        if (!client->deviceId.empty()) {
-            devices.push_back(client->deviceId);
+        auto deviceId = client->deviceId();
+        if (!deviceId.empty()) {
+            devices.push_back(std::move(deviceId));
         }
     }
     return devices;
 }
 
-void StreamReceiver::acceptLoop()
+void StreamReceiver::doAccept()
 {
-    while (running_.load()) {
-        auto context = std::make_shared<ClientContext>();
-        context->socket = std::make_shared<boost::asio::ip::tcp::socket>(*ioContext_);
+    acceptor_->async_accept(
+        boost::asio::make_strand(*ioContext_),
+        [this](const boost::system::error_code& ec, boost::asio::ip::tcp::socket socket) {
+            if (!running_.load() || !acceptor_->is_open()) {
+                return;
+            }
 
-        boost::system::error_code ec;
-        acceptor_->accept(*context->socket, ec);
-        if (ec) {
-            if (running_.load()) {
+            if (ec) {
                 std::cerr << "StreamReceiver accept failed: " << ec.message() << std::endl;
+            } else {
+                auto connection = std::make_shared<Connection>(*this, std::move(socket));
+                {
+                    std::lock_guard<std::mutex> lock(clientsMutex_);
+                    clients_.push_back(connection);
+                }
+                connection->start();
             }
-            continue;
-        }
-
-        {
-            std::lock_guard<std::mutex> lock(clientsMutex_);
-            clients_.push_back(context);
-        }
 
-        context->worker = std::thread([this, context]() {
-            handleClient(context);
+            doAccept();
         });
-    }
 }
 
-void StreamReceiver::handleClient(const std::shared_ptr<ClientContext>& context)
+bool StreamReceiver::decodeFrame(const std::shared_ptr<Connection>& connection, SnowOwl::Protocol::MessageType type,
+                                 std::vector<std::uint8_t> payload)
 {
-    auto& socket = *context->socket;
-    std::cout << "StreamReceiver: client from " << socket.remote_endpoint() << std::endl;
-
-    while (context->running.load()) {
-        Message message;
-        if (!readMessage(socket, message)) {
-            break;
-        }
-
-        switch (message.type) {
-        case SnowOwl::Protocol::MessageType::Frame:
-            processFrame(context->deviceId, message.payload);
-            break;
-        case SnowOwl::Protocol::MessageType::Control:
-            handleControl(context, message.payload);
-            break;
-        default:
-            break;
+    {
+        // Checked under the lock stop() waits with, so no task starts after it
+        std::lock_guard<std::mutex> lock(decodeMutex_);
+        if (!running_.load()) {
+            return false;
         }
+        ++decodesInFlight_;
     }
 
-    cleanupClient(context);
+    decodePool().submit([this, connection, type, payload = std::move(payload)]() mutable {
+        processFrame(*connection, type, payload);
+        releaseBuffer(std::move(payload));
+        connection->onDecoded();
+
+        {
+            std::lock_guard<std::mutex> lock(decodeMutex_);
+            --decodesInFlight_;
+        }
+        decodeCv_.notify_all();
+    });
+    return true;
 }
 
-bool StreamReceiver::readMessage(boost::asio::ip::tcp::socket& socket, Message& message) const
+std::vector<std::uint8_t> StreamReceiver::acquireBuffer()
 {
-    boost::system::error_code ec;
-    std::array<std::uint8_t, 5> header{};
-    boost::asio::read(socket, boost::asio::buffer(header), ec);
-    if (ec) {
-        return false;
+    std::lock_guard<std::mutex> lock(bufferMutex_);
+    if (freeBuffers_.empty()) {
+        return {};
     }
+    auto buffer = std::move(freeBuffers_.back());
+    freeBuffers_.pop_back();
+    return buffer;
+}
 
-    message.type = static_cast<SnowOwl::Protocol::MessageType>(header[0]);
-    const std::uint32_t length =
-        header[1] | (static_cast<std::uint32_t>(header[2]) << 8) |
-        (static_cast<std::uint32_t>(header[3]) << 16) |
-        (static_cast<std::uint32_t>(header[4]) << 24);
+void StreamReceiver::releaseBuffer(std::vector<std::uint8_t>&& buffer)
+{
+    if (buffer.capacity() == 0 || buffer.capacity() > kMaxPooledCapacity) {
+        return;
+    }
 
-    message.payload.resize(length);
-    boost::asio::read(socket, boost::asio::buffer(message.payload), ec);
-    if (ec) {
-        return false;
+    std::lock_guard<std::mutex> lock(bufferMutex_);
+    if (freeBuffers_.size() < kMaxPooledBuffers) {
+        buffer.clear();
+        freeBuffers_.push_back(std::move(buffer));
     }
-    return true;
 }
 
-void StreamReceiver::processFrame(const std::string& deviceId, const std::vector<std::uint8_t>& payload)
+void StreamReceiver::processFrame(Connection& connection, SnowOwl::Protocol::MessageType type,
+                                  const std::vector<std::uint8_t>& payload)
 {
     if (payload.empty()) {
         return;
     }
 
-    cv::Mat jpegMat(1, static_cast<int>(payload.size()), CV_8UC1, const_cast<std::uint8_t*>(payload.data()));
-    cv::Mat frame = cv::imdecode(jpegMat, cv::IMREAD_COLOR);
+    cv::Mat frame;
+    if (type == SnowOwl::Protocol::MessageType::VideoPacket) {
+        connection.videoDecoder().decode(payload.data(), payload.size(), decodeTargetSize_.load(), frame);
+    } else {
+        cv::Mat jpegMat(1, static_cast<int>(payload.size()), CV_8UC1, const_cast<std::uint8_t*>(payload.data()));
+        frame = cv::imdecode(jpegMat, decodeFlags(payload, decodeTargetSize_.load()));
+    }
     if (frame.empty()) {
         return;
     }
 
-    std::lock_guard<std::mutex> lock(frameMutex_);
-    lastFrame_.frame = std::move(frame);
-    lastFrame_.deviceId = deviceId.empty() ? "unknown" : deviceId;
-    lastFrame_.sequence = ++sequence_;
-    lastFrame_.timestamp = std::chrono::steady_clock::now();
+    const std::string deviceId = connection.deviceId();
+    // The decoded Mat is never written again, so every copy below shares it
+    ReceivedFrame received;
+    received.frame = std::move(frame);
+    received.deviceId = deviceId.empty() ? "unknown" : deviceId;
+    received.timestamp = std::chrono::steady_clock::now();
+    {
+        std::lock_guard<std::mutex> lock(frameMutex_);
+        received.sequence = ++sequence_;
+        lastFrame_ = received;
+        deviceFrames_[received.deviceId] = received;
+    }
+    frameCv_.notify_all();
+
+    std::vector<std::shared_ptr<const FrameCallback>> callbacks;
+    {
+        std::lock_guard<std::mutex> lock(subscriberMutex_);
+        callbacks.reserve(subscribers_.size());
+        for (const auto& entry : subscribers_) {
+            callbacks.push_back(entry.second);
+        }
+    }
+    for (const auto& callback : callbacks) {
+        (*callback)(received);
+    }
 }
 
-void StreamReceiver::handleControl(const std::shared_ptr<ClientContext>& context, const std::vector<std::uint8_t>& payload)
+void StreamReceiver::handleControl(Connection& connection, const std::vector<std::uint8_t>& payload)
 {
     try {
         const auto json = nlohmann::json::parse(payload.begin(), payload.end());
         const std::string deviceId = safeDeviceId(json);
-        context->deviceId = deviceId;
+        connection.setDeviceId(deviceId);
 
         if (json.contains("device_name") && json["device_name"].is_string()) {
             std::cout << "StreamReceiver: handshake from " << deviceId
@@ -229,31 +581,16 @@ void StreamReceiver::handleControl(const std::shared_ptr<ClientContext>& context
         } else {
             std::cout << "StreamReceiver: handshake from " << deviceId << std::endl;
         }
-
-        {
-            std::lock_guard<std::mutex> lock(frameMutex_);
-            deviceLastSeen_[deviceId] = std::chrono::steady_clock::now();
-        }
     } catch (const std::exception& ex) {
         std::cerr << "StreamReceiver: failed to parse control message: " << ex.what() << std::endl;
     }
 }
 
-void StreamReceiver::cleanupClient(const std::shared_ptr<ClientContext>& context)
+void StreamReceiver::removeConnection(const std::shared_ptr<Connection>& connection)
 {
-    context->running = false;
-
-    if (context->socket && context->socket->is_open()) {
-        boost::system::error_code ec;
-        context->socket->shutdown(boost::asio::ip::tcp::socket::shutdown_both, ec);
-        context->socket->close(ec);
-    }
-
-    {
-        std::lock_guard<std::mutex> lock(clientsMutex_);
-        auto it = std::remove(clients_.begin(), clients_.end(), context);
-        clients_.erase(it, clients_.end());
-    }
+    std::lock_guard<std::mutex> lock(clientsMutex_);
+    auto it = std::remove(clients_.begin(), clients_.end(), connection);
+    clients_.erase(it, clients_.end());
 }
 
 }
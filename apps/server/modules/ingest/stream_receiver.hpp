@@ -2,7 +2,9 @@
 
 #include <atomic>
 #include <chrono>
+#include <condition_variable>
 #include <cstdint>
+#include <functional>
 #include <memory>
 #include <mutex>
 #include <string>
@@ -20,6 +22,7 @@ namespace SnowOwl::Modules::Ingest {
 struct ReceivedFrame {
     cv::Mat frame;
     std::string deviceId;
+    // Increases across all devices, so it orders frames of different devices too
     std::uint64_t sequence{0};
     std::chrono::steady_clock::time_point timestamp{};
 };
@@ -32,41 +35,76 @@ public:
     bool start(std::uint16_t port);
     void stop();
 
+    // Connections that deliver no complete message for this long are closed
+    void setIdleTimeout(std::chrono::seconds timeout) { idleTimeout_ = timeout; }
+    // Long side frames need downstream; JPEGs at least twice as large are
+    // decoded at 1/2, 1/4 or 1/8 scale in the DCT domain, video packets are
+    // scaled by the same steps while converting. 0 keeps full size.
+    void setDecodeTargetSize(int longSide) { decodeTargetSize_ = longSide; }
+
+    using FrameCallback = std::function<void(const ReceivedFrame&)>;
+
+    // Newest frame of any device, or of one device
     bool latestFrame(ReceivedFrame& out) const;
+    bool latestFrame(const std::string& deviceId, ReceivedFrame& out) const;
+    // Blocks until a frame newer than afterSequence arrives (from deviceId,
+    // or any device when empty); false on timeout or once stopped
+    bool waitForFrame(ReceivedFrame& out, std::uint64_t afterSequence,
+                      std::chrono::milliseconds timeout, const std::string& deviceId = {}) const;
+    // Called for every decoded frame on the thread that received it; frames
+    // of different devices arrive concurrently. Returns an id for unsubscribe.
+    std::size_t subscribe(FrameCallback callback);
+    void unsubscribe(std::size_t id);
+
     std::vector<std::string> connectedDevices() const;
 
 private:
-    struct ClientContext {
-        std::shared_ptr<boost::asio::ip::tcp::socket> socket;
-        std::thread worker;
-        std::string deviceId;
-        std::atomic<bool> running{true};
-    };
-
-    struct Message {
-        SnowOwl::Protocol::MessageType type{SnowOwl::Protocol::MessageType::Control};
-        std::vector<std::uint8_t> payload;
-    };
-
-    void acceptLoop();
-    void handleClient(const std::shared_ptr<ClientContext>& context);
-    bool readMessage(boost::asio::ip::tcp::socket& socket, Message& message) const;
-    void processFrame(const std::string& deviceId, const std::vector<std::uint8_t>& payload);
-    void handleControl(const std::shared_ptr<ClientContext>& context, const std::vector<std::uint8_t>& payload);
-    void cleanupClient(const std::shared_ptr<ClientContext>& context);
+    // One edge device; reads run as an async chain on the connection's own
+    // strand, so the next message is only read once the previous one has
+    // been handled and a slow consumer pushes back through TCP
+    class Connection;
+
+    void doAccept();
+    // Decodes on a worker pool, off the connection's strand; at most one
+    // message per connection is in flight, so video packets stay in order
+    bool decodeFrame(const std::shared_ptr<Connection>& connection, SnowOwl::Protocol::MessageType type,
+                     std::vector<std::uint8_t> payload);
+    void processFrame(Connection& connection, SnowOwl::Protocol::MessageType type,
+                      const std::vector<std::uint8_t>& payload);
+    void handleControl(Connection& connection, const std::vector<std::uint8_t>& payload);
+    void removeConnection(const std::shared_ptr<Connection>& connection);
+
+    std::vector<std::uint8_t> acquireBuffer();
+    void releaseBuffer(std::vector<std::uint8_t>&& buffer);
 
     std::unique_ptr<boost::asio::io_context> ioContext_;
+    std::unique_ptr<boost::asio::executor_work_guard<boost::asio::io_context::executor_type>> workGuard_;
     std::unique_ptr<boost::asio::ip::tcp::acceptor> acceptor_;
-    std::thread acceptThread_;
+    std::vector<std::thread> workers_;
     std::atomic<bool> running_{false};
+    std::chrono::seconds idleTimeout_{30};
+    std::atomic<int> decodeTargetSize_{0};
+
+    std::mutex decodeMutex_;
+    std::condition_variable decodeCv_;
+    std::size_t decodesInFlight_{0};
 
     mutable std::mutex clientsMutex_;
-    std::vector<std::shared_ptr<ClientContext>> clients_;
+    std::vector<std::shared_ptr<Connection>> clients_;
+
+    // Payload buffers keep their capacity between messages and connections
+    std::mutex bufferMutex_;
+    std::vector<std::vector<std::uint8_t>> freeBuffers_;
 
     mutable std::mutex frameMutex_;
+    mutable std::condition_variable frameCv_;
     ReceivedFrame lastFrame_;
+    std::unordered_map<std::string, ReceivedFrame> deviceFrames_;
     std::uint64_t sequence_{0};
-    std::unordered_map<std::string, std::chrono::steady_clock::time_point> deviceLastSeen_;
+
+    std::mutex subscriberMutex_;
+    std::vector<std::pair<std::size_t, std::shared_ptr<const FrameCallback>>> subscribers_;
+    std::size_t nextSubscriberId_{1};
 };
 
 }
@@ -0,0 +1,166 @@
+#include "modules/ingest/video_packet_decoder.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+namespace SnowOwl::Modules::Ingest {
+
+using SnowOwl::Protocol::VideoCodec;
+
+VideoPacketDecoder::~VideoPacketDecoder()
+{
+    close();
+}
+
+bool VideoPacketDecoder::decode(const std::uint8_t* payload, std::size_t size, int targetLongSide, cv::Mat& frame)
+{
+    frame.release();
+    if (!payload || size <= SnowOwl::Protocol::kVideoPacketHeaderSize) {
+        return false;
+    }
+
+    const auto codec = static_cast<VideoCodec>(payload[0]);
+    if (codec != VideoCodec::H264 && codec != VideoCodec::H265) {
+        return false;
+    }
+    const bool keyframe = (payload[1] & SnowOwl::Protocol::kVideoPacketKeyframe) != 0;
+    std::uint64_t pts = 0;
+    for (std::size_t i = 0; i < 8; ++i) {
+        pts |= static_cast<std::uint64_t>(payload[2 + i]) << (8 * i);
+    }
+
+    if (codec != codec_ || (!codecCtx_ && !openFailed_)) {
+        close();
+        codec_ = codec;
+        openFailed_ = !open(codec);
+        waitingForKeyframe_ = true;
+    }
+    if (!codecCtx_) {
+        return false;
+    }
+
+    // The keyframe carries the parameter sets, so decoding restarts cleanly there
+    if (waitingForKeyframe_) {
+        if (!keyframe) {
+            return true;
+        }
+        avcodec_flush_buffers(codecCtx_);
+        waitingForKeyframe_ = false;
+    }
+
+    // Not refcounted, so libavcodec copies it into a padded buffer of its own
+    packet_->data = const_cast<std::uint8_t*>(payload + SnowOwl::Protocol::kVideoPacketHeaderSize);
+    packet_->size = static_cast<int>(size - SnowOwl::Protocol::kVideoPacketHeaderSize);
+    packet_->pts = static_cast<std::int64_t>(pts);
+    packet_->flags = keyframe ? AV_PKT_FLAG_KEY : 0;
+    const int sent = avcodec_send_packet(codecCtx_, packet_);
+    packet_->data = nullptr;
+    packet_->size = 0;
+    if (sent < 0) {
+        std::cerr << "VideoPacketDecoder: failed to send packet, waiting for next keyframe" << std::endl;
+        waitingForKeyframe_ = true;
+        return false;
+    }
+
+    while (true) {
+        const int received = avcodec_receive_frame(codecCtx_, frame_);
+        if (received == AVERROR(EAGAIN) || received == AVERROR_EOF) {
+            break;
+        }
+        if (received < 0) {
+            std::cerr << "VideoPacketDecoder: failed to decode frame, waiting for next keyframe" << std::endl;
+            waitingForKeyframe_ = true;
+            return false;
+        }
+
+        const bool converted = convert(targetLongSide, frame);
+        av_frame_unref(frame_);
+        if (!converted) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool VideoPacketDecoder::open(VideoCodec codec)
+{
+    const AVCodec* decoder = avcodec_find_decoder(codec == VideoCodec::H265 ? AV_CODEC_ID_HEVC : AV_CODEC_ID_H264);
+    if (!decoder) {
+        std::cerr << "VideoPacketDecoder: no " << (codec == VideoCodec::H265 ? "H.265" : "H.264") << " decoder" << std::endl;
+        return false;
+    }
+
+    codecCtx_ = avcodec_alloc_context3(decoder);
+    packet_ = av_packet_alloc();
+    frame_ = av_frame_alloc();
+    if (!codecCtx_ || !packet_ || !frame_) {
+        std::cerr << "VideoPacketDecoder: failed to allocate decoder" << std::endl;
+        close();
+        return false;
+    }
+
+    // Frame threading would hold back one frame per thread
+    codecCtx_->flags |= AV_CODEC_FLAG_LOW_DELAY;
+    codecCtx_->thread_type = FF_THREAD_SLICE;
+    codecCtx_->thread_count = 2;
+
+    if (avcodec_open2(codecCtx_, decoder, nullptr) < 0) {
+        std::cerr << "VideoPacketDecoder: failed to open decoder" << std::endl;
+        close();
+        return false;
+    }
+    return true;
+}
+
+void VideoPacketDecoder::close()
+{
+    if (codecCtx_) {
+        avcodec_free_context(&codecCtx_);
+    }
+    if (packet_) {
+        av_packet_free(&packet_);
+    }
+    if (frame_) {
+        av_frame_free(&frame_);
+    }
+    if (swsCtx_) {
+        sws_freeContext(swsCtx_);
+        swsCtx_ = nullptr;
+    }
+}
+
+bool VideoPacketDecoder::convert(int targetLongSide, cv::Mat& frame)
+{
+    const int width = frame_->width;
+    const int height = frame_->height;
+    if (width <= 0 || height <= 0) {
+        return false;
+    }
+
+    // Same steps as the DCT-scaled JPEG decode: halve while the long side stays at or above target
+    int scale = 1;
+    const int longSide = std::max(width, height);
+    while (targetLongSide > 0 && scale < 8 && longSide / (scale * 2) >= targetLongSide) {
+        scale *= 2;
+    }
+    const int outWidth = width / scale;
+    const int outHeight = height / scale;
+
+    swsCtx_ = sws_getCachedContext(swsCtx_, width, height, static_cast<AVPixelFormat>(frame_->format),
+                                   outWidth, outHeight, AV_PIX_FMT_BGR24, SWS_FAST_BILINEAR,
+                                   nullptr, nullptr, nullptr);
+    if (!swsCtx_) {
+        std::cerr << "VideoPacketDecoder: unsupported pixel format" << std::endl;
+        return false;
+    }
+
+    // A fresh Mat per picture, since published frames are shared and never written again
+    cv::Mat bgr(outHeight, outWidth, CV_8UC3);
+    std::uint8_t* dst[4] = {bgr.data, nullptr, nullptr, nullptr};
+    int dstStride[4] = {static_cast<int>(bgr.step[0]), 0, 0, 0};
+    sws_scale(swsCtx_, frame_->data, frame_->linesize, 0, height, dst, dstStride);
+    frame = std::move(bgr);
+    return true;
+}
+
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+
+#include <opencv2/core.hpp>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libswscale/swscale.h>
+}
+
+#include "protocol/message_types.hpp"
+
+namespace SnowOwl::Modules::Ingest {
+
+// Decodes the VideoPacket stream of one edge connection into BGR frames.
+// Packets must be fed in order; after a codec change or a decode error
+// everything up to the next keyframe is skipped.
+class VideoPacketDecoder {
+public:
+    VideoPacketDecoder() = default;
+    ~VideoPacketDecoder();
+
+    VideoPacketDecoder(const VideoPacketDecoder&) = delete;
+    VideoPacketDecoder& operator=(const VideoPacketDecoder&) = delete;
+
+    // payload is a whole VideoPacket message body; frame is left empty when
+    // the packet produced no picture. Frames whose long side is at least
+    // twice targetLongSide are scaled down by halves during conversion.
+    bool decode(const std::uint8_t* payload, std::size_t size, int targetLongSide, cv::Mat& frame);
+
+private:
+    bool open(SnowOwl::Protocol::VideoCodec codec);
+    void close();
+    bool convert(int targetLongSide, cv::Mat& frame);
+
+    SnowOwl::Protocol::VideoCodec codec_{SnowOwl::Protocol::VideoCodec::H264};
+    AVCodecContext* codecCtx_{nullptr};
+    AVPacket* packet_{nullptr};
+    AVFrame* frame_{nullptr};
+    SwsContext* swsCtx_{nullptr};
+    bool waitingForKeyframe_{true};
+    bool openFailed_{false};
+};
+
+}
@@ -8,9 +8,14 @@
 #include <QTimer>
 #include <QDateTime>
 #include <QHostAddress>
+#include <QThread>
 
 #include <iostream>
+#include <utility>
 #include <nlohmann/json.hpp>
+#include <opencv2/imgcodecs.hpp>
+
+#include "snowowl.pb.h"
 
 namespace SnowOwl::Server::Modules::Network {
 
@@ -42,29 +47,92 @@ bool NetworkServer::listen(quint16 port)
 
 void NetworkServer::stop()
 {
-    for (auto* client : clients_) {
+    // Cleaned up here: once clients_ is empty the disconnected handlers no
+    // longer find them
+    const auto clients = std::exchange(clients_, {});
+    clientCount_ = 0;
+    for (auto* client : clients) {
         if (client && client->socket) {
+            client->socket->disconnect(this);
             client->socket->disconnectFromHost();
         }
+        cleanupClient(client);
     }
-    
-    clients_.clear();
+
     tcpServer_->close();
 }
 
 void NetworkServer::broadcastFrame(const cv::Mat& frame)
 {
     emit frameReceived(frame);
+
+    if (frame.empty() || clientCount_.load() == 0 || framePending_.exchange(true)) {
+        return;
+    }
+
+    std::vector<uchar> jpegBuffer;
+    const std::vector<int> params = {cv::IMWRITE_JPEG_QUALITY, 80};
+    if (!cv::imencode(".jpg", frame, jpegBuffer, params)) {
+        framePending_ = false;
+        return;
+    }
+
+    // Encoded once here and shared by every client's write
+    const QByteArray jpeg(reinterpret_cast<const char*>(jpegBuffer.data()), static_cast<int>(jpegBuffer.size()));
+    const QByteArray block = encodeMessage({
+        {"type", "frame"},
+        {"width", frame.cols},
+        {"height", frame.rows},
+        {"timestamp", QDateTime::currentMSecsSinceEpoch()},
+        {"data", QString::fromLatin1(jpeg.toBase64())}
+    });
+
+    if (QThread::currentThread() == thread()) {
+        framePending_ = false;
+        writeToAllClients(block, MessageKind::Frame);
+        return;
+    }
+
+    QMetaObject::invokeMethod(this, [this, block]() {
+        framePending_ = false;
+        writeToAllClients(block, MessageKind::Frame);
+    }, Qt::QueuedConnection);
 }
 
 void NetworkServer::broadcastEvents(const std::vector<Detection::DetectionResult>& events)
 {
+    const int clients = clientCount_.load();
+    const int binaryClients = binaryEventClients_.load();
+    if (clients == 0) {
+        return;
+    }
+
+    // Each format is encoded once per batch, and only if somebody reads it
+    QByteArray jsonBlock;
+    QByteArray binaryBlock;
+    {
+        std::lock_guard<std::mutex> lock(eventMutex_);
+        if (clients > binaryClients) {
+            jsonBlock = encodeJsonEvents(events);
+        }
+        if (binaryClients > 0) {
+            binaryBlock = encodeBinaryEvents(events);
+        }
+    }
+
+    deliver(jsonBlock, MessageKind::Events, binaryBlock);
+}
+
+QByteArray NetworkServer::encodeJsonEvents(const std::vector<Detection::DetectionResult>& events)
+{
+    const qint64 timestamp = QDateTime::currentMSecsSinceEpoch();
+
     QJsonArray eventsArray;
     for (const auto& event : events) {
         QJsonObject eventObj;
         eventObj["type"] = QString::fromStdString(Detection::detectionTypeToString(event.type));
         eventObj["confidence"] = event.confidence;
-        eventObj["timestamp"] = QDateTime::currentMSecsSinceEpoch();
+        eventObj["timestamp"] = timestamp;
         
         QJsonObject bbox;
         bbox["x"] = event.boundingBox.x;
@@ -80,12 +148,37 @@ void NetworkServer::broadcastEvents(const std::vector<Detection::DetectionResult
     QJsonObject message;
     message["type"] = "detection_events";
     message["events"] = eventsArray;
-    message["timestamp"] = QDateTime::currentMSecsSinceEpoch();
+    message["timestamp"] = timestamp;
     
     QJsonDocument doc(message);
     QByteArray jsonData = doc.toJson(QJsonDocument::Compact);
     
-    sendToAllClients({{"type", "detection_events"}, {"data", QString::fromUtf8(jsonData)}});
+    return encodeMessage({{"type", "detection_events"}, {"data", QString::fromUtf8(jsonData)}});
+}
+
+QByteArray NetworkServer::encodeBinaryEvents(const std::vector<Detection::DetectionResult>& events)
+{
+    if (!eventBatch_) {
+        eventBatch_ = std::make_unique<snowowl::DetectionEventBatch>();
+    }
+
+    // Clear() keeps the repeated events allocated for the next batch
+    eventBatch_->Clear();
+    eventBatch_->set_timestamp(QDateTime::currentMSecsSinceEpoch());
+    for (const auto& event : events) {
+        auto* out = eventBatch_->add_events();
+        out->set_type(static_cast<snowowl::DetectionKind>(static_cast<int>(event.type)));
+        out->set_confidence(event.confidence);
+        out->set_x(event.boundingBox.x);
+        out->set_y(event.boundingBox.y);
+        out->set_width(event.boundingBox.width);
+        out->set_height(event.boundingBox.height);
+        out->set_description(event.description);
+    }
+
+    eventBuffer_.assign(1, '\0');
+    eventBatch_->AppendToString(&eventBuffer_);
+    return frameMessage(eventBuffer_.data(), static_cast<qsizetype>(eventBuffer_.size()));
 }
 
 void NetworkServer::onNewConnection()
@@ -105,7 +198,11 @@ void NetworkServer::onNewConnection()
         
         connect(socket, &QTcpSocket::disconnected, this, [this, client]() {
             onClientDisconnected();
-            cleanupClient(client);
+            // Broadcasts may already have dropped a client whose socket closed
+            if (clients_.removeOne(client)) {
+                clientCount_ = static_cast<int>(clients_.size());
+                cleanupClient(client);
+            }
         });
         connect(socket, &QTcpSocket::readyRead, this, [this, client]() {
             onReadyRead();
@@ -115,6 +212,7 @@ void NetworkServer::onNewConnection()
         });
         
         clients_.append(client);
+        clientCount_ = static_cast<int>(clients_.size());
         client->keepaliveTimer->start();
         
         emit clientConnected();
@@ -152,6 +250,22 @@ void NetworkServer::onReadyRead()
 
 void NetworkServer::onSendKeepalive()
 {
+    for (auto* client : clients_) {
+        if (!client || !client->socket) {
+            continue;
+        }
+        const quint64 frames = client->skippedFrames - client->reportedFrames;
+        const quint64 events = client->skippedEvents - client->reportedEvents;
+        if (frames == 0 && events == 0) {
+            continue;
+        }
+        std::cout << "NetworkServer: slow client " << client->socket->peerAddress().toString().toStdString()
+                  << ':' << client->socket->peerPort() << " skipped " << frames << " frames and "
+                  << events << " event batches in the last keepalive period" << std::endl;
+        client->reportedFrames = client->skippedFrames;
+        client->reportedEvents = client->skippedEvents;
+    }
+
     sendToAllClients({{"type", "keepalive"}, {"timestamp", QDateTime::currentMSecsSinceEpoch()}});
 }
 
@@ -168,30 +282,101 @@ void NetworkServer::setupServer()
 
 void NetworkServer::handleClientMessage(Client* client, const QByteArray& message)
 {
-    Q_UNUSED(client)
-    Q_UNUSED(message)
+    constexpr qsizetype kMaxInboundBytes = 64 * 1024;
+
+    client->inbound.append(message);
+    qsizetype newline;
+    while ((newline = client->inbound.indexOf('\n')) >= 0) {
+        const QByteArray line = client->inbound.left(newline).trimmed();
+        client->inbound.remove(0, newline + 1);
+        if (line.isEmpty()) {
+            continue;
+        }
+
+        const QJsonObject request = QJsonDocument::fromJson(line).object();
+        if (request.value("type").toString() == "set_event_format") {
+            setEventFormat(client, request.value("format").toString() == "binary");
+        }
+    }
+
+    if (client->inbound.size() > kMaxInboundBytes) {
+        client->inbound.clear();
+    }
 }
 
-void NetworkServer::sendToClient(Client* client, const QVariantMap& data)
+void NetworkServer::setEventFormat(Client* client, bool binary)
+{
+    if (client->binaryEvents != binary) {
+        client->binaryEvents = binary;
+        binaryEventClients_ += binary ? 1 : -1;
+    }
+
+    sendToClient(client, {{"type", "event_format"}, {"format", binary ? "binary" : "json"}});
+}
+
+QByteArray NetworkServer::encodeMessage(const QVariantMap& data)
 {
-    if (!client || !client->socket) return;
-    
     QJsonDocument doc(QJsonObject::fromVariantMap(data));
     QByteArray jsonData = doc.toJson(QJsonDocument::Compact);
     
+    return frameMessage(jsonData.constData(), jsonData.size());
+}
+
+QByteArray NetworkServer::frameMessage(const char* data, qsizetype size)
+{
     QByteArray block;
     QDataStream out(&block, QIODevice::WriteOnly);
     out.setVersion(QDataStream::Qt_6_0);
     out << quint32(0);
-    out << jsonData;
+    out << QByteArray::fromRawData(data, size);
     
     out.device()->seek(0);
     out << quint32(block.size() - sizeof(quint32));
     
+    return block;
+}
+
+void NetworkServer::sendToClient(Client* client, const QVariantMap& data)
+{
+    writeToClient(client, encodeMessage(data), MessageKind::Control);
+}
+
+bool NetworkServer::writeToClient(Client* client, const QByteArray& block, MessageKind kind)
+{
+    if (!client || !client->socket) return false;
+
+    if (kind != MessageKind::Control && client->socket->bytesToWrite() > maxPendingBytes_) {
+        if (kind == MessageKind::Frame) {
+            ++client->skippedFrames;
+        } else {
+            ++client->skippedEvents;
+        }
+        return false;
+    }
+
+    // QByteArray is implicitly shared, so every client queues the same buffer
     client->socket->write(block);
+    return true;
+}
+
+void NetworkServer::sendToAllClients(const QVariantMap& data, MessageKind kind)
+{
+    deliver(encodeMessage(data), kind);
+}
+
+void NetworkServer::deliver(const QByteArray& block, MessageKind kind, const QByteArray& binaryBlock)
+{
+    if (QThread::currentThread() != thread()) {
+        QMetaObject::invokeMethod(this, [this, block, kind, binaryBlock]() {
+            writeToAllClients(block, kind, binaryBlock);
+        }, Qt::QueuedConnection);
+        return;
+    }
+
+    writeToAllClients(block, kind, binaryBlock);
 }
 
-void NetworkServer::sendToAllClients(const QVariantMap& data)
+void NetworkServer::writeToAllClients(const QByteArray& block, MessageKind kind, const QByteArray& binaryBlock)
 {
     for (auto it = clients_.begin(); it != clients_.end();) {
         auto* client = *it;
@@ -206,13 +391,22 @@ void NetworkServer::sendToAllClients(const QVariantMap& data)
             continue;
         }
         
-        sendToClient(client, data);
+        const bool binary = kind == MessageKind::Events && client->binaryEvents && !binaryBlock.isEmpty();
+        const QByteArray& payload = binary ? binaryBlock : block;
+        if (!payload.isEmpty()) {
+            writeToClient(client, payload, kind);
+        }
         ++it;
     }
+    clientCount_ = static_cast<int>(clients_.size());
 }
 
 void NetworkServer::cleanupClient(Client* client) {
     if (!client) return;
+
+    if (client->binaryEvents) {
+        --binaryEventClients_;
+    }
     
     if (client->keepaliveTimer) {
         client->keepaliveTimer->stop();
@@ -5,15 +5,27 @@
 #include <QTcpSocket>
 #include <QTimer>
 #include <QVariantMap>
+#include <atomic>
 #include <memory>
+#include <mutex>
+#include <string>
 #include <vector>
 
 #include <opencv2/core/mat.hpp>
 
 #include "detection/detection_types.hpp"
 
+namespace snowowl {
+class DetectionEventBatch;
+}
+
 namespace SnowOwl::Server::Modules::Network {
 
+// Clients receive length-prefixed QDataStream byte arrays holding JSON.
+// A client that sends {"type":"set_event_format","format":"binary"} (one
+// JSON object per line) gets detection events as a 0x00 byte followed by
+// a serialized snowowl.DetectionEventBatch instead.
+
 class NetworkServer : public QObject {
     Q_OBJECT
 
@@ -29,6 +41,12 @@ public:
     void broadcastFrame(const cv::Mat& frame);
     void broadcastEvents(const std::vector<Detection::DetectionResult>& events);
 
+    // Frames and events are skipped for a client while more than this many
+    // bytes are still waiting in its socket; keepalives always go out
+    void setMaxPendingBytes(qint64 bytes) { maxPendingBytes_ = bytes; }
+    // Safe from any thread
+    int clientCount() const { return clientCount_.load(); }
+
 signals:
     void clientConnected();
     void clientDisconnected();
@@ -48,18 +66,52 @@ private:
         QTcpSocket* socket;
         QTimer* keepaliveTimer;
         bool authenticated;
+        // Logged at the next keepalive whenever they grew
+        quint64 skippedFrames{0};
+        quint64 skippedEvents{0};
+        quint64 reportedFrames{0};
+        quint64 reportedEvents{0};
+        bool binaryEvents{false};
+        QByteArray inbound;
+    };
+
+    enum class MessageKind {
+        Control,
+        Frame,
+        Events
     };
 
     void setupServer();
     void handleClientMessage(Client* client, const QByteArray& message);
+    static QByteArray encodeMessage(const QVariantMap& data);
+    static QByteArray frameMessage(const char* data, qsizetype size);
+    QByteArray encodeJsonEvents(const std::vector<Detection::DetectionResult>& events);
+    QByteArray encodeBinaryEvents(const std::vector<Detection::DetectionResult>& events);
+    void setEventFormat(Client* client, bool binary);
     void sendToClient(Client* client, const QVariantMap& data);
-    void sendToAllClients(const QVariantMap& data);
+    void sendToAllClients(const QVariantMap& data, MessageKind kind = MessageKind::Control);
+    // Writes now on the server thread, otherwise queues the write there
+    void deliver(const QByteArray& block, MessageKind kind, const QByteArray& binaryBlock = {});
+    // binaryBlock, when given, replaces block for clients in binary event mode
+    void writeToAllClients(const QByteArray& block, MessageKind kind, const QByteArray& binaryBlock = {});
+    bool writeToClient(Client* client, const QByteArray& block, MessageKind kind);
     void cleanupClient(Client* client);
 
     QTcpServer* tcpServer_;
     QList<Client*> clients_;
     QTimer* keepaliveTimer_;
     quint16 port_;
+    qint64 maxPendingBytes_{1024 * 1024};
+    // Read from the capture threads to skip encoding when nobody listens
+    std::atomic<int> clientCount_{0};
+    // At most one encoded frame waits for the server thread at a time
+    std::atomic<bool> framePending_{false};
+    std::atomic<int> binaryEventClients_{0};
+
+    // Reused by every broadcastEvents call, which may come from any thread
+    std::mutex eventMutex_;
+    std::unique_ptr<snowowl::DetectionEventBatch> eventBatch_;
+    std::string eventBuffer_;
 };
 
 }
\ No newline at end of file
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 
 namespace SnowOwl::Protocol {
@@ -8,8 +9,20 @@ enum class MessageType : std::uint8_t {
     Frame = 0x01,
     Event = 0x02,
     Heartbeat = 0x03,
+    VideoPacket = 0x04,
     Control = 0x10,
     AudioData = 0x20, // new message type for audio data
 };
 
-}
\ No newline at end of file
+enum class VideoCodec : std::uint8_t {
+    H264 = 0x01,
+    H265 = 0x02,
+};
+
+// VideoPacket payload: codec (1 byte), flags (1 byte), PTS in microseconds
+// (int64, little endian), then one Annex-B access unit. Keyframes carry
+// their parameter sets, so a receiver can start decoding at any keyframe.
+constexpr std::size_t kVideoPacketHeaderSize = 10;
+constexpr std::uint8_t kVideoPacketKeyframe = 0x01;
+
+}
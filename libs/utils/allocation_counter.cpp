@@ -0,0 +1,118 @@
+#include "allocation_counter.hpp"
+
+#include <cstdlib>
+#include <new>
+
+namespace {
+
+// Plain thread_local scalars need no dynamic initialisation, so operator new
+// can touch them before anything else on the thread has run
+thread_local bool t_counting = false;
+thread_local std::uint64_t t_allocations = 0;
+
+void* allocate(std::size_t size) {
+	if (t_counting) {
+		++t_allocations;
+	}
+	if (size == 0) {
+		size = 1;
+	}
+	for (;;) {
+		if (void* block = std::malloc(size)) {
+			return block;
+		}
+		std::new_handler handler = std::get_new_handler();
+		if (!handler) {
+			throw std::bad_alloc();
+		}
+		handler();
+	}
+}
+
+void* allocateAligned(std::size_t size, std::align_val_t alignment) {
+	if (t_counting) {
+		++t_allocations;
+	}
+	const std::size_t align = static_cast<std::size_t>(alignment);
+	// aligned_alloc wants the size rounded up to the alignment
+	size = size == 0 ? align : (size + align - 1) / align * align;
+	for (;;) {
+		if (void* block = std::aligned_alloc(align, size)) {
+			return block;
+		}
+		std::new_handler handler = std::get_new_handler();
+		if (!handler) {
+			throw std::bad_alloc();
+		}
+		handler();
+	}
+}
+
+}
+
+void* operator new(std::size_t size) { return allocate(size); }
+void* operator new[](std::size_t size) { return allocate(size); }
+void* operator new(std::size_t size, std::align_val_t alignment) { return allocateAligned(size, alignment); }
+void* operator new[](std::size_t size, std::align_val_t alignment) { return allocateAligned(size, alignment); }
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+	try {
+		return allocate(size);
+	} catch (...) {
+		return nullptr;
+	}
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+	try {
+		return allocate(size);
+	} catch (...) {
+		return nullptr;
+	}
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+	try {
+		return allocateAligned(size, alignment);
+	} catch (...) {
+		return nullptr;
+	}
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+	try {
+		return allocateAligned(size, alignment);
+	} catch (...) {
+		return nullptr;
+	}
+}
+
+void operator delete(void* block) noexcept { std::free(block); }
+void operator delete[](void* block) noexcept { std::free(block); }
+void operator delete(void* block, std::size_t) noexcept { std::free(block); }
+void operator delete[](void* block, std::size_t) noexcept { std::free(block); }
+void operator delete(void* block, const std::nothrow_t&) noexcept { std::free(block); }
+void operator delete[](void* block, const std::nothrow_t&) noexcept { std::free(block); }
+void operator delete(void* block, std::align_val_t) noexcept { std::free(block); }
+void operator delete[](void* block, std::align_val_t) noexcept { std::free(block); }
+void operator delete(void* block, std::size_t, std::align_val_t) noexcept { std::free(block); }
+void operator delete[](void* block, std::size_t, std::align_val_t) noexcept { std::free(block); }
+void operator delete(void* block, std::align_val_t, const std::nothrow_t&) noexcept { std::free(block); }
+void operator delete[](void* block, std::align_val_t, const std::nothrow_t&) noexcept { std::free(block); }
+
+namespace SnowOwl::Utils::Metrics {
+
+AllocationCounter::AllocationCounter()
+	: wasCounting_(t_counting), start_(t_allocations) {
+	t_counting = true;
+}
+
+AllocationCounter::~AllocationCounter() {
+	t_counting = wasCounting_;
+}
+
+std::uint64_t AllocationCounter::count() const {
+	return t_allocations - start_;
+}
+
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+
+namespace SnowOwl::Utils::Metrics {
+
+// Counts the operator new calls made by the current thread while it is
+// alive. allocation_counter.cpp replaces the global operator new, which
+// otherwise only tests a thread-local flag. Scopes nest; allocations on other
+// threads and direct malloc calls are not seen.
+class AllocationCounter {
+public:
+	AllocationCounter();
+	~AllocationCounter();
+
+	AllocationCounter(const AllocationCounter&) = delete;
+	AllocationCounter& operator=(const AllocationCounter&) = delete;
+
+	std::uint64_t count() const;
+
+private:
+	bool wasCounting_;
+	std::uint64_t start_;
+};
+
+}
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <mutex>
 #include <string>
 #include <vector>
@@ -14,10 +16,28 @@ struct HealthThresholds {
 	double maxTemperatureC{90.0};
 };
 
+// What the edge uplink currently sends and why; filled in by the edge
+// device, not by HealthMonitor
+struct UplinkStatus {
+	bool active{false};
+	bool adaptive{false};
+	bool congested{false};
+	int jpegQuality{0};
+	int bitrateKbps{0};
+	double fps{0.0};
+	double scale{1.0};
+	double throughputKbps{0.0};
+	double avgWriteMs{0.0};
+	std::size_t queuedBytes{0};
+	std::uint64_t droppedMessages{0};
+	std::string lastDecision;
+};
+
 struct HealthStatus {
 	bool healthy{true};
 	std::vector<std::string> warnings;
 	ResourceSnapshot snapshot;
+	UplinkStatus uplink;
 };
 
 class HealthMonitor {
@@ -0,0 +1,104 @@
+#include "latency_histogram.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace SnowOwl::Utils::Metrics {
+
+namespace {
+
+int highestBit(std::uint64_t value) {
+	int bit = -1;
+	while (value != 0) {
+		value >>= 1;
+		++bit;
+	}
+	return bit;
+}
+
+}
+
+std::size_t LatencyHistogram::bucketFor(std::uint64_t micros) {
+	if (micros < kSubBuckets) {
+		return static_cast<std::size_t>(micros);
+	}
+
+	// Values in [2^octave, 2^(octave + 1)) share one row of kSubBuckets steps
+	const int octave = highestBit(micros);
+	const std::uint64_t step = (micros >> (octave - 3)) & (kSubBuckets - 1);
+	const std::size_t index = static_cast<std::size_t>(octave - 2) * kSubBuckets + static_cast<std::size_t>(step);
+	return std::min(index, kBucketCount - 1);
+}
+
+std::uint64_t LatencyHistogram::bucketUpperBound(std::size_t index) {
+	if (index < kSubBuckets) {
+		return index + 1;
+	}
+
+	const int octave = static_cast<int>(index / kSubBuckets) + 2;
+	const std::uint64_t step = index % kSubBuckets;
+	const std::uint64_t width = std::uint64_t{1} << (octave - 3);
+	return (kSubBuckets + step) * width + width;
+}
+
+void LatencyHistogram::record(std::chrono::nanoseconds latency) {
+	const auto micros = static_cast<std::uint64_t>(
+		std::max<std::int64_t>(0, std::chrono::duration_cast<std::chrono::microseconds>(latency).count()));
+
+	buckets_[bucketFor(micros)].fetch_add(1, std::memory_order_relaxed);
+	count_.fetch_add(1, std::memory_order_relaxed);
+	totalMicros_.fetch_add(micros, std::memory_order_relaxed);
+
+	std::uint64_t previous = maxMicros_.load(std::memory_order_relaxed);
+	while (previous < micros && !maxMicros_.compare_exchange_weak(previous, micros, std::memory_order_relaxed)) {
+	}
+}
+
+LatencySummary LatencyHistogram::summary() const {
+	std::array<std::uint64_t, kBucketCount> counts{};
+	std::uint64_t total = 0;
+	for (std::size_t i = 0; i < kBucketCount; ++i) {
+		counts[i] = buckets_[i].load(std::memory_order_relaxed);
+		total += counts[i];
+	}
+
+	LatencySummary summary;
+	summary.count = total;
+	if (total == 0) {
+		return summary;
+	}
+
+	const double maxMicros = static_cast<double>(maxMicros_.load(std::memory_order_relaxed));
+	summary.maxMs = maxMicros / 1000.0;
+	summary.meanMs = static_cast<double>(totalMicros_.load(std::memory_order_relaxed))
+		/ static_cast<double>(std::max<std::uint64_t>(1, count_.load(std::memory_order_relaxed))) / 1000.0;
+
+	// Percentiles report the bucket's upper edge, never more than the observed maximum
+	const auto percentile = [&](double fraction) {
+		const auto rank = std::max<std::uint64_t>(1, static_cast<std::uint64_t>(std::ceil(fraction * static_cast<double>(total))));
+		std::uint64_t seen = 0;
+		for (std::size_t i = 0; i < kBucketCount; ++i) {
+			seen += counts[i];
+			if (seen >= rank) {
+				return std::min(static_cast<double>(bucketUpperBound(i)), maxMicros) / 1000.0;
+			}
+		}
+		return maxMicros / 1000.0;
+	};
+
+	summary.p50Ms = percentile(0.50);
+	summary.p95Ms = percentile(0.95);
+	summary.p99Ms = percentile(0.99);
+	return summary;
+}
+
+void LatencyHistogram::reset() {
+	for (auto& bucket : buckets_) {
+		bucket.store(0, std::memory_order_relaxed);
+	}
+	count_.store(0, std::memory_order_relaxed);
+	totalMicros_.store(0, std::memory_order_relaxed);
+	maxMicros_.store(0, std::memory_order_relaxed);
+}
+
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace SnowOwl::Utils::Metrics {
+
+struct LatencySummary {
+	std::uint64_t count{0};
+	double meanMs{0.0};
+	double p50Ms{0.0};
+	double p95Ms{0.0};
+	double p99Ms{0.0};
+	double maxMs{0.0};
+};
+
+// Lock-free latency histogram with log-linear microsecond buckets: every
+// power of two is split into eight steps, so percentiles are accurate to
+// about 12% from 1us up to roughly half a minute. record() is safe to call
+// from any number of threads.
+class LatencyHistogram {
+public:
+	static constexpr std::size_t kSubBuckets = 8;
+	static constexpr std::size_t kBucketCount = 192;
+
+	void record(std::chrono::nanoseconds latency);
+	LatencySummary summary() const;
+	void reset();
+
+	std::uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+
+private:
+	static std::size_t bucketFor(std::uint64_t micros);
+	static std::uint64_t bucketUpperBound(std::size_t index);
+
+	std::array<std::atomic<std::uint64_t>, kBucketCount> buckets_{};
+	std::atomic<std::uint64_t> count_{0};
+	std::atomic<std::uint64_t> totalMicros_{0};
+	std::atomic<std::uint64_t> maxMicros_{0};
+};
+
+}
@@ -0,0 +1,92 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "core/streams/video_processor.hpp"
+
+namespace {
+
+using SnowOwl::Detection::DetectionResult;
+using SnowOwl::Detection::DetectionType;
+using SnowOwl::Server::Core::VideoProcessor;
+using ServerDetector = SnowOwl::Server::Modules::Detection::IDetector;
+
+// Reports one detection of its own type. Each stub waits until every other
+// stub has started, so the test only passes when they run concurrently.
+class StubDetector : public ServerDetector {
+public:
+    StubDetector(DetectionType type, std::atomic<int>& started, int expected)
+        : type_(type), started_(started), expected_(expected) {}
+
+    DetectionType type() const override { return type_; }
+    bool enabled() const override { return enabled_; }
+    void setEnabled(bool enabled) override { enabled_ = enabled; }
+
+    void process(const cv::Mat& frame, std::vector<DetectionResult>& outResults) override {
+        ++started_;
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+        while (started_.load() < expected_ && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::yield();
+        }
+        overlapped = started_.load() >= expected_;
+
+        DetectionResult result;
+        result.type = type_;
+        result.boundingBox = cv::Rect(0, 0, frame.cols, frame.rows);
+        result.confidence = 1.0f;
+        outResults.push_back(result);
+    }
+
+    bool overlapped{false};
+
+private:
+    DetectionType type_;
+    std::atomic<int>& started_;
+    int expected_;
+    bool enabled_{true};
+};
+
+TEST(VideoProcessorTest, MergesResultsOfParallelDetectors) {
+    VideoProcessor processor;
+    // Only the stubs run; the model detector has nothing to load here
+    processor.setDetectionEnabled(DetectionType::EquipmentFailure, false);
+
+    std::atomic<int> started{0};
+    auto fire = std::make_unique<StubDetector>(DetectionType::Fire, started, 2);
+    auto gas = std::make_unique<StubDetector>(DetectionType::GasLeak, started, 2);
+    const StubDetector* fireStub = fire.get();
+    const StubDetector* gasStub = gas.get();
+    processor.registerDetector(std::move(fire));
+    processor.registerDetector(std::move(gas));
+
+    const cv::Mat frame(48, 64, CV_8UC3, cv::Scalar::all(0));
+    const auto results = processor.processFrame(frame);
+
+    ASSERT_EQ(results.size(), 2u);
+    const auto hasType = [&results](DetectionType type) {
+        return std::any_of(results.begin(), results.end(), [type](const DetectionResult& r) { return r.type == type; });
+    };
+    EXPECT_TRUE(hasType(DetectionType::Fire));
+    EXPECT_TRUE(hasType(DetectionType::GasLeak));
+    EXPECT_TRUE(fireStub->overlapped);
+    EXPECT_TRUE(gasStub->overlapped);
+
+    EXPECT_EQ(processor.frameLatency().count, 1u);
+    std::size_t timed = 0;
+    for (const auto& detector : processor.detectorLatencies()) {
+        if (detector.type == DetectionType::Fire || detector.type == DetectionType::GasLeak) {
+            EXPECT_EQ(detector.latency.count, 1u);
+            ++timed;
+        }
+    }
+    EXPECT_EQ(timed, 2u);
+}
+
+}
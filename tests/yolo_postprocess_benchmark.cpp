@@ -0,0 +1,160 @@
+// Times the YOLO output scan on synthetic tensors: the old path, which copied
+// each image's slice and built a score vector per anchor, against the
+// in-place scanYoloOutput used by UnifiedDetector.
+//
+// Usage: yolo_postprocess_benchmark [iterations]
+
+#include "modules/detection/yolo_output.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+using SnowOwl::Server::Modules::Detection::scanYoloOutput;
+
+namespace {
+
+constexpr std::size_t kClasses = 80;
+constexpr std::size_t kChannels = 4 + kClasses;
+constexpr std::size_t kAnchors = 8400;
+constexpr float kThreshold = 0.5f;
+
+struct Candidates {
+    std::vector<float> boxes;
+    std::vector<float> confidences;
+    std::vector<int> classIds;
+
+    void clear() {
+        boxes.clear();
+        confidences.clear();
+        classIds.clear();
+    }
+};
+
+// The previous postprocess: copies the slice, then allocates a score vector
+// for every anchor. It always indexed the tensor as [anchors, 4 + classes].
+std::size_t scanCopying(const float* tensor, std::size_t perImage) {
+    std::vector<float> output(tensor, tensor + perImage);
+    const int num_classes = static_cast<int>(kClasses);
+    const int num_detections = static_cast<int>(output.size() / kChannels);
+
+    std::vector<float> boxes;
+    std::vector<float> confidences;
+    std::vector<int> class_ids;
+
+    for (int i = 0; i < num_detections; ++i) {
+        std::vector<float> scores;
+        for (int c = 0; c < num_classes; ++c) {
+            scores.push_back(output[i * kChannels + 4 + c]);
+        }
+
+        auto max_score_it = std::max_element(scores.begin(), scores.end());
+        if (*max_score_it > kThreshold) {
+            for (int k = 0; k < 4; ++k) {
+                boxes.push_back(output[i * kChannels + k]);
+            }
+            confidences.push_back(*max_score_it);
+            class_ids.push_back(static_cast<int>(std::distance(scores.begin(), max_score_it)));
+        }
+    }
+    return confidences.size();
+}
+
+std::size_t scanInPlace(const float* tensor, bool channelMajor, std::vector<float>& bestScores,
+                        std::vector<int>& bestClasses, Candidates& out) {
+    out.clear();
+    scanYoloOutput(tensor, kAnchors, kClasses, channelMajor, kThreshold, bestScores, bestClasses,
+                   [&](float x, float y, float w, float h, float score, int classId) {
+                       out.boxes.insert(out.boxes.end(), {x, y, w, h});
+                       out.confidences.push_back(score);
+                       out.classIds.push_back(classId);
+                   });
+    return out.confidences.size();
+}
+
+// Scores mostly below the threshold with a few confident anchors, roughly
+// what a real frame produces
+std::vector<float> makeTensor(bool channelMajor, std::mt19937& rng) {
+    std::uniform_real_distribution<float> coord(0.0f, 640.0f);
+    std::uniform_real_distribution<float> score(0.0f, 0.3f);
+    std::bernoulli_distribution confident(0.01);
+    std::uniform_int_distribution<std::size_t> cls(0, kClasses - 1);
+    std::vector<float> tensor(kChannels * kAnchors);
+    for (std::size_t a = 0; a < kAnchors; ++a) {
+        auto at = [&](std::size_t ch) -> float& {
+            return tensor[channelMajor ? ch * kAnchors + a : a * kChannels + ch];
+        };
+        for (std::size_t ch = 0; ch < kChannels; ++ch) {
+            at(ch) = ch < 4 ? coord(rng) : score(rng);
+        }
+        if (confident(rng)) {
+            at(4 + cls(rng)) = 0.9f;
+        }
+    }
+    return tensor;
+}
+
+template <typename Fn>
+double millisecondsPerRun(int iterations, std::size_t& found, Fn&& fn) {
+    found = fn();
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        found = fn();
+    }
+    const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / iterations;
+}
+
+void report(const std::string& shape, const std::string& path, double ms, double baseline, std::size_t found) {
+    std::cout << std::left << std::setw(14) << shape << std::setw(10) << path << std::right << std::fixed
+              << std::setprecision(3) << std::setw(10) << ms << " ms" << std::setprecision(1) << std::setw(8)
+              << baseline / ms << "x" << std::setw(10) << found << std::endl;
+}
+
+}
+
+int main(int argc, char** argv) {
+    const int iterations = argc > 1 ? std::max(1, std::atoi(argv[1])) : 50;
+
+    std::mt19937 rng(42);
+    std::vector<float> bestScores;
+    std::vector<int> bestClasses;
+    Candidates candidates;
+    bool consistent = true;
+
+    std::cout << "YOLO postprocess, " << iterations << " iterations per path" << std::endl;
+    std::cout << std::left << std::setw(14) << "shape" << std::setw(10) << "path" << std::right << std::setw(13)
+              << "per frame" << std::setw(9) << "speedup" << std::setw(10) << "found" << std::endl;
+
+    for (const bool channelMajor : {true, false}) {
+        const std::vector<float> tensor = makeTensor(channelMajor, rng);
+        const std::string shape = channelMajor ? "[1,84,8400]" : "[1,8400,84]";
+
+        std::size_t copied = 0;
+        std::size_t inPlace = 0;
+        const double copyMs = millisecondsPerRun(iterations, copied, [&] {
+            return scanCopying(tensor.data(), tensor.size());
+        });
+        const double inPlaceMs = millisecondsPerRun(iterations, inPlace, [&] {
+            return scanInPlace(tensor.data(), channelMajor, bestScores, bestClasses, candidates);
+        });
+
+        report(shape, "copy", copyMs, copyMs, copied);
+        report(shape, "in-place", inPlaceMs, copyMs, inPlace);
+
+        // Both paths read [anchors, 4 + classes] the same way, so they must agree
+        if (!channelMajor && copied != inPlace) {
+            std::cerr << "yolo_postprocess_benchmark: copy path found " << copied << " candidates, in-place path "
+                      << inPlace << std::endl;
+            consistent = false;
+        }
+    }
+
+    return consistent ? EXIT_SUCCESS : EXIT_FAILURE;
+}